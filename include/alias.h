@@ -74,6 +74,8 @@
 
 	void 	add_var_alias      	(const char *name, const char *stuff, int noisy);
 	void 	add_local_alias    	(const char *name, const char *stuff, int noisy);
+	char *	local_alias_name	(const char *name);
+	void	set_local_alias		(const char *name, const char *stuff, int noisy);
 #if 0	/* Internal now */
 	void 	add_cmd_alias 	   	(void);
 #endif
@@ -82,8 +84,8 @@
 	void	add_builtin_variable_alias (const char *, IrcVariable *);
 	void    add_builtin_expando     (const char *name, char *(*func) (void));
 
-	void 	add_var_stub_alias 	(const char *name, const char *stuff);
-	void 	add_cmd_stub_alias 	(const char *name, const char *stuff);
+	void 	add_var_stub_alias 	(const char *name, const char *stuff, int noisy);
+	void 	add_cmd_stub_alias 	(const char *name, const char *stuff, int noisy);
 
 	void	delete_builtin_command	(const char *);
 	void	delete_builtin_function	(const char *);
@@ -129,6 +131,7 @@
  * The third argument are the command line expandoes $0, $1, etc.
  */
 	char *	expand_alias 		(const char *, const char *);
+	char *	expand_alias_temp	(const char *, const char *);
 
 /*
  * This is the interface to the "expression parser"
@@ -41,7 +41,7 @@ static uint32_t cs_alist_hash (const char *s, uint32_t *mask)
 				m |= 0x0000FF00;
 				if (s[3])
 				{
-					uint |= ((unsigned char) s[2]);
+					uint |= ((unsigned char) s[3]);
 					m |= 0x000000FF;
 				}
 			}
@@ -54,10 +54,14 @@ static uint32_t cs_alist_hash (const char *s, uint32_t *mask)
 #endif
 
 #ifdef __need_ci_alist_hash__
-extern unsigned char *stricmp_tables[3];
+extern unsigned char rfc1459_stricmp_table[];
 /*
  * This hash routine is for case insensitive keys.  Specifically keys that
  * cannot be prefolded to an appropriate case but are still insensitive
+ *
+ * The rfc1459 table folds everything the ascii one does (and {}|~ too),
+ * so two keys that any of our case insensitive compares think are the
+ * same always hash the same.
  */
 static uint32_t ci_alist_hash (const char *s, uint32_t *mask)
 {
@@ -71,19 +75,19 @@ static uint32_t ci_alist_hash (const char *s, uint32_t *mask)
 	// This is clean, branchless-adjacent logic
 	if (s[0])
 	{
-		uint |= ((unsigned char)stricmp_tables[0][(unsigned char)s[0]]) << 24;
+		uint |= ((unsigned char)rfc1459_stricmp_table[(unsigned char)s[0]]) << 24;
 		m = 0xFF000000;
 		if (s[1])
 		{
-			uint |= ((unsigned char)stricmp_tables[0][(unsigned char)s[1]]) << 16;
+			uint |= ((unsigned char)rfc1459_stricmp_table[(unsigned char)s[1]]) << 16;
 			m |= 0x00FF0000;
 			if (s[2])
 			{
-				uint |= ((unsigned char)stricmp_tables[0][(unsigned char)s[2]]) << 8;
+				uint |= ((unsigned char)rfc1459_stricmp_table[(unsigned char)s[2]]) << 8;
 				m |= 0x0000FF00;
 				if (s[3])
 				{
-					uint |= ((unsigned char)stricmp_tables[0][(unsigned char)s[3]]);
+					uint |= ((unsigned char)rfc1459_stricmp_table[(unsigned char)s[3]]);
 					m |= 0x000000FF;
 				}
 			}
@@ -112,6 +116,15 @@ typedef enum {
  * This is the actual list, that contains structs that are of the
  * form described above.  It contains the current size and the maximum
  * size of the alist.
+ *
+ * The list is always sorted, because people walk list[] directly and
+ * find_alist_item() does prefix matches.  Once an alist gets big, it
+ * also gets a hash index of the names, so exact lookups (alist_lookup(),
+ * and the replace/remove in add_to_alist() and remove_from_alist()) don't
+ * have to search.  If you throw away list[] yourself instead of using
+ * alist_pop(), you must call alist_free_index() too.  The exception to
+ * "always sorted" is alist_append(); if you use that, call alist_sort()
+ * before you walk list[] yourself.
  */
 typedef struct
 {
@@ -120,13 +133,17 @@ typedef struct
 	int 		total_max;
 	alist_func 	func;
 	hash_type 	hash;
+	struct alist_index_stru *index;	/* Made by alist.c when it's big */
 } alist;
 
 void *	add_to_alist 		(alist *, const char *, void *);
+void *	alist_append		(alist *, const char *, void *);
+void	alist_sort		(alist *);
 void *	remove_from_alist 	(alist *, const char *);
 void *	alist_lookup 		(alist *, const char *, int);
 void *	find_alist_item 	(alist *, const char *, int *, int *);
 void *	alist_pop		(alist *, int);
 void *  get_alist_item 		(alist *, int);
+void	alist_free_index	(alist *);
 
 #endif
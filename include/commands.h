@@ -21,6 +21,13 @@ extern	const char *		current_command;
 
 extern	int	need_defered_commands;
 
+typedef struct BlockStru
+{
+	char *	text;		/* The block, with a nul after each statement */
+	char **	stmts;		/* Where each statement starts in 'text' */
+	int	count;
+} Block;
+
 	void	init_commands		(void);
 
         char *  call_lambda_function    (const char *, const char *, const char *);
@@ -29,10 +36,14 @@ extern	int	need_defered_commands;
         void    call_user_command       (const char *, const char *, char *, void *);
 	void	runcmds			(const char *, const char *);
         void    runcmds_with_arglist    (const char *, char *, const char *);
+	Block *	compile_block		(const char *);
+	void	run_block		(const Block *, const char *);
+	void	destroy_block		(Block **);
 
 	int     parse_statement 	(const char *, int, const char *);
 
 	BUILT_IN_COMMAND(load);
+	void	stub_package		(const char *);
 	void	send_text	 	(int, const char *, const char *, const char *, int, int);
 	int	command_exist		(char *);
 	BUILT_IN_COMMAND(e_channel);
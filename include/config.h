@@ -71,6 +71,7 @@
 #define DEFAULT_INSERT_MODE 1
 #define DEFAULT_KEY_INTERVAL 1000
 #define DEFAULT_LASTLOG 256
+#define DEFAULT_LASTLOG_INDEX 0
 #define DEFAULT_LASTLOG_LEVEL "ALL"
 #define DEFAULT_LASTLOG_REWRITE (const char *)NULL
 #define DEFAULT_LOG 0
@@ -25,16 +25,33 @@ struct epic_loadfile {
     struct archive *a;
     struct archive_entry *entry;
 #endif
+    struct epic_decompress *dc;
     int eof;
 };
 
+/* How a file is compressed (see uzfopen()) */
+#define COMPRESS_NONE	0
+#define COMPRESS_Z	1	/* compress(1) -- .Z */
+#define COMPRESS_GZIP	2	/* gzip(1) -- .gz and .z */
+#define COMPRESS_BZIP2	3	/* bzip2(1) -- .bz2 */
+#define COMPRESS_XZ	4	/* xz(1) -- .xz */
+
 	struct epic_loadfile * epic_fopen (char *filename, const char *mode, int do_error);
 	int 	epic_fgetc (struct epic_loadfile *elf);
 	char *	epic_fgets (char *s, int n, struct epic_loadfile *elf);
 	int 	epic_feof (struct epic_loadfile *elf);
 	int 	epic_fclose (struct epic_loadfile *elf);
+	int	epic_ferror (struct epic_loadfile *elf);
+	int	epic_frewind (struct epic_loadfile *elf);
+	int	epic_fseek (struct epic_loadfile *elf, off_t offset, int whence);
+	off_t	epic_ftell (struct epic_loadfile *elf);
+	ssize_t	epic_fread (struct epic_loadfile *elf, char *buf, size_t n);
 	off_t 	epic_stat (const char *filename, struct stat *buf);
 	size_t  slurp_elf_file (struct epic_loadfile *elf, char **file_contents, off_t *file_contents_size);
+	int	map_elf_file (struct epic_loadfile *elf, char **file_contents, off_t *file_contents_size);
+	void	unmap_elf_file (char *file_contents, off_t file_contents_size);
+	int	epic_can_decompress (int how);
+	struct epic_loadfile * epic_fopen_decompress (const char *filename, int how, int do_error);
 
 	int     string_feof( const char *file_contents, off_t file_contents_size);
 	int     string_fgetc (const char **file_contents, off_t *file_contents_size);
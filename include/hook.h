@@ -109,6 +109,9 @@ enum HOOK_TYPES {
 #define NUMBER_OF_LISTS ZZZZ_THIS_ALWAYS_COMES_LAST_ZZZZ
 #define INVALID_HOOKNUM -1001
 
+/* A hook that calls C instead of ircII: (data, event, argc, argv) */
+typedef int	(*NativeHook) (void *, const char *, int, char **);
+
 	BUILT_IN_COMMAND(oncmd);
 	BUILT_IN_COMMAND(shookcmd);
 
@@ -120,6 +123,7 @@ enum HOOK_TYPES {
 	void	save_hooks 		(FILE *, int);
 	void	do_stack_on		(int, char *);
 	int	hook_find_free_serial	(int, int, int);
+	int	add_native_hook		(const char *, int, const char *, const char *, NativeHook, void *, void (*) (void *));
 
 	extern int deny_all_hooks;
 
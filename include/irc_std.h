@@ -70,6 +70,7 @@
 /*
  * Everybody needs these POSIX headers...
  */
+#include <dirent.h>		/* Issue 1 */
 #include <errno.h>		/* Issue 1 */
 #include <fcntl.h>		/* Issue 1 */
 #include <limits.h>		/* Issue 1 */
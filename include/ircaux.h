@@ -31,22 +31,63 @@ struct metric_time {
 	void *	really_new_malloc 	(size_t, const char *, int);
 	void *	really_new_free 	(void **, const char *, int);
 	void *	really_new_realloc 	(void **, size_t, const char *, int);
+	char *	memctl			(char *);
 
 	/* - - - - Functions dealing with copying strings - - - - */
-	char *	malloc_sprintf 		(char **, const char *, ...) __A(2);
-	char *	malloc_vsprintf 	(char **, const char *, va_list);
-	char *	malloc_strcdup		(int, ...);
+/* Like new_malloc(), these pass in where they were called from */
+#define		malloc_sprintf(...)	really_malloc_sprintf(__FILE__, __LINE__, __VA_ARGS__)
+#define		malloc_vsprintf(x,y,z)	really_malloc_vsprintf((x), (y), (z), __FILE__, __LINE__)
+#define		malloc_strcdup(...)	really_malloc_strcdup(__FILE__, __LINE__, __VA_ARGS__)
+#define		malloc_strcpy(x,y)	really_malloc_strcpy((x), (y), __FILE__, __LINE__)
+	char *	really_malloc_sprintf 	(const char *, int, char **, const char *, ...) __A(4);
+	char *	really_malloc_vsprintf 	(char **, const char *, va_list, const char *, int);
+	char *	really_malloc_strcdup	(const char *, int, int, ...);
+	char *	really_malloc_strcpy	(char **, const char *, const char *, int);
 #define		malloc_strdup(x)	malloc_strcdup(1, x)
 #define		malloc_strdup2(x,y)	malloc_strcdup(2, x, y)
 #define		malloc_strdup3(x,y,z)	malloc_strcdup(3, x, y, z)
 	char *	malloc_strext	 	(const char *, ptrdiff_t);
-	char *	malloc_strcpy		(char **, const char *);
 	char *	malloc_strcat		(char **, const char *);
 	char *	malloc_strcat_ues	(char **, const char *, const char *);
 	char *	malloc_strcat_word      (char **, const char *, const char *, int);
 	char *	malloc_strcat_wordlist  (char **, const char *, const char *);
-	char *	malloc_sprintf 		(char **, const char *, ...) __A(2);
-	char *  malloc_vsprintf		(char **, const char *, va_list);
+
+	/* - - - - Statement-scoped scratch memory - - - - */
+typedef struct ArenaMarkStru
+{
+	void *	chunk;
+	size_t	used;
+	size_t	checked;
+} ArenaMark;
+
+	void	arena_mark		(ArenaMark *);
+	void	arena_release		(const ArenaMark *);
+	void	arena_reset		(void);
+	void *	arena_alloc		(size_t);
+	void *	arena_realloc		(void *, size_t, size_t);
+	char *	arena_strdup		(const char *);
+
+	/* - - - - Functions dealing with building strings - - - - */
+typedef struct StrbufStru
+{
+	char *	str;		/* new_malloc()ed (or arena), or NULL */
+	size_t	len;		/* strlen(str) */
+	size_t	size;		/* Bytes allocated for str */
+	int	temp;		/* str is in the scratch arena */
+} Strbuf;
+
+	void	strbuf_init		(Strbuf *);
+	void	strbuf_init_temp	(Strbuf *);
+	void	strbuf_adopt		(Strbuf *, char **);
+	void	strbuf_reserve		(Strbuf *, size_t);
+	char *	strbuf_ncat		(Strbuf *, const char *, size_t);
+	char *	strbuf_cat		(Strbuf *, const char *);
+	char *	strbuf_cat_escaped	(Strbuf *, const char *, const char *);
+	char *	strbuf_cat_ues		(Strbuf *, const char *, const char *);
+	char *	strbuf_cat_word		(Strbuf *, const char *, const char *, int);
+	char *	strbuf_cat_wordlist	(Strbuf *, const char *, const char *);
+	char *	strbuf_release		(Strbuf *);
+	void	strbuf_free		(Strbuf *);
 
 	/* - - - - Functions dealing with irc things - - - - */
 	char *	check_nickname 		(char *);
@@ -102,6 +143,7 @@ struct 	epic_loadfile *	uzfopen 	(char **, const char *, int, struct stat *);
 #define my_table_stricmp(x, y, t) my_table_strnicmp(x, y, UINT_MAX, t)
 	int	server_strnicmp		(const char *, const char *, size_t, int);
 #define server_stricmp(x, y, s)	server_strnicmp(x, y, UINT_MAX, s)
+	uint32_t server_strhash		(const char *);
 	int	my_stricmp 		(const char *, const char *);
 	int     my_strncmp 		(const char *, const char *, size_t);
 	int	my_strnicmp 		(const char *, const char *, size_t);
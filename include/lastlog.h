@@ -22,6 +22,7 @@ extern	double	output_expires_after;
 	Mask	real_notify_mask 		(void);
 	void	set_lastlog_mask 		(void *);
 	void	set_lastlog_size 		(void *);
+	void	set_lastlog_index		(void *);
 	void	set_notify_mask 		(void *);
 	int	recount_window_lastlog		(int);
 	void	trim_lastlog			(int);
@@ -30,6 +31,7 @@ extern	double	output_expires_after;
 	intmax_t add_to_lastlog 		(int, const char *);
 	char *	function_line			(char *);
 	char *	function_lastlog		(char *);
+	int	walk_window_lastlog		(int, int, int, void (*) (void *, intmax_t, const char *, const char *, const char *, time_t), void *);
 	void	set_new_server_lastlog_mask	(void *);
 	void	set_old_server_lastlog_mask	(void *);
 	void	reconstitute_scrollback		(int);
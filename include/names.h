@@ -11,6 +11,8 @@
 	void	add_channel		(const char *, int); 
 	void	remove_channel		(const char *, int);
 	void	add_to_channel		(const char *, const char *, int, int, int, int, int);
+	void	add_names_to_channel	(const char *, const char *, int);
+	void	channel_names_done	(const char *, int);
 	void	add_userhost_to_channel	(const char *, const char *, int, const char *);
 	void	remove_from_channel	(const char *, const char *, int);
 	void	rename_nick		(const char *, const char *, int);
@@ -34,6 +36,7 @@
 	int	is_channel_nomsgs	(const char *, int);
 	int	is_channel_anonymous	(const char *, int);
 	char *	scan_channel		(char *);
+	int	walk_channel_nicks	(const char *, int, void (*) (void *, const char *, const char *, const char *), void *);
 	void	list_channels		(void);
 	BUILT_IN_KEYBINDING(switch_channels);
 	const char *	window_current_channel	(int, int);
@@ -43,6 +46,10 @@
 	const char *	what_channel		(const char *, int);
 	const char *	walk_channels		(int, const char *);
 	const char *	fetch_userhost		(int, const char *, const char *);
+	void	set_user_away		(int, const char *, int);
+	void	set_user_account	(int, const char *, const char *);
+	int	fetch_user_away		(int, const char *);
+	const char *	fetch_user_account	(int, const char *);
 	int	get_channel_limit	(const char *, int);
 	int	get_channel_oper	(const char *, int);
 	int	get_channel_voice	(const char *, int);
@@ -0,0 +1,31 @@
+/*
+ * profile.h -- The script profiler
+ *
+ * Copyright 2026 EPIC Software Labs
+ * See the COPYRIGHT file, or do a HELP IRCII COPYRIGHT
+ */
+
+#ifndef __profile_h__
+#define __profile_h__
+
+typedef enum {
+	PROFILE_ALIAS,
+	PROFILE_HOOK,
+	PROFILE_FUNCTION,
+	PROFILE_COMMAND
+} ProfileKind;
+
+extern	int	profiling;
+
+	BUILT_IN_COMMAND(profilecmd);
+	int	profile_enter	(ProfileKind kind, const char *name);
+	void	profile_leave	(int entered);
+
+/*
+ * Wrap these around anything you want profiled.  When the profiler is
+ * off, this costs one test of a global.
+ */
+#define PROFILE_ENTER(kind, name)	(profiling ? profile_enter((kind), (name)) : 0)
+#define PROFILE_LEAVE(entered)		do { if (entered) profile_leave(entered); } while (0)
+
+#endif
@@ -33,6 +33,19 @@ typedef struct
 	int	enabled;
 } OPTION_item;
 
+/*
+ * The 005s that get looked at all the time (for every nick in a NAMES
+ * reply, every mode change, every message) are kept here already parsed,
+ * so nobody has to look them up and pick them apart every time.
+ * set_server_005() keeps this up to date.
+ */
+typedef struct
+{
+	char		prefix_mode[256];	/* PREFIX: '@' -> 'o', and so on */
+	char		mode_type[256];		/* What chanmodetype() returns */
+	unsigned char	chantypes[32];		/* CHANTYPES, as a bitmap */
+} ISupport;
+
 typedef struct WaitCmdstru
 {
         char    *stuff;
@@ -92,6 +105,7 @@ typedef	struct
 	char *		version_string;		/* what is says */
 	alist		options;		/* 005/CAP settings kept kere. */
 	int		stricmp_table;		/* Which case insensitive map to use */
+	ISupport	isupport;		/* Some of 'options', pre-parsed */
 	int		line_length;		/* How long a protocol command may be */
 	int		max_cached_chan_size;	/* Bigger channels won't cache U@H */
 
@@ -258,7 +272,11 @@ const	char *	get_pending_nickname		(int);
 	void	nickname_change_rejected	(int, const char *);
 
 const	char*	get_server_005			(int, const char *);
+	int	walk_server_005			(int, void (*) (void *, const char *, const char *), void *);
 	void	set_server_005			(int, char*, const char*);
+const	char *	get_server_prefix_modes		(int);
+	int	get_server_chanmode_type	(int, int);
+	int	is_server_chantype		(int, int);
 
 	void	server_hard_wait		(int);
         void    server_passive_wait 		(int, const char *);
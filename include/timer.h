@@ -19,7 +19,7 @@ typedef enum {
 	void	ExecuteTimers 	(void);
 	char *	add_timer	(int, const char *, double, long, 
 				 int (*) (void *), void *, const char *, 
-				 TimerDomain, int, int, int);
+				 TimerDomain, int, int, int, double);
 	int	timer_exists	(const char *);
 	int     remove_timer	(const char *);
 	Timespec	TimerTimeout 	(void);
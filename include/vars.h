@@ -51,8 +51,10 @@ int	ACCEPT_INVALID_SSL_CERT_VAR,
 	INSERT_MODE_VAR,
 	KEY_INTERVAL_VAR,
 	LASTLOG_VAR,
+	LASTLOG_INDEX_VAR,
 	LASTLOG_LEVEL_VAR,
 	LASTLOG_REWRITE_VAR,
+	LOAD_CACHE_VAR,
 	LOAD_PATH_VAR,
 	LOG_VAR,
 	LOGFILE_VAR,
@@ -151,6 +151,14 @@ When the user types "/hello Python World" it will translate to
 All python aliases have a small ircii shim installed. You can examine
 this shim by typing "/alias hello" at the EPIC prompt.
 
+If you pass `native=True`, your function is registered as a builtin command
+instead, and EPIC calls it directly without going through an alias or
+looking up the function by name each time:
+
+    @alias('hello', native=True)
+    def hello(args):
+        xecho('Hello, %s!' % args)
+
 @on()
 -----
 
@@ -178,6 +186,17 @@ their client will print out a warning:
 All python event triggers have a small ircii shim installed. You can examine
 the shim installed for our example by typing "/on privmsg" at the EPIC prompt.
 
+If you pass `native=True`, EPIC calls your function directly instead, without
+a shim. A native event handler gets one string argument for each of the
+event's words, with the last one getting the rest of the line. As with any
+/ON, the noise indicator decides whether EPIC's default action is suppressed.
+With NOISE_UNKNOWN ("?"), it is suppressed if your function returns something
+true:
+
+    @on('msg', noise_indicator=NOISE_UNKNOWN, native=True)
+    def on_msg(nick, text):
+        xecho('%s said %s' % (nick, text))
+
 Calling EPIC From Python
 ========================
 
@@ -230,6 +249,23 @@ Example, get the list of servers you're connected to:
 
     servers = expression('myservers()')
 
+run_async()
+-----------
+
+If your event handler has something slow to do (score a message for spam,
+look up a URL title) you can hand it to `run_async()`. It runs on a worker
+thread and your handler returns right away, so the client keeps going. When
+it's finished, the `done` function gets the return value, back on the main
+thread, and that's where you output things. The slow function itself must
+not call any EPIC functions.
+
+Example:
+
+    @on('public', native=True)
+    def on_public(nick, channel, text):
+        run_async(score_spam, (text,), lambda score:
+            score > 0.9 and xecho('%s is spamming %s' % (nick, channel)))
+
 register_listener_callback()
 ----------------------------
 
@@ -317,6 +353,7 @@ from importlib import reload
 
 from _epic import callback_when_readable, cancel_callback, cmd, eval, expand, expr, echo, say, call
 from _epic import run_command, call_function, get_set, get_assign, get_var, builtin_cmd
+from _epic import on as native_on, run_async
 
 # Map some commands to friendlier names
 command = cmd
@@ -338,6 +375,7 @@ NOISE_SILENT = '^'
 NOISE_QUIET = '-'
 NOISE_NOISY = '+'
 NOISE_SYSTEM = '%'
+NOISE_UNKNOWN = '?'
 
 # Tracking object for registered socket listeners.
 # Format: _listening_sockets[<fd_num>] = (<dispatch_function>, <cleanup_function>)
@@ -524,14 +562,21 @@ def xecho(message, all=False, all_server=False, banner=True, current=False,
 
 
 # Decorators for registering python functions as aliases or hooks
-def alias(name):
+def alias(name, native=False):
     """A decorator used to register an epic alias.
 
     Epic aliases will always be called with a single argument, and that
     argument will be a string. Aliases are responsible for doing their own
     argument parsing.
+
+    When `native` is True the function is registered as a builtin command
+    that EPIC calls directly, instead of through an ircII alias.
     """
     def decorator(f):
+        if native:
+            builtin_cmd(name, f)
+            return f
+
         module = f.__module__
         function = f.__name__
         eval("^alias %s {pydirect %s.%s $*}" % (name, module, function))
@@ -543,7 +588,7 @@ def alias(name):
 
 def on(event_type, wildcard_pattern='*', noise_indicator=NOISE_SILENT,
     exclude_match=False, delete=False, serial_number='-',
-    flexible_pattern=False):
+    flexible_pattern=False, native=False):
     """A decorator used to register an epic event handler.
 
     For complete detail about how epic event handlers work consult the epic5
@@ -614,11 +659,38 @@ def on(event_type, wildcard_pattern='*', noise_indicator=NOISE_SILENT,
         * NOISE_QUIET: suppress all output, run the *default action*.
         * NOISE_NOISY: show all output
         * NOISE_SYSTEM: display echoed output and supress the *default action*
+        * NOISE_UNKNOWN: suppress all output, run the *default action* unless
+          a native handler returns something true (native hooks only)
 
     `flexible_pattern`
         When true the `wildcard_pattern` will be expanded every time the hook
         is matched. When false the `wildcard_pattern` will be matched as is.
+
+    `native`
+        When True EPIC calls the function directly, with one argument for
+        each of the event's words, instead of through an ircII shim. With
+        NOISE_UNKNOWN, the *default action* is suppressed if the function
+        returns something true.
+        Native handlers take an integer `serial_number` (anything else means
+        0), and can't be used with `delete`, `exclude_match` or
+        `flexible_pattern`.
     """
+    if native and not (delete or exclude_match or flexible_pattern):
+        if noise_indicator not in (NOISE_DEFAULT, NOISE_SILENT, NOISE_QUIET,
+                                  NOISE_NOISY, NOISE_SYSTEM, NOISE_UNKNOWN):
+            echo('Unknown noise_indicator %s' % noise_indicator)
+            noise_indicator = NOISE_DEFAULT
+        try:
+            serial = int(serial_number)
+        except ValueError:
+            serial = 0
+
+        def native_decorator(f):
+            native_on(noise_indicator + event_type, wildcard_pattern, f, serial)
+            return f
+
+        return native_decorator
+
     if serial_number:
         sni = '#'
         serial_number = ' ' + str(serial_number)
@@ -99,6 +99,9 @@ typedef	struct	SymbolStru
 	char *	user_variable;
 	int	user_variable_stub;
 	char *	user_variable_package;
+	int	user_variable_cached;	/* Which of these are valid: */
+	intmax_t	user_variable_integer;	/* STR2INT(user_variable) */
+	long double	user_variable_float;	/* atolf(user_variable) */
 
 	char *	user_command;
 	int	user_command_stub;
@@ -114,6 +117,12 @@ struct SymbolStru *	saved;		/* For stacks */
 	int	saved_hint;
 }	Symbol;
 
+#define CACHED_INTEGER		1
+#define CACHED_FLOAT		2
+
+/* Call this whenever you change a symbol's user_variable */
+#define forget_symbol_number(s)	((s)->user_variable_cached = 0)
+
 #define SAVED_VAR		 1
 #define SAVED_CMD		 2
 #define SAVED_BUILTIN_CMD	 4
@@ -131,10 +140,46 @@ const char *symbol_types[] = {
  * This is the description for a list of aliases
  * This is an ``alist'' structure
  */
-static alist globals = 	{ NULL, 0, 0, my_strncmp, HASH_INSENSITIVE };
+static alist globals = 	{ NULL, 0, 0, my_strncmp, HASH_INSENSITIVE, NULL };
+
+/*
+ * Every $func() call and every /command looks its name up in the globals,
+ * and scripts call the same handful of names over and over again.  So we
+ * keep a small direct-mapped cache of name -> Symbol bindings.
+ *
+ * A binding is good for as long as ``symbol_generation'' hasn't changed.
+ * The generation is bumped whenever a symbol is added to or removed from
+ * the globals, because that is the only way a name can come to refer to
+ * a different Symbol.  Everything else (redefining an alias, /stack push,
+ * and so forth) changes the Symbol in place, and since callers always
+ * read the Symbol's fields fresh, they see those changes for free.
+ *
+ * Stubs are never cached, because looking them up does a /load.
+ */
+#define SYMBOL_BINDINGS	256
+
+typedef struct SymbolBindingStru
+{
+	char *		name;
+	unsigned long	generation;
+	Symbol *	symbol;
+} SymbolBinding;
+
+static	SymbolBinding	symbol_bindings[SYMBOL_BINDINGS];
+static	unsigned long	symbol_generation = 1;
 
 static	Symbol *lookup_symbol 	   (const char *name);
-static	Symbol *find_local_alias   (const char *name, alist **list);
+static	Symbol *find_global_symbol (const char *name);
+static	Symbol *lookup_symbol_to_define (const char *name);
+static	Symbol *resolve_symbol 	   (const char *name);
+static	void	add_global_symbol  (const char *name, Symbol *item);
+static	void	flush_symbol_bindings (void);
+static	Symbol *find_local_alias   (const char *name, int *frame);
+static	void	add_local_symbol   (int frame, const char *name, Symbol *item);
+static	void	reset_local_frame  (int frame);
+static	Symbol *assign_var_alias   (const char *name, const char *stuff, int noisy);
+static	Symbol *set_local_symbol   (const char *name, const char *stuff, int noisy);
+static	Symbol *find_variable_symbol (const char *name, Symbol **builtin);
 
 /*
  * This is the ``stack frame''.  Each frame has a ``name'' which is
@@ -150,8 +195,19 @@ typedef struct RuntimeStackStru
 	alist	alias;		/* Local variables */
 	int	locked;		/* Are we locked in a wait? */
 	int	parent;		/* Our parent stack frame */
+	uint32_t initials;	/* Bloom filter of locals' first letters */
+	int	stems;		/* How many locals end in a dot */
 }	RuntimeStack;
 
+/*
+ * Every variable lookup looks in the local frames first, and almost none
+ * of them find anything there.  Each frame keeps a bitmask of the first
+ * letter of every local it holds, so we can walk past frames that could
+ * not possibly have the variable.  A stem (a local ending in a dot) always
+ * has the same first letter as the implicit locals under it.
+ */
+#define LOCAL_INITIAL(name)	((uint32_t)1 << ((unsigned char)*(name) & 31))
+
 /*
  * This is the foundational stack frame.  Its size is saved in ``max_wind''
  * and the current frame being used is stored in ``wind_index''.
@@ -243,6 +299,7 @@ void	flush_all_symbols (void)
 		new_free(&s);
 	}
 	new_free(&globals.list);
+	flush_symbol_bindings();
 }
 
 
@@ -455,13 +512,14 @@ BUILT_IN_COMMAND(assigncmd)
  * User front end to the STUB command
  * Syntax to stub an alias to a file:	STUB ALIAS name[,name] filename(s)
  * Syntax to stub a variable to a file:	STUB ASSIGN name[,name] filename(s)
+ * Syntax to stub everything in files:	STUB PACKAGE dir-or-file [...]
  */
 BUILT_IN_COMMAND(stubcmd)
 {
 	int 	type;
 	char 	*cmd;
 	char 	*name;
-const 	char 	*usage = "Usage: STUB (alias|assign) <name> <file> [<file> ...]";
+const 	char 	*usage = "Usage: STUB (alias|assign) <name> <file> [<file> ...] | STUB PACKAGE <dir> [<dir> ...]";
 
 	/*
 	 * The first argument is the type of stub to make
@@ -478,6 +536,17 @@ const 	char 	*usage = "Usage: STUB (alias|assign) <name> <file> [<file> ...]";
 		type = COMMAND_ALIAS;
 	else if (!strncmp(cmd, "ASSIGN", strlen(cmd)))
 		type = VAR_ALIAS;
+	else if (!strncmp(cmd, "PACKAGE", strlen(cmd)))
+	{
+		if (!args || !*args)
+		{
+			my_error("Missing directory name");
+			say("%s", usage);
+		}
+		while ((name = new_next_arg(args, &args)))
+			stub_package(name);
+		return;
+	}
 	else
 	{
 		my_error("[%s] is an Unrecognized stub type", cmd);
@@ -528,9 +597,9 @@ const 	char 	*usage = "Usage: STUB (alias|assign) <name> <file> [<file> ...]";
 
 		real_name = remove_brackets(name, NULL);
 		if (type == COMMAND_ALIAS)
-			add_cmd_stub_alias(real_name, args);
+			add_cmd_stub_alias(real_name, args, 1);
 		else
-			add_var_stub_alias(real_name, args);
+			add_var_stub_alias(real_name, args, 1);
 
 		new_free(&real_name);
 		name = next_name;
@@ -555,7 +624,7 @@ BUILT_IN_COMMAND(localcmd)
 
 	if (!my_strnicmp(name, "-dump", 2))	/* Unusable name anyways */
 	{
-		destroy_var_aliases(&call_stack[wind_index].alias);
+		reset_local_frame(wind_index);
 		return;
 	}
 
@@ -972,6 +1041,7 @@ static Symbol *make_new_Symbol (const char *name)
 	tmp->user_variable = NULL;
 	tmp->user_variable_stub = 0;
 	tmp->user_variable_package = NULL;
+	tmp->user_variable_cached = 0;
 
 	tmp->user_command = NULL;
 	tmp->user_command_stub = 0;
@@ -1029,6 +1099,8 @@ static int	GC_symbol (Symbol *item, alist *list, int loc)
 
 	if (list && loc >= 0)
 		alist_pop(list, loc);
+	if (list == &globals)
+		symbol_generation++;
 
 	new_free(&item->user_variable_package);
 	new_free(&item->user_command_package);
@@ -1052,6 +1124,16 @@ static int	GC_symbol (Symbol *item, alist *list, int loc)
  * local variable is used (invisibly)
  */
 void	add_var_alias	(const char *orig_name, const char *stuff, int noisy)
+{
+	assign_var_alias(orig_name, stuff, noisy);
+}
+
+/*
+ * The guts of add_var_alias().  Returns the symbol that now holds 'stuff',
+ * or NULL if there isn't one (because of an error, or because 'stuff' was
+ * empty and the variable was deleted).
+ */
+static Symbol *	assign_var_alias (const char *orig_name, const char *stuff, int noisy)
 {
 	const char 	*ptr;
 	Symbol 	*tmp = NULL;
@@ -1077,13 +1159,13 @@ void	add_var_alias	(const char *orig_name, const char *stuff, int noisy)
 	 * Weed out FUNCTION_RETURN (die die die)
 	 */
 	else if (!strcmp(name, "FUNCTION_RETURN"))
-		add_local_alias(name, stuff, noisy);
+		tmp = set_local_symbol(name, stuff, noisy);
 
 	/*
 	 * Pass the buck on local variables
 	 */
 	else if ((local == 1) || (local == 0 && find_local_alias(name, NULL)))
-		add_local_alias(name, stuff, noisy);
+		tmp = set_local_symbol(name, stuff, noisy);
 
 	else if (stuff && *stuff)
 	{
@@ -1098,7 +1180,7 @@ void	add_var_alias	(const char *orig_name, const char *stuff, int noisy)
 		if (!tmp || cnt >= 0)
 		{
 			tmp = make_new_Symbol(name);
-			add_to_alist(&globals, name, tmp);
+			add_global_symbol(name, tmp);
 		}
 
 		if (current_package())
@@ -1110,6 +1192,7 @@ void	add_var_alias	(const char *orig_name, const char *stuff, int noisy)
 		}
 
 		malloc_strcpy(&(tmp->user_variable), stuff);
+		forget_symbol_number(tmp);
 		tmp->user_variable_stub = 0;
 
 
@@ -1123,10 +1206,10 @@ void	add_var_alias	(const char *orig_name, const char *stuff, int noisy)
 		delete_var_alias(name, noisy);
 
 	new_free(&save);
-	return;
+	return tmp;
 }
 
-void	add_var_stub_alias  (const char *orig_name, const char *stuff)
+void	add_var_stub_alias  (const char *orig_name, const char *stuff, int noisy)
 {
 	Symbol *tmp = NULL;
 	const char *ptr;
@@ -1149,12 +1232,12 @@ void	add_var_stub_alias  (const char *orig_name, const char *stuff)
 	}
 
 
-	if (!(tmp = lookup_symbol(name)))
+	if (!(tmp = lookup_symbol_to_define(name)))
 	{
 		tmp = make_new_Symbol(name);
 		if (current_package())
 		    tmp->user_variable_package = malloc_strdup(current_package());
-		add_to_alist(&globals, name, tmp);
+		add_global_symbol(name, tmp);
 	}
 	else if (current_package())
 	{
@@ -1164,18 +1247,36 @@ void	add_var_stub_alias  (const char *orig_name, const char *stuff)
 	}
 
 	malloc_strcpy(&(tmp->user_variable), stuff);
+	forget_symbol_number(tmp);
 	tmp->user_variable_stub = 1;
 
-	say("Assign %s stubbed to file %s", name, stuff);
+	if (noisy)
+		say("Assign %s stubbed to file %s", name, stuff);
 	new_free(&name);
 	return;
 }
 
 void	add_local_alias	(const char *orig_name, const char *stuff, int noisy)
+{
+	char *	name;
+
+	if (!(name = local_alias_name(orig_name)))
+		return;
+
+	set_local_alias(name, stuff, noisy);
+	new_free(&name);
+}
+
+/*
+ * local_alias_name: Check and canonicalize the name of a local variable.
+ * Loops assign to their loop variable every time through, so they call 
+ * this once and then call set_local_alias() with the result.
+ * Returns NULL if 'orig_name' is not a valid local variable name.
+ * YOU MUST new_free() THE RETURN VALUE.
+ */
+char *	local_alias_name (const char *orig_name)
 {
 	const char 	*ptr;
-	Symbol 	*tmp = NULL;
-	alist *list = NULL;
 	char *	name;
 
 	name = remove_brackets(orig_name, NULL);
@@ -1189,23 +1290,42 @@ void	add_local_alias	(const char *orig_name, const char *stuff, int noisy)
 		my_error("LOCAL names may not contain '%c' (You asked for [%s])", 
 						*ptr, name);
 		new_free(&name);
-		return;
+		return NULL;
 	}
-	
+
+	return name;
+}
+
+/*
+ * set_local_alias: Assign 'stuff' to a local variable whose 'name' came
+ * from local_alias_name().  If the variable already exists, its value is
+ * overwritten in place.
+ */
+void	set_local_alias (const char *name, const char *stuff, int noisy)
+{
+	set_local_symbol(name, stuff, noisy);
+}
+
+static Symbol *	set_local_symbol (const char *name, const char *stuff, int noisy)
+{
+	Symbol 	*tmp = NULL;
+	int	frame = -1;
+
 	/*
 	 * Now we see if this local variable exists anywhere
 	 * within our view.  If it is, we dont care where.
 	 * If it doesnt, then we add it to the current frame,
 	 * where it will be reaped later.
 	 */
-	if (!(tmp = find_local_alias (name, &list)))
+	if (!(tmp = find_local_alias (name, &frame)))
 	{
 		tmp = make_new_Symbol(name);
-		add_to_alist (list, name, tmp);
+		add_local_symbol(frame, name, tmp);
 	}
 
 	/* Fill in the interesting stuff */
 	malloc_strcpy(&(tmp->user_variable), stuff);
+	forget_symbol_number(tmp);
 	if (tmp->user_variable)		/* Oh blah. */
 	{
 		if (noisy)
@@ -1213,9 +1333,7 @@ void	add_local_alias	(const char *orig_name, const char *stuff, int noisy)
 		else
 			debug(DEBUG_LOCAL_VARS, "Assign %s (local) added [%s]", name, stuff);
 	}
-
-	new_free(&name);
-	return;
+	return tmp;
 }
 
 /* * * */
@@ -1226,12 +1344,12 @@ static void	add_cmd_alias	(const char *orig_name, ArgList *arglist, const char *
 	char *argstr;
 
 	name = remove_brackets(orig_name, NULL);
-	if (!(tmp = lookup_symbol(name)))
+	if (!(tmp = lookup_symbol_to_define(name)))
 	{
 		tmp = make_new_Symbol(name);
 		if (current_package())
 		   tmp->user_command_package = malloc_strdup(current_package());
-		add_to_alist(&globals, name, tmp);
+		add_global_symbol(name, tmp);
 	}
 	else if (current_package()) 
 	{
@@ -1259,18 +1377,18 @@ static void	add_cmd_alias	(const char *orig_name, ArgList *arglist, const char *
 }
 
 
-void	add_cmd_stub_alias  (const char *orig_name, const char *stuff)
+void	add_cmd_stub_alias  (const char *orig_name, const char *stuff, int noisy)
 {
 	Symbol *tmp = NULL;
 	char *name;
 
 	name = remove_brackets(orig_name, NULL);
-	if (!(tmp = lookup_symbol(name)))
+	if (!(tmp = lookup_symbol_to_define(name)))
 	{
 		tmp = make_new_Symbol(name);
 		if (current_package())
 		   tmp->user_command_package = malloc_strdup(current_package());
-		add_to_alist(&globals, name, tmp);
+		add_global_symbol(name, tmp);
 	}
 	else if (current_package())
 	{
@@ -1282,7 +1400,8 @@ void	add_cmd_stub_alias  (const char *orig_name, const char *stuff)
 	malloc_strcpy(&(tmp->user_command), stuff);
 	tmp->user_command_stub = 1;
 
-	say("Alias %s stubbed to file %s", name, stuff);
+	if (noisy)
+		say("Alias %s stubbed to file %s", name, stuff);
 
 	new_free(&name);
 	return;
@@ -1297,7 +1416,7 @@ void	add_builtin_cmd_alias	(const char *name, void (*func) (const char *, char *
 	if (!tmp || cnt >= 0)
 	{
 		tmp = make_new_Symbol(name);
-		add_to_alist(&globals, name, tmp);
+		add_global_symbol(name, tmp);
 	}
 
 	tmp->builtin_command = func;
@@ -1313,7 +1432,7 @@ void	add_builtin_func_alias	(const char *name, char * (*func) (char *))
 	if (!tmp || cnt >= 0)
 	{
 		tmp = make_new_Symbol(name);
-		add_to_alist(&globals, name, tmp);
+		add_global_symbol(name, tmp);
 	}
 
 	tmp->builtin_function = func;
@@ -1329,7 +1448,7 @@ void	add_builtin_expando	(const char *name, char *(*func) (void))
 	if (!tmp || cnt >= 0)
 	{
 		tmp = make_new_Symbol(name);
-		add_to_alist(&globals, name, tmp);
+		add_global_symbol(name, tmp);
 	}
 
 	tmp->builtin_expando = func;
@@ -1345,7 +1464,7 @@ void	add_builtin_variable_alias (const char *name, IrcVariable *var)
 	if (!tmp || cnt >= 0)
 	{
 		tmp = make_new_Symbol(name);
-		add_to_alist(&globals, name, tmp);
+		add_global_symbol(name, tmp);
 	}
 
 	tmp->builtin_variable = var;
@@ -1418,13 +1537,9 @@ static Symbol *unstub_command (Symbol *item)
  */
 static Symbol *	lookup_symbol (const char *name)
 {
-	Symbol *	item = NULL;
-	int 	loc;
-	int 	cnt = 0;
+	Symbol *	item;
 
-	item = find_alist_item(&globals, name, &cnt, &loc);
-	if (cnt >= 0)
-		item = NULL;
+	item = find_global_symbol(name);
 	if (item && item->user_variable_stub)
 		item = unstub_variable(item);
 	if (item && item->user_command_stub)
@@ -1432,6 +1547,86 @@ static Symbol *	lookup_symbol (const char *name)
 	return item;
 }
 
+/*
+ * Like lookup_symbol(), but stubs are returned as they are.
+ */
+static Symbol *	find_global_symbol (const char *name)
+{
+	return (Symbol *)alist_lookup(&globals, name, 0);
+}
+
+/*
+ * Like lookup_symbol(), for when 'name' is about to be (re)defined or
+ * (re)stubbed.  A stub that loads a whole file is still loaded first,
+ * otherwise the rest of that file would get loaded later on and clobber
+ * the new definition.  A -range stub only ever loads this one name, so
+ * it is returned as it is, to be replaced.
+ */
+static Symbol *	lookup_symbol_to_define (const char *name)
+{
+	Symbol *	item;
+
+	if (!(item = find_global_symbol(name)))
+		return NULL;
+	if (item->user_variable_stub &&
+			my_strnicmp(item->user_variable, "-range ", 7))
+		return lookup_symbol(name);
+	if (item->user_command_stub &&
+			my_strnicmp(item->user_command, "-range ", 7))
+		return lookup_symbol(name);
+	return item;
+}
+
+static void	add_global_symbol (const char *name, Symbol *item)
+{
+	add_to_alist(&globals, name, item);
+	symbol_generation++;
+}
+
+static void	flush_symbol_bindings (void)
+{
+	int	i;
+
+	for (i = 0; i < SYMBOL_BINDINGS; i++)
+	{
+		new_free(&symbol_bindings[i].name);
+		symbol_bindings[i].generation = 0;
+		symbol_bindings[i].symbol = NULL;
+	}
+	symbol_generation++;
+}
+
+/*
+ * 'name' is expected to already be in canonical form (uppercase, dot notation)
+ */
+static Symbol *	resolve_symbol (const char *name)
+{
+	SymbolBinding *	b;
+	Symbol *	item;
+	const unsigned char *p;
+	unsigned	h = 0;
+
+	for (p = (const unsigned char *)name; *p; p++)
+		h = h * 31 + *p;
+	b = &symbol_bindings[h % SYMBOL_BINDINGS];
+
+	if (b->generation == symbol_generation && !strcmp(b->name, name))
+	{
+		item = b->symbol;
+		if (!item || (!item->user_variable_stub && !item->user_command_stub))
+			return item;
+	}
+
+	item = lookup_symbol(name);
+	if (!item || (!item->user_variable_stub && !item->user_command_stub))
+	{
+		malloc_strcpy(&b->name, name);
+		b->generation = symbol_generation;
+		b->symbol = item;
+	}
+	return item;
+}
+
 /*
  * An example will best describe the semantics:
  *
@@ -1440,30 +1635,44 @@ static Symbol *	lookup_symbol (const char *name)
  * is an exact leading subset of ``name'' and that variable ends in a
  * period (a dot).
  */
-static Symbol *	find_local_alias (const char *orig_name, alist **list)
+static Symbol *	find_local_alias (const char *orig_name, int *frame)
 {
 	Symbol 	*alias = NULL;
 	int 	c;
 	const char 	*ptr;
-	int 	implicit = -1;
 	int	function_return = 0;
+	uint32_t initial;
 	char *	name;
+	char *	period;
 
 	/* No name is an error */
 	if (!orig_name)
 		return NULL;
 
-	name = remove_brackets(orig_name, NULL);
-	upper(name);
+	/*
+	 * Nearly every caller hands us a name that is already canonical,
+	 * so we only go through remove_brackets() when there is actually
+	 * a bracket to remove.  Either way, the name lives on the stack.
+	 */
+	if (strchr(orig_name, '['))
+	{
+		char *	tmp = remove_brackets(orig_name, NULL);
+		name = LOCAL_COPY(tmp);
+		new_free(&tmp);
+	}
+	else
+	{
+		name = LOCAL_COPY(orig_name);
+		upper(name);
+	}
 
 	ptr = after_expando(name, 1, NULL);
-	if (*ptr) {
-		new_free(&name);
+	if (*ptr)
 		return NULL;
-	}
 
-	if (!my_stricmp(name, "FUNCTION_RETURN"))
+	if (!strcmp(name, "FUNCTION_RETURN"))
 		function_return = 1;
+	initial = LOCAL_INITIAL(name);
 
 	/*
 	 * Search our current local variable stack, and wind our way
@@ -1471,9 +1680,8 @@ static Symbol *	find_local_alias (const char *orig_name, alist **list)
 	 * alias or ON call.  If we find a variable in one of those enclosing
 	 * stacks, then we use it.  If we dont, we progress.
 	 *
-	 * This needs to be optimized for the degenerate case, when there
-	 * is no local variable available...  It will be true 99.999% of
-	 * the time.
+	 * Frames whose bloom filter says they can't have the variable
+	 * (which is nearly all of them) are skipped without a lookup.
 	 */
 	for (c = wind_index; c >= 0; c = call_stack[c].parent)
 	{
@@ -1481,42 +1689,42 @@ static Symbol *	find_local_alias (const char *orig_name, alist **list)
 		if (function_return && last_function_call_level != -1)
 			c = last_function_call_level;
 
-		debug(DEBUG_LOCAL_VARS, "Looking for [%s] in level [%d]", name, c);
-
-		if (call_stack[c].alias.list)
+		if (call_stack[c].alias.max && (call_stack[c].initials & initial))
 		{
-			int x, cnt, loc;
+			int cnt, loc;
+
+			debug(DEBUG_LOCAL_VARS, "Looking for [%s] in level [%d]", name, c);
 
 			/* We can always hope that the variable exists */
 			find_alist_item(&call_stack[c].alias, name, &cnt, &loc);
 			if (cnt < 0)
 				alias = call_stack[c].alias.list[loc]->data;
 
-			/* XXXX - This is bletcherous */
-			else if (strchr(name, '.'))
+			/*
+			 * Otherwise, if any leading part of the name that ends
+			 * in a dot is a local here, then this is an implicit
+			 * local in that structure.  There are only as many
+			 * candidates as there are dots in the name.
+			 */
+			else if (call_stack[c].stems)
 			{
-			    for (x = 0; x < loc; x++)
+			    for (period = strchr(name, '.'); period; period = strchr(period + 1, '.'))
 			    {
-				Symbol *item;
-				size_t len;
+				char	save = period[1];
+				Symbol	*stem;
 
-				item = call_stack[c].alias.list[x]->data;
-				len =  strlen(item->name);
+				period[1] = 0;
+				stem = find_alist_item(&call_stack[c].alias, name, &cnt, &loc);
+				period[1] = save;
 
-				if (streq(item->name, name) == len) {
-					if (item->name[len-1] == '.') {
-						implicit = c;
-						break;
-					}
+				if (stem && cnt < 0)
+				{
+					alias = make_new_Symbol(name);
+					add_local_symbol(c, name, alias);
+					break;
 				}
 			    }
 			}
-
-			if (!alias && implicit >= 0)
-			{
-				alias = make_new_Symbol(name);
-				add_to_alist (&call_stack[implicit].alias, name, alias);
-			}
 		}
 
 		if (alias)
@@ -1533,20 +1741,43 @@ static Symbol *	find_local_alias (const char *orig_name, alist **list)
 		}
 	}
 
-	new_free(&name);
-
 	if (alias)
 	{
-		if (list)
-			*list = &call_stack[c].alias;
+		if (frame)
+			*frame = c;
 		return alias;
 	}
-	else if (list)
-		*list = &call_stack[wind_index].alias;
+	else if (frame)
+		*frame = wind_index;
 
 	return NULL;
 }
 
+/*
+ * Put a new local variable into a stack frame, and keep the frame's
+ * lookup filter up to date.  'name' must already be canonical.
+ */
+static void	add_local_symbol (int frame, const char *name, Symbol *item)
+{
+	size_t	len;
+
+	add_to_alist(&call_stack[frame].alias, name, item);
+	call_stack[frame].initials |= LOCAL_INITIAL(name);
+	if ((len = strlen(name)) && name[len - 1] == '.')
+		call_stack[frame].stems++;
+}
+
+/*
+ * Throw away every local variable in a stack frame.
+ */
+static void	reset_local_frame (int frame)
+{
+	if (call_stack[frame].alias.list)
+		destroy_var_aliases(&call_stack[frame].alias);
+	call_stack[frame].initials = 0;
+	call_stack[frame].stems = 0;
+}
+
 
 /* * */
 static void	delete_var_alias (const char *orig_name, int noisy)
@@ -1561,6 +1792,7 @@ static void	delete_var_alias (const char *orig_name, int noisy)
 	if (item && cnt < 0)
 	{
 		new_free(&item->user_variable);
+		forget_symbol_number(item);
 		item->user_variable_stub = 0;
 		new_free(&(item->user_variable_package));
 		GC_symbol(item, &globals, loc);
@@ -2241,6 +2473,7 @@ static	void	destroy_var_aliases (alist *my_alist)
 			continue;
 
 		new_free((void **)&item->user_variable);
+		forget_symbol_number(item);
 		new_free((void **)&item->user_variable_package);
 		item->user_variable_stub = 0;
 		GC_symbol(item, my_alist, cnt);
@@ -2374,6 +2607,8 @@ int	make_local_stack 	(const char *name)
 			call_stack[wind_index].current = NULL;
 			call_stack[wind_index].name = NULL;
 			call_stack[wind_index].parent = -1;
+			call_stack[wind_index].initials = 0;
+			call_stack[wind_index].stems = 0;
 		}
 		wind_index = tmp_wind;
 	}
@@ -2417,8 +2652,7 @@ void 	destroy_local_stack 	(void)
 	/*
 	 * We clean up as best we can here...
 	 */
-	if (call_stack[wind_index].alias.list)
-		destroy_var_aliases(&call_stack[wind_index].alias);
+	reset_local_frame(wind_index);
 	if (call_stack[wind_index].current)
 		call_stack[wind_index].current = 0;
 	if (call_stack[wind_index].name)
@@ -2495,16 +2729,22 @@ char 	*get_variable 	(const char *str)
 }
 
 
-static char *	get_variable_with_args (const char *str, const char *args)
+/*
+ * find_variable_symbol: Find the symbol whose user_variable is the value
+ * of the variable 'name' (which has been through remove_brackets()).
+ *
+ *    1) local variable
+ *    2) global variable
+ *
+ * If neither of those is set, but there is a global symbol by that name 
+ * (which might be a built in expando or variable), it's put in (*builtin).
+ */
+static Symbol *	find_variable_symbol (const char *name, Symbol **builtin)
 {
-	Symbol	*alias = NULL;
-	char	*ret = NULL;
-	char	*name = NULL;
-	char	*freep = NULL;
-	int	copy = 0;
+	Symbol	*alias;
 	int	local = 0;
 
-	freep = name = remove_brackets(str, args);
+	*builtin = NULL;
 
 	/*
 	 * Support $:var to mean local variable ONLY (no globals)
@@ -2524,19 +2764,36 @@ static char *	get_variable_with_args (const char *str, const char *args)
 	 * local == 1   means "global variables not allowed"
 	 */
 	if ((local != -1) && (alias = find_local_alias(name, NULL)))
-		copy = 1, ret = alias->user_variable;
-	else if (local == 1)
-		(void) 0;
+		if (alias->user_variable)
+			return alias;
 
-	if (ret == NULL && ((alias = lookup_symbol(name)) != NULL))
+	if ((alias = lookup_symbol(name)) != NULL)
 	{
 		if (alias->user_variable)
-			copy = 1, ret = alias->user_variable;
-		else if (alias->builtin_expando)
-			copy = 0, ret = alias->builtin_expando();
-		else if (alias->builtin_variable)
-			copy = 0, ret = make_string_var_bydata(alias->builtin_variable);
+			return alias;
+		*builtin = alias;
 	}
+
+	return NULL;
+}
+
+static char *	get_variable_with_args (const char *str, const char *args)
+{
+	Symbol	*alias = NULL;
+	Symbol	*builtin;
+	char	*ret = NULL;
+	char	*name = NULL;
+	char	*freep = NULL;
+	int	copy = 0;
+
+	freep = name = remove_brackets(str, args);
+
+	if ((alias = find_variable_symbol(name, &builtin)))
+		copy = 1, ret = alias->user_variable;
+	else if (builtin && builtin->builtin_expando)
+		copy = 0, ret = builtin->builtin_expando();
+	else if (builtin && builtin->builtin_variable)
+		copy = 0, ret = make_string_var_bydata(builtin->builtin_variable);
 /*
 	if (ret == NULL && (ret = make_string_var(str)))
 		copy = 0;
@@ -2555,12 +2812,74 @@ static char *	get_variable_with_args (const char *str, const char *args)
 	return (copy ? malloc_strdup(ret) : ret);
 }
 
+/*
+ * The math parser uses variables as numbers a lot (think "@ i++"), and
+ * would otherwise convert the value from a string every time.  So each
+ * symbol remembers what its value is as a number, until the value changes.
+ *
+ * get_variable_integer / get_variable_float: 'name' must be a plain
+ * variable name (no $'s or []'s).  If it's set, put its value into 
+ * (*result) and return 1.  Otherwise return 0, and the caller should
+ * do it the hard way.
+ */
+static int	get_variable_integer (const char *name, intmax_t *result)
+{
+	Symbol	*alias, *builtin;
+	char *	canon;
+
+	canon = upper(LOCAL_COPY(name));
+	if (!(alias = find_variable_symbol(canon, &builtin)))
+		return 0;
+
+	if (!(alias->user_variable_cached & CACHED_INTEGER))
+	{
+		alias->user_variable_integer = STR2INT(alias->user_variable);
+		alias->user_variable_cached |= CACHED_INTEGER;
+	}
+	*result = alias->user_variable_integer;
+	return 1;
+}
+
+static int	get_variable_float (const char *name, long double *result)
+{
+	Symbol	*alias, *builtin;
+	char *	canon;
+
+	canon = upper(LOCAL_COPY(name));
+	if (!(alias = find_variable_symbol(canon, &builtin)))
+		return 0;
+
+	if (!(alias->user_variable_cached & CACHED_FLOAT))
+	{
+		alias->user_variable_float = atolf(alias->user_variable);
+		alias->user_variable_cached |= CACHED_FLOAT;
+	}
+	*result = alias->user_variable_float;
+	return 1;
+}
+
+/*
+ * add_var_alias_integer: The same as add_var_alias(name, stuff, 0), 
+ * where 'stuff' is 'value' written out in decimal.  Since we already 
+ * know what the number is, we remember it.
+ */
+static void	add_var_alias_integer (const char *name, const char *stuff, intmax_t value)
+{
+	Symbol	*alias;
+
+	if ((alias = assign_var_alias(name, stuff, 0)))
+	{
+		alias->user_variable_integer = value;
+		alias->user_variable_cached = CACHED_INTEGER;
+	}
+}
+
 /* * */
 const char *	get_cmd_alias (const char *name, void **args, void (**func) (const char *, char *, const char *))
 {
 	Symbol *item;
 
-	if ((item = lookup_symbol(name)))
+	if ((item = resolve_symbol(name)))
 	{
 		if (args)
 			*args = item->arglist;
@@ -2577,7 +2896,7 @@ const char *	get_func_alias (const char *name, void **args, char * (**func) (cha
 {
 	Symbol *item;
 
-	if ((item = lookup_symbol(name)))
+	if ((item = resolve_symbol(name)))
 	{
 		if (args)
 			*args = item->arglist;
@@ -2674,11 +2993,9 @@ static	int maxret = 0;
 		case (SETPACKAGE) :
 		{
 			Symbol *alias = NULL;
-			alist *a_list;
-
 			upper(listc);
 			if (list == VAR_ALIAS_LOCAL)
-				alias = find_local_alias(listc, &a_list);
+				alias = find_local_alias(listc, NULL);
 			else 
 				alias = lookup_symbol(listc);
 
@@ -2801,7 +3118,7 @@ int	stack_push_var_alias (const char *name)
 	if (!item || cnt >= 0)
 	{
 	    item = make_new_Symbol(name);
-	    add_to_alist(&globals, name, item);
+	    add_global_symbol(name, item);
 	}
 
 	sym = make_new_Symbol(name);
@@ -2835,6 +3152,7 @@ int	stack_pop_var_alias (const char *name)
 	s = sym->saved;
 	ss = sym->saved->saved;
 	malloc_strcpy(&item->user_variable, s->user_variable);
+	forget_symbol_number(item);
 	item->user_variable_stub = s->user_variable_stub;
 	malloc_strcpy(&item->user_variable_package, s->user_variable_package);
 	new_free(&s->user_variable);
@@ -2889,7 +3207,7 @@ int	stack_push_cmd_alias (char *name)
 	if (!item || cnt >= 0)
 	{
 	    item = make_new_Symbol(name);
-	    add_to_alist(&globals, name, item);
+	    add_global_symbol(name, item);
 	}
 
 	sym = make_new_Symbol(name);
@@ -2982,7 +3300,7 @@ int	stack_push_builtin_cmd_alias (const char *name)
 	if (!item || cnt >= 0)
 	{
 	    item = make_new_Symbol(name);
-	    add_to_alist(&globals, name, item);
+	    add_global_symbol(name, item);
 	}
 
 	sym = make_new_Symbol(name);
@@ -3066,7 +3384,7 @@ int	stack_push_builtin_func_alias (const char *name)
 	if (!item || cnt >= 0)
 	{
 	    item = make_new_Symbol(name);
-	    add_to_alist(&globals, name, item);
+	    add_global_symbol(name, item);
 	}
 
 	sym = make_new_Symbol(name);
@@ -3149,7 +3467,7 @@ int	stack_push_builtin_expando_alias (const char *name)
 	if (!item || cnt >= 0)
 	{
 	    item = make_new_Symbol(name);
-	    add_to_alist(&globals, name, item);
+	    add_global_symbol(name, item);
 	}
 
 	sym = make_new_Symbol(name);
@@ -3230,7 +3548,7 @@ int	stack_push_builtin_var_alias (const char *name)
 	if (!item || cnt >= 0)
 	{
 	    item = make_new_Symbol(name);
-	    add_to_alist(&globals, name, item);
+	    add_global_symbol(name, item);
 	}
 
 	sym = make_new_Symbol(name);
@@ -3481,7 +3799,7 @@ char    *symbolctl      (char *input)
 	    if (!s || cnt >= 0)
 	    {
 		s = make_new_Symbol(symbol);
-		add_to_alist(&globals, symbol, s);
+		add_global_symbol(symbol, s);
 		RETURN_INT(1);
 	    }
 	    RETURN_INT(0);
@@ -3497,6 +3815,7 @@ char    *symbolctl      (char *input)
 		    all = 1;
 		if (all || !my_stricmp(input, "ASSIGN")) {
 		    new_free(&s->user_variable);
+		    forget_symbol_number(s);
 		    s->user_variable_stub = 0;
 		    new_free(&s->user_variable_package);
 		}
@@ -3694,6 +4013,7 @@ char    *symbolctl      (char *input)
 		        malloc_strcpy(&s->user_variable, input);
 		    else
 			new_free(&s->user_variable);
+		    forget_symbol_number(s);
 		    RETURN_INT(1);
 		} else if (!my_stricmp(attr, "STUB")) {
 		    if (is_number(input)) {
@@ -37,9 +37,33 @@
 #define ALIST_ITEM(alist, loc) ((alist_item_ *) ((alist) -> list [ (loc) ]))
 #define LALIST_ITEM(alist, loc) (((alist) -> list [ (loc) ]))
 
+/*
+ * The hash index.  Once an alist has ALIST_INDEX_MIN items, every item is
+ * also put in an open addressed (linear probing) hash table, keyed on the
+ * whole name.  The table only holds pointers to the items in list[], so
+ * it doesn't care where they are in list[].  It's thrown away when the 
+ * alist becomes empty.
+ */
+#define ALIST_INDEX_MIN		32
+
+typedef struct alist_index_stru
+{
+	alist_item_ **	slot;
+	uint32_t *	hash;
+	int		size;		/* Always a power of two */
+	int		count;
+	int		unsorted;	/* alist_append() was used since sorting */
+} alist_index_;
+
 /* Function decls */
 static	void	check_alist_size (alist *list);
 	void 	move_alist_items (alist *list, int start, int end, int dir);
+static	uint32_t alist_index_hash (alist *a, const char *name);
+static	alist_item_ *alist_index_find (alist *a, const char *name);
+static	void	alist_index_resize (alist *a, int count);
+static	void	alist_index_add (alist *a, alist_item_ *item_);
+static	void	alist_index_remove (alist *a, alist_item_ *item_);
+static	int	alist_item_cmp (const void *p1, const void *p2);
 
 /*
  * Returns an entry that has been displaced, if any.
@@ -53,6 +77,19 @@ void *	add_to_alist (alist *a, const char *name, void *item)
 	uint32_t	mask; 	/* Dummy var */
 	alist_item_ *	item_;
 
+	/*
+	 * If it's already there, it just gets the new name and data.
+	 * The new name is the same as the old one (as far as a->func is
+	 * concerned) so it stays in the same place.
+	 */
+	if (a->index && (item_ = alist_index_find(a, name)))
+	{
+		ret = item_->data;
+		malloc_strcpy(&item_->name, name);
+		item_->data = item;
+		return ret;
+	}
+
 	/* Initialize our internal item */
 	item_ = (alist_item_ *)new_malloc(sizeof(alist_item_));
 	item_->name = NULL;
@@ -70,6 +107,9 @@ void *	add_to_alist (alist *a, const char *name, void *item)
 		if (count < 0)
 		{
 			ret = ALIST_ITEM(a, location)->data;
+			alist_index_remove(a, ALIST_ITEM(a, location));
+			new_free(&ALIST_ITEM(a, location)->name);
+			new_free((char **)&LALIST_ITEM(a, location));
 			a->max--;
 		}
 		else
@@ -78,9 +118,78 @@ void *	add_to_alist (alist *a, const char *name, void *item)
 
 	a->list[location] = item_;
 	a->max++;
+	alist_index_add(a, item_);
 	return ret;
 }
 
+/*
+ * This is add_to_alist() for when you have a lot of things to add at once.
+ * The new item just goes on the end of list[], and the alist is marked as
+ * unsorted until someone calls alist_sort() (or anything that needs the
+ * order, like find_alist_item()).  alist_lookup() works the whole time,
+ * because an alist that has had alist_append() used on it always has an
+ * index.  Returns an entry that has been displaced, if any.
+ */
+void *	alist_append (alist *a, const char *name, void *item)
+{
+	void *		ret;
+	uint32_t	mask; 	/* Dummy var */
+	alist_item_ *	item_;
+
+	if (!a->index)
+		alist_index_resize(a, a->max + 1);
+	if ((item_ = alist_index_find(a, name)))
+	{
+		ret = item_->data;
+		malloc_strcpy(&item_->name, name);
+		item_->data = item;
+		return ret;
+	}
+
+	item_ = (alist_item_ *)new_malloc(sizeof(alist_item_));
+	item_->name = NULL;
+	malloc_strcpy(&item_->name, name);	
+	if (a->hash == HASH_INSENSITIVE)
+		item_->hash = ci_alist_hash(item_->name, &mask);
+	else
+		item_->hash = cs_alist_hash(item_->name, &mask);
+	item_->data = item;
+
+	check_alist_size(a);
+	a->list[a->max++] = item_;
+	if (a->max > 1)
+		a->index->unsorted = 1;
+	alist_index_add(a, item_);
+	return NULL;
+}
+
+/*
+ * Put list[] back in order after alist_append().  This is the same order
+ * that find_alist_item() keeps: by the first four (folded) letters, and
+ * then by a->func.  It does nothing if the alist is already sorted.
+ */
+static alist_func	sorting_func;
+
+static int	alist_item_cmp (const void *p1, const void *p2)
+{
+	const alist_item_ *i1 = *(const alist_item_ * const *)p1;
+	const alist_item_ *i2 = *(const alist_item_ * const *)p2;
+
+	if (i1->hash != i2->hash)
+		return i1->hash < i2->hash ? -1 : 1;
+	return sorting_func(i1->name, i2->name, strlen(i1->name) + 1);
+}
+
+void	alist_sort (alist *a)
+{
+	if (!a->index || !a->index->unsorted)
+		return;
+
+	sorting_func = a->func;
+	qsort(a->list, a->max, sizeof(alist_item_ *), alist_item_cmp);
+	a->index->unsorted = 0;
+}
+
 /*
  * Returns the entry that has been removed, if any.
  */
@@ -91,6 +200,10 @@ void *	remove_from_alist (alist *a, const char *name)
 
 	if (a->max)
 	{
+		/* The index can say "not there" without searching */
+		if (a->index && !alist_index_find(a, name))
+			return NULL;
+
 		find_alist_item(a, name, &count, &location);
 		if (count >= 0)
 			return NULL;
@@ -111,25 +224,44 @@ void *	alist_pop (alist *a, int which)
 
 	item_ = ALIST_ITEM(a, which);
 	ret = item_->data;
+	alist_index_remove(a, item_);
 
 	move_alist_items(a, which + 1, a->max, -1);
 	a->max--;
 	check_alist_size(a);
+	if (a->max == 0)
+		alist_free_index(a);
 
 	new_free(&item_->name);
 	new_free((char **)&item_);
 	return ret;
 }
 
+/*
+ * Returns the data for the item whose name is exactly 'name' (not just 
+ * one that starts with it), or NULL.  If 'rem' is not 0, it's removed.
+ */
 void *	alist_lookup (alist *a, const char *name, int rem)
 {
-	int 	count, 
-		location;
+	int 		count, 
+			location;
+	void *		ret;
+	alist_item_ *	item_;
 
 	if (rem)
 		return remove_from_alist(a, name);
-	else
-		return find_alist_item(a, name, &count, &location);
+
+	if (a->index)
+	{
+		if ((item_ = alist_index_find(a, name)))
+			return item_->data;
+		return NULL;
+	}
+
+	ret = find_alist_item(a, name, &count, &location);
+	if (count >= 0)
+		return NULL;
+	return ret;
 }
 
 static void	check_alist_size (alist *a)
@@ -159,24 +291,170 @@ static void	check_alist_size (alist *a)
  */
 void	move_alist_items (alist *a, int start, int end, int dir)
 {
-	int 	i;
-
 	if (dir > 0)
 	{
-		for (i = end; i >= start; i--)
-			LALIST_ITEM(a, i + dir) = ALIST_ITEM(a, i);
-		for (i = dir; i > 0; i--)
-			LALIST_ITEM(a, start + i - 1) = NULL;
+		memmove(&LALIST_ITEM(a, start + dir), &LALIST_ITEM(a, start),
+				sizeof(alist_item_ *) * (end - start + 1));
+		memset(&LALIST_ITEM(a, start), 0, sizeof(alist_item_ *) * dir);
 	}
 	else if (dir < 0)
 	{
-		for (i = start; i <= end; i++)
-			LALIST_ITEM(a, i + dir) = ALIST_ITEM(a, i);
-		for (i = end - dir + 1; i <= end; i++)
-			LALIST_ITEM(a, i) = NULL;
+		memmove(&LALIST_ITEM(a, start + dir), &LALIST_ITEM(a, start),
+				sizeof(alist_item_ *) * (end - start + 1));
+		memset(&LALIST_ITEM(a, end + dir + 1), 0, 
+				sizeof(alist_item_ *) * -dir);
 	}
 }
 
+/*
+ * The hash for the index is over the whole name.  For case insensitive
+ * alists, it uses the same folding as ci_alist_hash(), and skips bytes
+ * that aren't ascii (because a->func may think that two different utf8 
+ * sequences are the same letter).  So if a->func says two names are the
+ * same, they always hash the same.
+ */
+static uint32_t	alist_index_hash (alist *a, const char *name)
+{
+	const unsigned char *s;
+	uint32_t	h = 2166136261U;
+
+	if (a->hash == HASH_INSENSITIVE)
+	{
+		for (s = (const unsigned char *)name; *s; s++)
+			if (*s < 0x80)
+				h = (h ^ rfc1459_stricmp_table[*s]) * 16777619U;
+	}
+	else
+	{
+		for (s = (const unsigned char *)name; *s; s++)
+			h = (h ^ *s) * 16777619U;
+	}
+	return h;
+}
+
+static alist_item_ *	alist_index_find (alist *a, const char *name)
+{
+	alist_index_ *	idx = a->index;
+	uint32_t	h;
+	int		i;
+
+	h = alist_index_hash(a, name);
+	for (i = h & (idx->size - 1); idx->slot[i]; i = (i + 1) & (idx->size - 1))
+	{
+		if (idx->hash[i] == h && 
+		    !a->func(name, idx->slot[i]->name, strlen(name) + 1))
+			return idx->slot[i];
+	}
+	return NULL;
+}
+
+static void	alist_index_insert (alist_index_ *idx, alist_item_ *item_, uint32_t h)
+{
+	int	i;
+
+	for (i = h & (idx->size - 1); idx->slot[i]; i = (i + 1) & (idx->size - 1))
+		;
+	idx->slot[i] = item_;
+	idx->hash[i] = h;
+	idx->count++;
+}
+
+/*
+ * Makes the index big enough for 'count' items, at most half full.
+ * When it has to grow, everything in list[] is put back in.
+ */
+static void	alist_index_resize (alist *a, int count)
+{
+	alist_index_ *	idx;
+	int		size, i;
+	int		unsorted;
+
+	for (size = 64; size < count * 2; size *= 2)
+		;
+	if (a->index && a->index->size >= size)
+		return;
+
+	unsorted = a->index ? a->index->unsorted : 0;
+	alist_free_index(a);
+	idx = (alist_index_ *)new_malloc(sizeof(alist_index_));
+	idx->size = size;
+	idx->count = 0;
+	idx->unsorted = unsorted;
+	idx->slot = (alist_item_ **)new_malloc(sizeof(alist_item_ *) * size);
+	idx->hash = (uint32_t *)new_malloc(sizeof(uint32_t) * size);
+	a->index = idx;
+
+	for (i = 0; i < a->max; i++)
+		alist_index_insert(idx, ALIST_ITEM(a, i), 
+				alist_index_hash(a, ALIST_ITEM(a, i)->name));
+}
+
+/* Call this after 'item_' has been put in list[] */
+static void	alist_index_add (alist *a, alist_item_ *item_)
+{
+	if (!a->index)
+	{
+		if (a->max >= ALIST_INDEX_MIN)
+			alist_index_resize(a, a->max);	/* Includes item_ */
+		return;
+	}
+
+	if (a->index->count + 1 > a->index->size / 2)
+		alist_index_resize(a, a->index->count + 1);	/* Ditto */
+	else
+		alist_index_insert(a->index, item_, 
+				alist_index_hash(a, item_->name));
+}
+
+/* Call this before 'item_' is freed */
+static void	alist_index_remove (alist *a, alist_item_ *item_)
+{
+	alist_index_ *	idx = a->index;
+	int		i, j, k;
+	int		mask;
+
+	if (!idx)
+		return;
+
+	mask = idx->size - 1;
+	for (i = alist_index_hash(a, item_->name) & mask; idx->slot[i]; i = (i + 1) & mask)
+		if (idx->slot[i] == item_)
+			break;
+	if (!idx->slot[i])
+		return;
+
+	/*
+	 * Linear probing doesn't use tombstones; instead everything after
+	 * the hole that would have landed at or before it gets moved up.
+	 */
+	idx->slot[i] = NULL;
+	idx->count--;
+	for (j = (i + 1) & mask; idx->slot[j]; j = (j + 1) & mask)
+	{
+		k = idx->hash[j] & mask;
+		if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j)))
+		{
+			idx->slot[i] = idx->slot[j];
+			idx->hash[i] = idx->hash[j];
+			idx->slot[j] = NULL;
+			i = j;
+		}
+	}
+}
+
+/*
+ * Throw away an alist's hash index.  You only need to call this yourself 
+ * if you throw away the alist's list[] without using alist_pop().
+ */
+void	alist_free_index (alist *a)
+{
+	if (!a->index)
+		return;
+	new_free(&a->index->slot);
+	new_free(&a->index->hash);
+	new_free((char **)&a->index);
+}
+
 
 /*
  * This is just a generalization of the old function  ``find_command''
@@ -216,6 +494,7 @@ void *	find_alist_item (alist *set, const char *name, int *cnt, int *loc)
 	uint32_t	mask;
 	uint32_t	hash;
 
+	alist_sort(set);
 	if (set->hash == HASH_INSENSITIVE)
 		hash = ci_alist_hash(name, &mask);
 	else
@@ -334,9 +613,10 @@ void *	find_alist_item (alist *set, const char *name, int *cnt, int *loc)
 
 void *	get_alist_item (alist *set, int location)
 {
-	if (location < 0 || location > set->max)
+	if (location < 0 || location >= set->max)
 		return NULL;
 
+	alist_sort(set);
 	return ALIST_ITEM(set, location)->data;
 }
 
@@ -42,6 +42,7 @@
 #include "numbers.c"
 #include "output.c"
 #include "parse.c"
+#include "profile.c"
 #include "python.c"
 #include "queue.c"
 #include "recode.c"
@@ -220,6 +220,7 @@ struct system_timer system_timers[] = {
 static int	system_timer (void *entry)
 {
 	double	timeout = 0;
+	double	slack;
 	int	nominal_timeout;
 	struct system_timer *item = NULL;
 
@@ -227,8 +228,17 @@ static int	system_timer (void *entry)
 
 	nominal_timeout = get_int_var(*item->interval_variable);
 	timeout = time_to_next_interval(nominal_timeout);
+
+	/*
+	 * This goes off at the top of the interval, like a /TIMER -SNAP,
+	 * so it gets the same slack, and it can share its wakeup with 
+	 * whatever else is going off around then.
+	 */
+	slack = nominal_timeout / 100.0;
+	if (slack > 1)
+		slack = 1;
 	add_timer(1, item->name, timeout, 1, system_timer, entry, NULL, 
-				GENERAL_TIMER, -1, 0, 0);
+				GENERAL_TIMER, -1, 0, 0, slack);
 
 	item->callback();
 	return 0;
@@ -69,6 +69,7 @@
 #include "extlang.h"
 #include "elf.h"
 #include "queue.h"
+#include "profile.h"
 
 /* used with input_move_cursor */
 #define RIGHT 1
@@ -253,6 +254,7 @@ static	IrcCommand irc_command[] =
 	{ "PING",	pingcmd		},
 	{ "POP",	pop_cmd		},
 	{ "PRETEND",	pretend_cmd	},
+	{ "PROFILE",	profilecmd	}, /* profile.c */
 	{ "PUSH",	push_cmd	},
 #ifdef HAVE_PYTHON
 	{ "PYDIRECT",	pydirect_cmd	}, /* python.c */
@@ -723,7 +725,7 @@ BUILT_IN_COMMAND(e_pause)
 	if ((sec = next_arg(args, &args)))
 	{
 		seconds = atof(sec);
-		add_timer(0, empty_string, seconds, 1, e_pause_timer_callback, (void *)data, NULL, GENERAL_TIMER, -1, 0, 0);
+		add_timer(0, empty_string, seconds, 1, e_pause_timer_callback, (void *)data, NULL, GENERAL_TIMER, -1, 0, 0, 0);
 	}
 	else
 		add_wait_prompt(empty_string, e_pause_prompt_callback, (void *)data, WAIT_PROMPT_NOOP, 0);
@@ -1451,10 +1453,35 @@ struct load_info
 	int	line;
 	int	start_line;
 	struct stat sb;
+	int	caching;	/* Are we filling in 'cache'? */
+	int	comment_hack;	/* /SET COMMENT_HACK when we started */
+	Strbuf	cache;		/* What the loader did, for the load cache */
+	int	indexing;	/* Only looking for definitions (/STUB PACKAGE) */
+	int	index_whole;	/* Can't load definitions one at a time */
+	off_t	index_end;	/* Where the last definition ended */
+	off_t	stmt_start;	/* Where the current statement began, or -1 */
+	off_t	stmt_end;	/* Where the current statement ends (so far) */
+	int	stmt_line;	/* The line the current statement began on */
 } load_level[MAX_LOAD_DEPTH];
 
 int 	load_depth = -1;
 
+/*
+ * /LOAD -range <start>-<end>[:<size>:<mtime>:<command>:<name>]
+ * The part after <end> is what /STUB PACKAGE knew about the file: its
+ * size and mtime (in nanoseconds) and the one definition in the range.
+ */
+struct load_range
+{
+	intmax_t	start;		/* Where the range begins, or -1 */
+	intmax_t	end;		/* Where the range ends, or -1 */
+	intmax_t	size;		/* How big the file was, or -1 */
+	intmax_t	mtime;		/* When it was last changed */
+	const char *	cmd;		/* "alias" or "assign", or NULL */
+	size_t		cmdlen;
+	const char *	name;		/* What the range defines */
+};
+
 void	dump_load_stack (int onelevel)
 {
 	int i = load_depth;
@@ -1541,6 +1568,22 @@ BUILT_IN_COMMAND(subpackagecmd)
 static void	loader_which (const char *file_contents, off_t file_contents_size, const char *filename, const char *args, struct load_info *);
 static void	loader_std (const char *file_contents, off_t file_contents_size, const char *filename, const char *args, struct load_info *);
 static void	loader_pf  (const char *file_contents, off_t file_contents_size, const char *filename, const char *args, struct load_info *);
+static char *	load_cache_key (const char *filename, const char *loader_name, Filename cache_file);
+static char *	load_cache_fetch (const char *key, const char *cache_file);
+static void	load_cache_replay (char *contents, const char *subargs, struct load_info *);
+static int	load_cache_next (char **ptr, int *type, int *line, char **text, size_t *len);
+static void	load_cache_store (const char *key, const char *cache_file, struct load_info *);
+static void	load_cache_append (struct load_info *, int, const char *);
+static void	load_cache_record (Strbuf *, int, int, const char *);
+static void	load_statement (struct load_info *, const char *);
+static void	load_statement_begins (struct load_info *, off_t, int, int);
+static void	index_statement (struct load_info *, const char *);
+static char *	index_script (const char *);
+static int	stub_script (const char *);
+static intmax_t	stat_mtime_ns (const Stat *);
+static int	parse_load_range (const char *, struct load_range *);
+static int	load_range_ok (const struct load_range *, const char *, const char *, off_t);
+static void	load_diagnostic (struct load_info *, int, const char *, ...) __A(3);
 
 /*
  * load: the /LOAD command.  Reads the named file, parsing each line as
@@ -1559,7 +1602,14 @@ BUILT_IN_COMMAND(load)
 	void	(*loader) (const char *, off_t, const char *, const char *, struct load_info *);
 	char *	file_contents = NULL;
 	off_t	file_contents_size = 0;
+	int	file_mapped = 0;
 	const char *	declared_encoding = NULL;
+	const char *	loader_name;
+	char *	cache_key;
+	Filename cache_file;
+	char *	cached;
+	struct load_range range, this_range;
+	int	first_line;
 
 	if (++load_depth == MAX_LOAD_DEPTH)
 	{
@@ -1576,6 +1626,9 @@ BUILT_IN_COMMAND(load)
 	load_level[load_depth].package_set_here = 0;
 	load_level[load_depth].line = 0;
 	load_level[load_depth].start_line = 0;
+	load_level[load_depth].caching = 0;
+	strbuf_init(&load_level[load_depth].cache);
+	load_level[load_depth].indexing = 0;
 	/* What to do with load_level[load_depth].sb? */
 
 	display = swap_window_display(0);
@@ -1590,6 +1643,7 @@ BUILT_IN_COMMAND(load)
 	    loader = loader_std;
 
 	declared_encoding = find_recoding("scripts", NULL, NULL);
+	parse_load_range(NULL, &range);
 
 	/* 
 	 * We iterate over the whole list -- if we use the -args flag, the
@@ -1628,9 +1682,26 @@ BUILT_IN_COMMAND(load)
 		declared_encoding = next_arg(args, &args);
 		continue;
 	    }
+	    /*
+	     * -range <start>-<end> loads only those bytes of the next file.
+	     * This is what /STUB PACKAGE uses to load just one alias.
+	     */
+	    else if (my_strnicmp(filename, "-range", strlen(filename)) == 0)
+	    {
+		char *	spec;
+
+		if ((spec = next_arg(args, &args)) && 
+				parse_load_range(spec, &range) < 0)
+		    say("LOAD: -range %s is not <start>-<end>", spec);
+		continue;
+	    }
 	    else
 		sargs = NULL;
 
+	    this_range = range;
+	    parse_load_range(NULL, &range);
+	    first_line = 1;
+
 	    /* Locate the file */
 	    if (!(use_path = get_string_var(LOAD_PATH_VAR)))
 	    {
@@ -1649,12 +1720,99 @@ BUILT_IN_COMMAND(load)
 				&load_level[load_depth].sb)))
                 continue;
 
-	    if (slurp_elf_file(elf, &file_contents, &file_contents_size) > 0)
+	    /*
+	     * If we've loaded this file before, and it hasn't changed
+	     * since then, we don't need to read it again.
+	     */
+	    if (loader == loader_std)
+		loader_name = "std";
+	    else if (loader == loader_pf)
+		loader_name = "pf";
+	    else
+		loader_name = NULL;
+
+	    if (this_range.end < 0)
+		cache_key = load_cache_key(expanded, loader_name, cache_file);
+	    else
+		cache_key = NULL;
+	    if ((cached = load_cache_fetch(cache_key, cache_file)))
+	    {
+		epic_fclose(elf);
+		new_free(&elf);
+
+		load_level[load_depth].filename = expanded;
+		load_level[load_depth].loader = loader_name;
+		load_level[load_depth].line = 1;
+		if (load_depth > 0 && load_level[load_depth - 1].package)
+		    malloc_strcpy(&load_level[load_depth].package,
+				load_level[load_depth-1].package);
+
+		will_catch_return_exceptions++;
+		load_cache_replay(cached, sargs, &load_level[load_depth]);
+		will_catch_return_exceptions--;
+		return_exception = 0;
+
+		new_free(&load_level[load_depth].filename);
+		new_free(&load_level[load_depth].package);
+		new_free(&cached);
+		new_free(&cache_key);
+		continue;
+	    }
+
+	    /* Big scripts are mapped, rather than read and copied */
+	    if ((file_mapped = map_elf_file(elf, &file_contents, 
+						&file_contents_size)) ||
+	        slurp_elf_file(elf, &file_contents, &file_contents_size) > 0)
 	    {
+		/*
+		 * If the file changed since it was stubbed, the range
+		 * could be anything, and we'd better load all of it.
+		 */
+		if (this_range.end >= 0 && load_range_ok(&this_range, 
+				expanded, file_contents, file_contents_size))
+		{
+		    intmax_t	this_start = this_range.start;
+		    intmax_t	this_end = this_range.end;
+		    char *	part;
+		    const char *p;
+
+		    for (p = file_contents; (p = memchr(p, '\n', 
+				file_contents + this_start - p)); p++)
+			first_line++;
+
+		    part = new_malloc(this_end - this_start + 1);
+		    memcpy(part, file_contents + this_start, 
+				this_end - this_start);
+		    part[this_end - this_start] = 0;
+
+		    if (file_mapped)
+			unmap_elf_file(file_contents, file_contents_size);
+		    else
+			new_free(&file_contents);
+		    file_contents = part;
+		    file_contents_size = this_end - this_start;
+		    file_mapped = 0;
+		}
+		else if (this_range.end >= 0)
+		    say("%s has changed since it was stubbed; loading all of it",
+				expanded);
+
 		if (invalid_utf8str(file_contents))
 		{
 		    size_t	really;
 
+		    /* recode_with_iconv() needs to free it */
+		    if (file_mapped)
+		    {
+			char *	copy;
+
+			copy = new_malloc(file_contents_size + 1);
+			memcpy(copy, file_contents, file_contents_size + 1);
+			unmap_elf_file(file_contents, file_contents_size);
+			file_contents = copy;
+			file_mapped = 0;
+		    }
+
 		    really = file_contents_size;
 		    if ((off_t)really != file_contents_size)
 			privileged_yell("Loading a non-utf8 file whose size is greater than size_t will probably have problems");
@@ -1665,6 +1823,9 @@ BUILT_IN_COMMAND(load)
 				&file_contents, &really);
 
 		    file_contents_size = (off_t)really;
+
+		    /* The cache doesn't know about encodings */
+		    new_free(&cache_key);
 	        }
 	    }
 	    epic_fclose(elf);
@@ -1672,24 +1833,54 @@ BUILT_IN_COMMAND(load)
 
 	    /* If no file resulted, then we're done. */
 	    if (!file_contents || !*file_contents)
+	    {
+		if (file_mapped)
+		    unmap_elf_file(file_contents, file_contents_size);
+		else
+		    new_free(&file_contents);
+		new_free(&cache_key);
 		continue;
+	    }
 
 	    /* Now process the file */
             load_level[load_depth].filename = expanded;
-	    load_level[load_depth].line = 1;
+	    load_level[load_depth].line = first_line;
 	    if (load_depth > 0 && load_level[load_depth - 1].package)
 	        malloc_strcpy(&load_level[load_depth].package,
 				load_level[load_depth-1].package);
 
+	    if (cache_key)
+	    {
+		load_level[load_depth].caching = 1;
+		load_level[load_depth].comment_hack = 
+					get_int_var(COMMENT_HACK_VAR);
+	    }
+
 	    will_catch_return_exceptions++;
 	    loader(file_contents, file_contents_size, expanded, 
 			sargs, &load_level[load_depth]);
 	    will_catch_return_exceptions--;
+
+	    /* A /RETURN means we didn't see the whole file. */
+	    if (return_exception)
+		load_level[load_depth].caching = 0;
 	    return_exception = 0;
 
+	    if (load_level[load_depth].caching)
+		load_cache_store(cache_key, cache_file, &load_level[load_depth]);
+	    load_level[load_depth].caching = 0;
+	    strbuf_free(&load_level[load_depth].cache);
+
 	    new_free(&load_level[load_depth].filename);
 	    new_free(&load_level[load_depth].package);
-	    new_free(&file_contents);
+	    if (file_mapped)
+	    {
+		unmap_elf_file(file_contents, file_contents_size);
+		file_contents = NULL;
+	    }
+	    else
+		new_free(&file_contents);
+	    new_free(&cache_key);
 	}
 
 	/*
@@ -1728,6 +1919,9 @@ static void	loader_std (const char *file_contents, off_t file_contents_size, con
 	char 	*start, *real_start, *current_row;
 #define MAX_LINE_SIZE BIG_BUFFER_SIZE * 5
 	char	*buffer;
+	const char *whole_file = file_contents;
+	off_t	line_start = 0, line_end = 0;
+	int	line_first = 0, line_in_comment = 0;
 
         loadinfo->loader = "std";
 
@@ -1745,13 +1939,19 @@ static void	loader_std (const char *file_contents, off_t file_contents_size, con
 	    int     len;
 	    char    *ptr;
 
+	    /* Where this line is, for /STUB PACKAGE */
+	    line_start = file_contents - whole_file;
+	    line_first = loadinfo->line;
+	    line_in_comment = in_comment;
+
             if (!string_fgets(buffer, MAX_LINE_SIZE, &file_contents, &file_contents_size))
                     break;
 
             if (loadinfo->line == 1 && loadinfo->sb.st_mode & 0111 &&
 	    	(buffer[0] != '#' || buffer[1] != '!'))
 	    {
-	    	yell("Caution -- %s is marked as an executable; "
+	    	load_diagnostic(loadinfo, 'Y', 
+		     "Caution -- %s is marked as an executable; "
 		     "loading binaries results in undefined behavior.", 
 		     loadinfo->filename);
 	    }
@@ -1794,6 +1994,7 @@ static void	loader_std (const char *file_contents, off_t file_contents_size, con
 		len = strlen(start);
 		loadinfo->line++;
 	    }
+	    line_end = file_contents - whole_file;
 
 	    if (start[len-1] == '\n')
 		start[--len] = 0;
@@ -1808,6 +2009,10 @@ static void	loader_std (const char *file_contents, off_t file_contents_size, con
 			ptr != optr && ptr[-1] == '\\')
 		    optr = ptr + 1;
 
+		if (!current_row)
+		    load_statement_begins(loadinfo, line_start, line_first,
+						line_in_comment);
+
 		/* 
 		 * if no_semicolon is set, we will not attempt
 		 * to parse this line, but will continue
@@ -1821,11 +2026,14 @@ static void	loader_std (const char *file_contents, off_t file_contents_size, con
 		{
 		    if (!paste_level)
 		    {
-			parse_statement(current_row, 0, NULL);
+			load_statement(loadinfo, current_row);
 			new_free(&current_row);
 
 			if (return_exception)
 				return;
+
+			load_statement_begins(loadinfo, line_start, 
+					line_first, line_in_comment);
 		    }
 		    else if (!in_comment)
 			malloc_strcat(&current_row, ";");
@@ -1891,7 +2099,8 @@ static void	loader_std (const char *file_contents, off_t file_contents_size, con
 				/* If we are NOT in a block alias, */
 				if (paste_level == 0)
 				{
-				    parse_statement(current_row, 0, NULL);
+				    loadinfo->stmt_end = line_end;
+				    load_statement(loadinfo, current_row);
 				    new_free(&current_row);
 				    if (return_exception)
 					return;
@@ -1934,7 +2143,8 @@ static void	loader_std (const char *file_contents, off_t file_contents_size, con
 
 			if (!paste_level)
 			{
-				my_error("Unexpected } in %s, line %d",
+				load_diagnostic(loadinfo, 'E', 
+					"Unexpected } in %s, line %d",
 					filename, loadinfo->line);
 				break;
 			}
@@ -1961,7 +2171,8 @@ static void	loader_std (const char *file_contents, off_t file_contents_size, con
 			/* Semicolon at the end of line, not within {}s */
 			if (ptr[1] == 0 && !paste_level)
 			{
-			    parse_statement(current_row, 0, NULL);
+			    loadinfo->stmt_end = line_end;
+			    load_statement(loadinfo, current_row);
 			    new_free(&current_row);
 			    if (return_exception)
 				return;
@@ -1988,23 +2199,28 @@ static void	loader_std (const char *file_contents, off_t file_contents_size, con
 		    start = NULL;
 		}
 	    } /* End of while (start && *start) */
+
+	    if (current_row)
+		loadinfo->stmt_end = line_end;
 	} /* End of for(;;line++) */
 
 	if (in_comment)
-	    my_error("File %s ended with an unterminated comment in line %d",
+	    load_diagnostic(loadinfo, 'E', 
+			"File %s ended with an unterminated comment in line %d",
 			filename, comment_line);
 
 	if (current_row)
 	{
 	    if (paste_level)
 	    {
-		my_error("Unexpected EOF in %s trying to match '{' at line %d",
+		load_diagnostic(loadinfo, 'E', 
+				"Unexpected EOF in %s trying to match '{' at line %d",
 				filename, paste_line);
 	        new_free(&current_row);
 	    }
 	    else
 	    {
-		parse_statement(current_row, 0, NULL);
+		load_statement(loadinfo, current_row);
 	        new_free(&current_row);
 	        if (return_exception)
 			return;
@@ -2084,7 +2300,8 @@ static void	loader_pf (const char *file_contents, off_t file_contents_size, cons
 
 	    if (shebang == 0)
 	    {
-		yell("Cannot open %s -- executable file", 
+		load_diagnostic(loadinfo, 'Y', 
+			"Cannot open %s -- executable file", 
 			loadinfo->filename); 
 		new_free(&buffer);
 		return;
@@ -2141,10 +2358,725 @@ static void	loader_pf (const char *file_contents, off_t file_contents_size, cons
 	}
 
 	buffer[pos] = 0;
+	if (loadinfo->caching)
+		load_cache_append(loadinfo, 'L', buffer);
 	call_lambda_command("LOAD", buffer, subargs);
 	new_free(&buffer);
 }
 
+/*
+ * The load cache
+ *
+ * Most of the time you /LOAD the same scripts, unchanged, every time you
+ * start the client, and the std loader spends most of its time figuring
+ * out where the statements begin and end.  So when /SET LOAD_CACHE is
+ * set to a directory, after a file is loaded we write down what the 
+ * loader did with it (each statement and the line it started on, or the
+ * block the pf loader built, and any complaints it made along the way).  
+ * The next time, if the file has the same size and mtime, we just do 
+ * those things again without reading the file at all.
+ *
+ * A cache file is:
+ *	The key (see load_cache_key())
+ *	Zero or more records, each of which is
+ *		<type> <line> <length>\n<text>\n
+ *	where <type> is one of
+ *		S	A statement (parse_statement)
+ *		L	The pf loader's block (call_lambda_command)
+ *		E	An error message (my_error)
+ *		Y	A warning (yell)
+ *	END\n
+ *
+ * /STUB PACKAGE keeps its index of a file in the same place, with the
+ * loader name "index", and these records:
+ *		A	<start>-<end> <name> of an /ALIAS
+ *		V	<start>-<end> <name> of an /ASSIGN
+ *		W	The definitions can't be loaded one at a time
+ */
+#define LOAD_CACHE_VERSION 1
+
+/*
+ * Everything the loader's output depends on.  If any of it has changed,
+ * the cache entry is no good.  Returns NULL if the file can't be cached.
+ * Otherwise, the name of the cache file is put into 'cache_file'.
+ */
+static char *	load_cache_key (const char *filename, const char *loader_name, Filename cache_file)
+{
+	const char *	dir;
+	Filename	cache_dir;
+	Stat		sb;
+	unsigned long	hash;
+	const char *	p;
+	char		leafname[32];
+
+	if (!loader_name)
+		return NULL;
+	if (!(dir = get_string_var(LOAD_CACHE_VAR)) || !*dir)
+		return NULL;
+	if (expand_twiddle(dir, cache_dir))
+		return NULL;
+	if (stat(filename, &sb) < 0 || !S_ISREG(sb.st_mode))
+		return NULL;
+
+	/* FNV-1a of the filename and loader */
+	hash = 2166136261UL;
+	for (p = filename; *p; p++)
+		hash = (hash ^ (unsigned char)*p) * 16777619UL;
+	for (p = loader_name; *p; p++)
+		hash = (hash ^ (unsigned char)*p) * 16777619UL;
+	snprintf(leafname, sizeof(leafname), "/%08lx.load", hash & 0xFFFFFFFFUL);
+	strlcpy(cache_file, cache_dir, sizeof(Filename));
+	if (strlcat(cache_file, leafname, sizeof(Filename)) >= sizeof(Filename))
+		return NULL;
+
+	return malloc_sprintf(NULL, "EPIC load cache %d %s %s %lu\n"
+				    "%s %s\n"
+				    "%jd %jd %o %d\n",
+			LOAD_CACHE_VERSION, irc_version, internal_version,
+			commit_id, loader_name, filename,
+			(intmax_t)sb.st_size, stat_mtime_ns(&sb),
+			(unsigned)(sb.st_mode & 0111),
+			get_int_var(COMMENT_HACK_VAR));
+}
+
+/*
+ * Find the next record in a cache file.  Returns 1 if there was one,
+ * 0 at the END marker, and -1 if the file is garbage.  The record's
+ * (*text) is (*len) bytes long and is followed by a newline.
+ */
+static int	load_cache_next (char **ptr, int *type, int *line, char **text, size_t *len)
+{
+	char *	p = *ptr;
+	char *	after;
+
+	if (!strcmp(p, "END\n"))
+		return 0;
+
+	if (!*p || !strchr("SLEYAVW", *p) || p[1] != ' ')
+		return -1;
+	*type = *p;
+
+	*line = strtol(p + 2, &after, 10);
+	if (*after != ' ')
+		return -1;
+	*len = strtoul(after + 1, &after, 10);
+	if (*after != '\n')
+		return -1;
+	p = after + 1;
+
+	/* The text may not contain a nul, so it must end where we think */
+	if (!memchr(p, 0, *len + 1) && p[*len] == '\n')
+	{
+		*text = p;
+		*ptr = p + *len + 1;
+		return 1;
+	}
+	return -1;
+}
+
+/*
+ * If 'cache_file' is a complete cache file for 'key', return its records
+ * (which you must new_free()).  Otherwise return NULL.
+ */
+static char *	load_cache_fetch (const char *key, const char *cache_file)
+{
+	FILE *	fp;
+	Stat	sb;
+	char *	contents;
+	char *	p;
+	size_t	keylen, got, len;
+	int	type, line, r;
+	char *	text;
+
+	if (!key)
+		return NULL;
+	if (!(fp = fopen(cache_file, "r")))
+		return NULL;
+	if (fstat(fileno(fp), &sb) < 0 || !S_ISREG(sb.st_mode))
+	{
+		fclose(fp);
+		return NULL;
+	}
+
+	contents = new_malloc(sb.st_size + 1);
+	got = fread(contents, 1, sb.st_size, fp);
+	fclose(fp);
+	contents[got] = 0;
+
+	keylen = strlen(key);
+	if (got != (size_t)sb.st_size || got < keylen || 
+			memcmp(contents, key, keylen))
+	{
+		new_free(&contents);
+		return NULL;
+	}
+	memmove(contents, contents + keylen, got - keylen + 1);
+
+	/* Make sure the whole thing is there before we use any of it */
+	p = contents;
+	while ((r = load_cache_next(&p, &type, &line, &text, &len)) > 0)
+		;
+	if (r < 0)
+		new_free(&contents);
+	return contents;
+}
+
+/*
+ * Do what the loader did the last time.
+ */
+static void	load_cache_replay (char *contents, const char *subargs, struct load_info *loadinfo)
+{
+	int	type, line;
+	char *	text;
+	size_t	len;
+
+	while (load_cache_next(&contents, &type, &line, &text, &len) > 0)
+	{
+		text[len] = 0;
+		loadinfo->line = line;
+		if (type == 'S')
+			parse_statement(text, 0, NULL);
+		else if (type == 'L')
+			call_lambda_command("LOAD", text, subargs);
+		else if (type == 'E')
+			my_error("%s", text);
+		else if (type == 'Y')
+			yell("%s", text);
+
+		if (return_exception)
+			return;
+	}
+}
+
+static void	load_cache_append (struct load_info *loadinfo, int type, const char *text)
+{
+	load_cache_record(&loadinfo->cache, type, loadinfo->line, text);
+}
+
+static void	load_cache_record (Strbuf *cache, int type, int line, const char *text)
+{
+	char	header[64];
+
+	snprintf(header, sizeof(header), "%c %d %lu\n", 
+			type, line, (unsigned long)strlen(text));
+	strbuf_cat(cache, header);
+	strbuf_cat(cache, text);
+	strbuf_cat(cache, "\n");
+}
+
+/*
+ * Write out the cache file.  It's written under a temporary name and then
+ * renamed, so nobody ever sees half of one.
+ */
+static void	load_cache_store (const char *key, const char *cache_file, struct load_info *loadinfo)
+{
+	char *	tmpfile;
+	char *	dir;
+	char *	slash;
+	FILE *	fp;
+	int	ok;
+
+	/* If /SET COMMENT_HACK changed, then the lines after it did too */
+	if (get_int_var(COMMENT_HACK_VAR) != loadinfo->comment_hack)
+		return;
+
+	tmpfile = malloc_sprintf(NULL, "%s.%ld", cache_file, (long)getpid());
+	if (!(fp = fopen(tmpfile, "w")))
+	{
+		/* Perhaps the directory doesn't exist yet */
+		dir = LOCAL_COPY(cache_file);
+		if ((slash = strrchr(dir, '/')))
+		{
+			*slash = 0;
+			mkdir(dir, 0700);
+		}
+		if (!(fp = fopen(tmpfile, "w")))
+		{
+			new_free(&tmpfile);
+			return;
+		}
+	}
+
+	ok = fputs(key, fp) >= 0;
+	if (ok && loadinfo->cache.str)
+		ok = fwrite(loadinfo->cache.str, 1, loadinfo->cache.len, fp) 
+						== loadinfo->cache.len;
+	if (ok)
+		ok = fputs("END\n", fp) >= 0;
+	if (fclose(fp) != 0)
+		ok = 0;
+
+	if (!ok || rename(tmpfile, cache_file) < 0)
+		unlink(tmpfile);
+	new_free(&tmpfile);
+}
+
+/*
+ * Loaders call these instead of parse_statement(), my_error() and yell(),
+ * so the load cache can remember what they did.
+ */
+static void	load_statement (struct load_info *loadinfo, const char *stmt)
+{
+	if (loadinfo->indexing)
+	{
+		index_statement(loadinfo, stmt);
+		return;
+	}
+
+	if (loadinfo->caching)
+	{
+		if (get_int_var(COMMENT_HACK_VAR) != loadinfo->comment_hack)
+			loadinfo->caching = 0;
+		else
+			load_cache_append(loadinfo, 'S', stmt);
+	}
+	parse_statement(stmt, 0, NULL);
+}
+
+static void	load_diagnostic (struct load_info *loadinfo, int type, const char *format, ...)
+{
+	char *	message = NULL;
+	va_list	args;
+
+	va_start(args, format);
+	malloc_vsprintf(&message, format, args);
+	va_end(args);
+
+	/* Complaints will be made when the file is really loaded */
+	if (loadinfo->indexing)
+	{
+		if (type == 'E')
+			loadinfo->index_whole = 1;
+		new_free(&message);
+		return;
+	}
+
+	if (loadinfo->caching)
+		load_cache_append(loadinfo, type, message);
+
+	if (type == 'E')
+		my_error("%s", message);
+	else
+		yell("%s", message);
+	new_free(&message);
+}
+
+/*
+ * The std loader calls this whenever a new statement might begin on the
+ * line at 'offset'.  A statement can only be loaded by itself if it 
+ * starts at the beginning of a line that isn't in the middle of a comment.
+ */
+static void	load_statement_begins (struct load_info *loadinfo, off_t offset, int line, int in_comment)
+{
+	loadinfo->stmt_start = in_comment ? -1 : offset;
+	loadinfo->stmt_line = line;
+}
+
+/*
+ * A file's mtime in nanoseconds, or in whole seconds if that is all 
+ * this system keeps track of.
+ */
+static intmax_t	stat_mtime_ns (const Stat *sb)
+{
+#if defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+	return (intmax_t)sb->st_mtim.tv_sec * 1000000000 + sb->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC_TV_NSEC)
+	return (intmax_t)sb->st_mtimespec.tv_sec * 1000000000 + 
+				sb->st_mtimespec.tv_nsec;
+#else
+	return (intmax_t)sb->st_mtime * 1000000000;
+#endif
+}
+
+/*
+ * Parse the argument to /LOAD -range into 'range'.  A NULL 'spec' just 
+ * clears 'range'.  Returns -1 (and clears 'range') if 'spec' is garbage.
+ */
+static int	parse_load_range (const char *spec, struct load_range *range)
+{
+	char *	after;
+	const char *	colon;
+
+	range->start = range->end = -1;
+	range->size = range->mtime = -1;
+	range->cmd = range->name = NULL;
+	range->cmdlen = 0;
+	if (!spec)
+		return 0;
+
+	range->start = strtoimax(spec, &after, 10);
+	if (after == spec || *after != '-')
+		goto garbage;
+	range->end = strtoimax(after + 1, &after, 10);
+	if (range->start < 0 || range->end < range->start)
+		goto garbage;
+	if (!*after)
+		return 0;
+
+	/* :<size>:<mtime>:<command>:<name> */
+	if (*after != ':')
+		goto garbage;
+	range->size = strtoimax(after + 1, &after, 10);
+	if (*after != ':')
+		goto garbage;
+	range->mtime = strtoimax(after + 1, &after, 10);
+	if (*after != ':')
+		goto garbage;
+	range->cmd = after + 1;
+	if (!(colon = strchr(range->cmd, ':')) || colon == range->cmd || 
+			!colon[1])
+		goto garbage;
+	range->cmdlen = colon - range->cmd;
+	range->name = colon + 1;
+	return 0;
+
+garbage:
+	parse_load_range(NULL, range);
+	return -1;
+}
+
+/*
+ * Can we load just 'range' of 'filename' (whose 'contents' are 'size'
+ * bytes long)?  Only if the file hasn't changed since it was stubbed,
+ * the range is whole lines, and it defines what it's supposed to.
+ */
+static int	load_range_ok (const struct load_range *range, const char *filename, const char *contents, off_t size)
+{
+	Stat		sb;
+	const char *	p;
+	const char *	word;
+	size_t		len;
+
+	if (range->end > size)
+		return 0;
+	if (range->start > 0 && contents[range->start - 1] != '\n')
+		return 0;
+	if (range->end < size && contents[range->end - 1] != '\n')
+		return 0;
+
+	/* A -range you typed in yourself is taken at its word */
+	if (!range->cmd)
+		return 1;
+
+	if (epic_stat(filename, &sb) < 0 || 
+			(intmax_t)sb.st_size != range->size ||
+			stat_mtime_ns(&sb) != range->mtime)
+		return 0;
+
+	/* It must begin with "/<command> <name>", like index_statement() saw */
+	for (p = contents + range->start; my_isspace(*p); p++)
+		;
+	while (*p == '/')
+		p++;
+	for (word = p; *p && !my_isspace(*p); p++)
+		;
+	len = p - word;
+	if (len != range->cmdlen || my_strnicmp(word, range->cmd, len))
+		return 0;
+
+	while (my_isspace(*p))
+		p++;
+	for (word = p; *p && !my_isspace(*p); p++)
+		;
+	len = p - word;
+	if (len != strlen(range->name) || my_strnicmp(word, range->name, len))
+		return 0;
+	if (p > contents + range->end)
+		return 0;
+
+	return 1;
+}
+
+/*
+ * /STUB PACKAGE
+ *
+ * Script libraries are mostly a long list of /ALIASes and /ASSIGNs, 
+ * and most of them are never used.  /STUB PACKAGE runs each file through
+ * the std loader without executing anything, and writes down where each
+ * definition starts and ends.  Each name is stubbed to "-range <start>-<end>
+ * <file>", so the first time it is used, /LOAD reads in just that one 
+ * definition instead of the whole file.  The range also says how big the 
+ * file was, when it was last changed, and what it defines; if any of that
+ * isn't true any more, /LOAD reads in the whole file after all.
+ *
+ * This only works if the file is nothing but definitions, one per line 
+ * (or lines).  If anything else happens at the top level (/PACKAGE, /ON, 
+ * /@, two statements on one line, ...) every name is stubbed to the whole 
+ * file, which is what /STUB ALIAS would have done.
+ */
+static void	index_statement (struct load_info *loadinfo, const char *stmt)
+{
+	const char *	p;
+	const char *	cmd;
+	const char *	name;
+	size_t		cmdlen, namelen;
+	char		record[256];
+	int		type;
+	ssize_t		span;
+
+	if (loadinfo->stmt_start < 0 || 
+			loadinfo->stmt_start < loadinfo->index_end)
+		loadinfo->index_whole = 1;
+	loadinfo->index_end = loadinfo->stmt_end;
+
+	for (p = stmt; my_isspace(*p); p++)
+		;
+	while (*p == '/')
+		p++;
+	for (cmd = p; *p && !my_isspace(*p); p++)
+		;
+	if (!(cmdlen = p - cmd))
+		return;
+
+	if (cmdlen == 5 && !my_strnicmp(cmd, "ALIAS", 5))
+		type = 'A';
+	else if (cmdlen == 6 && !my_strnicmp(cmd, "ASSIGN", 6))
+		type = 'V';
+	else
+	{
+		loadinfo->index_whole = 1;
+		return;
+	}
+
+	while (my_isspace(*p))
+		p++;
+	for (name = p; *p && !my_isspace(*p); p++)
+		;
+	namelen = p - name;
+
+	/* Deleting (-name), listing, or computed names */
+	if (!namelen || namelen > 128 || *name == '-' || 
+			memchr(name, '$', namelen) || memchr(name, '{', namelen))
+	{
+		loadinfo->index_whole = 1;
+		return;
+	}
+
+	/* It must be just the one definition */
+	while (my_isspace(*p))
+		p++;
+	if (type == 'A' && *p == '{')
+	{
+		if ((span = MatchingBracket(p + 1, '{', '}')) < 0)
+			loadinfo->index_whole = 1;
+		else
+		{
+			for (p += span + 2; my_isspace(*p); p++)
+				;
+			if (*p)
+				loadinfo->index_whole = 1;
+		}
+	}
+	else if (strchr(p, ';'))
+		loadinfo->index_whole = 1;
+
+	snprintf(record, sizeof(record), "%jd-%jd %.*s", 
+			(intmax_t)loadinfo->stmt_start, 
+			(intmax_t)loadinfo->stmt_end, (int)namelen, name);
+	load_cache_record(&loadinfo->cache, type, loadinfo->stmt_line, record);
+}
+
+/*
+ * Returns the index records of 'filename' (which you must new_free()),
+ * from the load cache if it's there, and saving it there if it isn't.
+ */
+static char *	index_script (const char *filename)
+{
+	struct epic_loadfile *elf;
+	struct load_info info;
+	char *	expanded;
+	char *	contents = NULL;
+	off_t	size = 0;
+	int	mapped;
+	char *	cache_key;
+	Filename cache_file;
+	char *	records;
+
+	cache_key = load_cache_key(filename, "index", cache_file);
+	if ((records = load_cache_fetch(cache_key, cache_file)))
+	{
+		new_free(&cache_key);
+		return records;
+	}
+
+	memset(&info, 0, sizeof(info));
+	expanded = malloc_strdup(filename);
+	if (!(elf = uzfopen(&expanded, ".", 1, &info.sb)))
+	{
+		new_free(&cache_key);
+		return NULL;
+	}
+
+	if (!(mapped = map_elf_file(elf, &contents, &size)))
+		slurp_elf_file(elf, &contents, &size);
+	epic_fclose(elf);
+	new_free(&elf);
+
+	info.filename = expanded;
+	info.line = 1;
+	info.indexing = 1;
+	info.comment_hack = get_int_var(COMMENT_HACK_VAR);
+	strbuf_init(&info.cache);
+	if (contents && *contents)
+		loader_std(contents, size, expanded, NULL, &info);
+
+	/* A /LOAD -range won't be recoded the same way as the whole file */
+	if (contents && invalid_utf8str(contents))
+		info.index_whole = 1;
+	if (info.index_whole)
+		load_cache_record(&info.cache, 'W', 0, empty_string);
+
+	if (cache_key)
+		load_cache_store(cache_key, cache_file, &info);
+	strbuf_cat(&info.cache, "END\n");
+	records = strbuf_release(&info.cache);
+
+	if (mapped)
+		unmap_elf_file(contents, size);
+	else
+		new_free(&contents);
+	new_free(&expanded);
+	new_free(&cache_key);
+	return records;
+}
+
+/*
+ * Stub everything 'filename' defines.  Returns the number of names stubbed.
+ */
+static int	stub_script (const char *filename)
+{
+	char *	records;
+	char *	p;
+	char *	text;
+	char *	name;
+	char *	stuff;
+	size_t	len;
+	int	type, line, whole = 0, count = 0;
+	Stat	sb;
+
+	if (strpbrk(filename, " \t"))
+	{
+		say("STUB PACKAGE: Skipping %s (it has a space in it)", filename);
+		return 0;
+	}
+
+	/* 
+	 * If the file changes after this, the ranges won't match it, 
+	 * and /LOAD will know that, because the stat won't match either.
+	 */
+	if (epic_stat(filename, &sb) < 0)
+		whole = 1;
+	if (!(records = index_script(filename)))
+		return 0;
+
+	for (p = records; load_cache_next(&p, &type, &line, &text, &len) > 0; )
+		if (type == 'W')
+			whole = 1;
+
+	for (p = records; load_cache_next(&p, &type, &line, &text, &len) > 0; )
+	{
+		if (type != 'A' && type != 'V')
+			continue;
+		text[len] = 0;
+		if (!(name = strchr(text, ' ')))
+			continue;
+		*name++ = 0;
+
+		if (whole)
+			stuff = malloc_strdup(filename);
+		else
+			stuff = malloc_sprintf(NULL, "-range %s:%jd:%jd:%s:%s %s", 
+				text, (intmax_t)sb.st_size, stat_mtime_ns(&sb),
+				type == 'A' ? "alias" : "assign", name, filename);
+
+		if (type == 'A')
+			add_cmd_stub_alias(name, stuff, 0);
+		else
+			add_var_stub_alias(name, stuff, 0);
+		new_free(&stuff);
+		count++;
+	}
+
+	new_free(&records);
+	return count;
+}
+
+static int	stub_package_sort (const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/*
+ * /STUB PACKAGE <dir-or-file>: Stub everything defined in each file in 
+ * a directory (or in one file, found in LOAD_PATH).
+ */
+void	stub_package (const char *path)
+{
+	Filename	dir;
+	Stat		sb;
+	DIR *		d;
+	struct dirent *	e;
+	char **		names = NULL;
+	char *		fullname;
+	char *		expanded;
+	const char *	use_path;
+	struct epic_loadfile *elf;
+	int		count = 0, files = 0, i;
+
+	if (!normalize_filename(path, dir) && !stat(dir, &sb) && 
+			S_ISDIR(sb.st_mode))
+	{
+		if (!(d = opendir(dir)))
+		{
+			say("STUB PACKAGE: Can't read %s: %s", dir, strerror(errno));
+			return;
+		}
+		while ((e = readdir(d)))
+		{
+			if (*e->d_name == '.')
+				continue;
+			RESIZE(names, char *, files + 1);
+			names[files++] = malloc_strdup(e->d_name);
+		}
+		closedir(d);
+
+		/* So that the last definition of a name always wins */
+		if (files)
+			qsort(names, files, sizeof(char *), stub_package_sort);
+
+		for (i = 0; i < files; i++)
+		{
+			fullname = malloc_sprintf(NULL, "%s/%s", dir, names[i]);
+			if (!stat(fullname, &sb) && S_ISREG(sb.st_mode))
+				count += stub_script(fullname);
+			new_free(&fullname);
+			new_free(&names[i]);
+		}
+		new_free((char **)&names);
+	}
+	else
+	{
+		if (!(use_path = get_string_var(LOAD_PATH_VAR)))
+		{
+			say("LOAD_PATH has not been set");
+			return;
+		}
+
+		/* uzfopen() frees 'expanded' on error */
+		expanded = malloc_strdup(path);
+		if (!(elf = uzfopen(&expanded, use_path, 1, &sb)))
+			return;
+		epic_fclose(elf);
+		new_free(&elf);
+
+		count = stub_script(expanded);
+		new_free(&expanded);
+		files = 1;
+	}
+
+	say("Stubbed %d names from %d files in %s", count, files, path);
+}
+
 /*
  * The /me command.  Does CTCP ACTION.  Dont ask me why this isnt the
  * same as /describe...
@@ -3298,6 +4230,74 @@ void    runcmds_with_arglist (const char *what, char *args, const char *subargs)
 	destroy_arglist(&arglist);
 }
 
+/*
+ * Loops run the same block over and over, and parse_block() would have 
+ * to find where each statement ends every time through.  Instead, the 
+ * loop commands compile_block() once, which chops the block into its
+ * statements, and then run_block() each time through.
+ *
+ * run_block(block, args) does exactly what runcmds(text, args) does.
+ */
+Block *	compile_block (const char *org_line)
+{
+	Block *	block;
+	char *	line;
+	ssize_t	span;
+
+	block = new_malloc(sizeof(Block));
+	block->text = line = malloc_strdup(org_line);
+	block->stmts = NULL;
+	block->count = 0;
+
+	while (line && *line)
+	{
+		if ((span = next_statement(line)) < 0)
+			break;
+
+		if (line[span] == ';')
+			line[span++] = 0;
+
+		RESIZE(block->stmts, char *, block->count + 1);
+		block->stmts[block->count++] = line;
+
+		/* Willfully ignore spaces after semicolons. */
+		line += span;
+		while (line && *line && isspace(*line))
+			line++;
+	}
+
+	return block;
+}
+
+void	run_block (const Block *block, const char *args)
+{
+	int	i;
+
+	if (!args)
+		args = empty_string;
+
+	for (i = 0; i < block->count; i++)
+	{
+		parse_statement(block->stmts[i], 0, args);
+
+		/* See parse_block() */
+		if ((will_catch_break_exceptions && break_exception) ||
+		    (will_catch_return_exceptions && return_exception) ||
+		    (will_catch_continue_exceptions && continue_exception) ||
+		     system_exception)
+			break;
+	}
+}
+
+void	destroy_block (Block **block)
+{
+	if (!*block)
+		return;
+	new_free(&(*block)->stmts);
+	new_free(&(*block)->text);
+	new_free((char **)block);
+}
+
 /*
  * parse_block: execute a block of ircII statements (in a C string)
  *
@@ -3421,10 +4421,13 @@ static	unsigned 	level = 0;
 	int		cmdchar_used = 0;
 	int		quiet = 0;
 	char *		this_stmt;
+	ArenaMark	mark;
 
 	if (!stmt || !*stmt)
 		return 0;
 
+	/* Temporaries for this statement go in the arena */
+	arena_mark(&mark);
 	this_stmt = LOCAL_COPY(stmt);
 	set_current_command(this_stmt);
 
@@ -3570,9 +4573,9 @@ expression_statement:
 		const char *prevcmd = NULL;
 
 		if (subargs != NULL)
-			cmd = expand_alias(stmt, subargs); 
+			cmd = expand_alias_temp(stmt, subargs); 
 		else
-			cmd = malloc_strdup(stmt);
+			cmd = arena_strdup(stmt);
 
 		args = cmd;
 		while (*args && !isspace(*args))
@@ -3592,9 +4595,17 @@ expression_statement:
 		}
 
 		if (alias) 
+		{
+			int	prof = PROFILE_ENTER(PROFILE_ALIAS, cmd);
 			call_user_command(cmd, alias, args, arglist);
+			PROFILE_LEAVE(prof);
+		}
 		else if (builtin)
+		{
+			int	prof = PROFILE_ENTER(PROFILE_COMMAND, cmd);
 			builtin(cmd, args, subargs);
+			PROFILE_LEAVE(prof);
+		}
 		else if (get_int_var(DISPATCH_UNKNOWN_COMMANDS_VAR))
 			send_to_server("%s %s", cmd, args);
 		else if (do_hook(UNKNOWN_COMMAND_LIST, "%s%s %s", cmdchar_used >= 2 ? "//" : "", cmd, args))
@@ -3602,8 +4613,6 @@ expression_statement:
 
 		if (alias || builtin)
 			current_command = prevcmd;
-
-		new_free(&cmd);
 	}
 
 	/* 
@@ -3618,6 +4627,7 @@ expression_statement:
 
 	level--;
 	unset_current_command();
+	arena_release(&mark);
         return 0;
 }
 
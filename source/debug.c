@@ -74,6 +74,7 @@ static struct debug_opts opts[] =
 	{ "WHO_QUEUE",		DEBUG_WHO_QUEUE },
 	{ "UNICODE",		DEBUG_UNICODE },
 	{ "DWORD",        	DEBUG_DWORD },
+	{ "ARENA",		DEBUG_ARENA },
 	{ "MEMORY",		0 },
 	{ "NO_COLOR",		0 },
 	{ "REGEX",		0 },
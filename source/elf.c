@@ -37,6 +37,50 @@
 #include "ircaux.h"
 #include "elf.h"
 #include "output.h"
+#include <sys/mman.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_BZLIB
+#include <bzlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+
+/*
+ * When we have the library for it, we decompress .gz, .bz2 and .xz files
+ * ourselves, a buffer at a time, instead of running gunzip or bunzip2 and
+ * reading its output through a pipe.
+ */
+struct epic_decompress
+{
+	char *	filename;		/* So we can start over */
+	int	how;			/* COMPRESS_* */
+	int	done;			/* Nothing more to decompress */
+	int	error;			/* Decompressing failed */
+	off_t	offset;			/* Decompressed bytes read so far */
+	FILE *	raw;			/* The compressed file (bzip2, xz) */
+#ifdef HAVE_ZLIB
+	gzFile	gz;
+#endif
+#ifdef HAVE_BZLIB
+	BZFILE *bz;
+#endif
+#ifdef HAVE_LZMA
+	lzma_stream xz;
+	unsigned char	xzbuf[8192];	/* Compressed bytes for lzma_code() */
+#endif
+	unsigned char	buf[8192];	/* Decompressed bytes for epic_fgetc() */
+	size_t	len;
+	size_t	pos;
+};
+
+static int	dc_open (struct epic_decompress *dc);
+static ssize_t	dc_read (struct epic_decompress *dc, char *buf, size_t n);
+static ssize_t	dc_fread (struct epic_decompress *dc, char *buf, size_t n);
+static int	dc_getc (struct epic_decompress *dc);
+static void	dc_close (struct epic_decompress *dc);
 
 #ifdef HAVE_LIBARCHIVE
 static int archive_fopen(struct epic_loadfile *elf, char *filename, const char *ext, int do_error);
@@ -196,6 +240,12 @@ int	epic_fgetc(struct epic_loadfile *elf)
         }
     } 
 #endif
+    else if ((elf->dc)!=NULL) {
+        int c2 = dc_getc(elf->dc);
+        if (c2 == EOF)
+            elf->eof=1;
+        return c2;
+    }
     else {
         /* other */
         return EOF;
@@ -212,6 +262,21 @@ char *	epic_fgets(char *s, int n, struct epic_loadfile *elf)
         return archive_fgets(s, n, elf->a);
     } 
 #endif
+    else if ((elf->dc)!=NULL) {
+        int i, c;
+
+        for (i = 0; i < n - 1; ) {
+            if ((c = dc_getc(elf->dc)) == EOF) {
+                elf->eof=1;
+                break;
+            }
+            s[i++] = c;
+            if (c=='\n')
+                break;
+        }
+        s[i] = '\0';
+        return i ? s : NULL;
+    }
     else {
         return NULL;
     }
@@ -228,6 +293,9 @@ int	epic_feof(struct epic_loadfile *elf)
         /* unspecified */
     } 
 #endif
+    else if ((elf->dc)!=NULL) {
+        return elf->eof;
+    }
     else {
         return 1;
     }
@@ -245,11 +313,106 @@ int	epic_fclose(struct epic_loadfile *elf)
         return 0;
     } 
 #endif
+    else if ((elf->dc)!=NULL) {
+        dc_close(elf->dc);
+        new_free(&elf->dc->filename);
+        new_free(&elf->dc);
+        return 0;
+    }
     else {
         return EOF;
     }
 }
 
+int	epic_ferror(struct epic_loadfile *elf)
+{
+    if ((elf->fp)!=NULL) {
+        return ferror(elf->fp);
+    }
+    else if ((elf->dc)!=NULL) {
+        return elf->dc->error;
+    }
+    else {
+        return 0;
+    }
+}
+
+/*
+ * A decompressed file can't really be rewound, so we start decompressing
+ * it all over again.
+ */
+int	epic_frewind(struct epic_loadfile *elf)
+{
+    if ((elf->fp)!=NULL) {
+        rewind(elf->fp);
+        return 0;
+    }
+    else if ((elf->dc)!=NULL) {
+        dc_close(elf->dc);
+        elf->eof = 0;
+        if (!dc_open(elf->dc)) {
+            elf->dc->done = elf->dc->error = 1;
+            return -1;
+        }
+        return 0;
+    }
+    else {
+        return -1;
+    }
+}
+
+/*
+ * A decompressed file can only seek forward, so seeking backwards 
+ * starts over from the beginning.  There's no way to know where the 
+ * end is without decompressing the whole thing, so SEEK_END isn't 
+ * supported.
+ */
+int	epic_fseek(struct epic_loadfile *elf, off_t offset, int whence)
+{
+    if ((elf->fp)!=NULL) {
+        return fseeko(elf->fp, offset, whence);
+    }
+    else if ((elf->dc)!=NULL) {
+        char	junk[8192];
+        ssize_t	got;
+
+        if (whence == SEEK_CUR)
+            offset += elf->dc->offset;
+        else if (whence != SEEK_SET || offset < 0) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (offset < elf->dc->offset && epic_frewind(elf))
+            return -1;
+        elf->eof = 0;
+
+        while (elf->dc->offset < offset) {
+            got = (offset - elf->dc->offset < (off_t)sizeof(junk)) ? 
+                    (ssize_t)(offset - elf->dc->offset) : (ssize_t)sizeof(junk);
+            if (dc_fread(elf->dc, junk, got) <= 0)
+                break;
+        }
+        return elf->dc->error ? -1 : 0;
+    }
+    else {
+        return -1;
+    }
+}
+
+off_t	epic_ftell(struct epic_loadfile *elf)
+{
+    if ((elf->fp)!=NULL) {
+        return ftello(elf->fp);
+    }
+    else if ((elf->dc)!=NULL) {
+        return elf->dc->offset;
+    }
+    else {
+        return -1;
+    }
+}
+
 off_t	epic_stat(const char *filename, struct stat *buf)
 {
 #ifdef HAVE_LIBARCHIVE
@@ -368,7 +531,7 @@ size_t	slurp_elf_file (struct epic_loadfile *elf, char **file_contents, off_t *f
 {
 	size_t	size;
 	size_t	next_byte = 0;
-	int	sigh;
+	ssize_t	got;
 
 	if (!elf)
 		return -1;
@@ -378,32 +541,419 @@ size_t	slurp_elf_file (struct epic_loadfile *elf, char **file_contents, off_t *f
 	size = 8192;
 	RESIZE(*file_contents, char, size);
 
-	while (!epic_feof(elf))
+	for (;;)
 	{
-		if (next_byte >= size)
+		/* Always leave room for the nul */
+		if (next_byte + 1 >= size)
 		{
-			size += 8192;
+			size *= 2;
 			RESIZE(*file_contents, char, size);
 		}
 
-		sigh = epic_fgetc(elf);
-		if (sigh == EOF)
-			(*file_contents)[next_byte] = 0;
-		else if (sigh >= 0 && sigh <= 255)
-			(*file_contents)[next_byte] = (char)sigh;
-		next_byte++;
+		if ((got = epic_fread(elf, *file_contents + next_byte, 
+					size - next_byte - 1)) <= 0)
+			break;
+		next_byte += got;
 	}
 
-	/* The previous epic_fgetc() resulted in EOF so we got to back up */
-	if (next_byte > 0)
-		next_byte--;
-
 	/* Just for laughs, zero terminate it so it's a C string */
 	(*file_contents)[next_byte] = 0;
 	*file_contents_size = next_byte;
 	return next_byte;
 }
 
+/*
+ * map_elf_file: Like slurp_elf_file(), but if 'elf' is an ordinary file,
+ * (*file_contents) is a (private, copy-on-write) mapping of the file 
+ * instead of a copy of it, so big files don't have to be read in and 
+ * copied around.
+ *
+ * Return value:
+ *	0	- The file can't be mapped.  Use slurp_elf_file() instead.
+ *	1	- (*file_contents) is the mapped file, which is
+ *		  (*file_contents_size) bytes long and followed by a nul.
+ *		  YOU MUST unmap_elf_file() it, and NOT new_free() it!
+ *		  If you want to pass it to something that might free or 
+ *		  realloc it, make a copy first.
+ *
+ * Don't keep it around -- if somebody truncates the file while it's
+ * mapped, touching the missing part is a SIGBUS.
+ */
+int	map_elf_file (struct epic_loadfile *elf, char **file_contents, off_t *file_contents_size)
+{
+	Stat	sb;
+	long	pagesize;
+	char *	map;
+
+	if (!elf || !elf->fp || !file_contents)
+		return 0;
+	if (fstat(fileno(elf->fp), &sb) < 0 || !S_ISREG(sb.st_mode))
+		return 0;
+	if (sb.st_size <= 0 || (off_t)(size_t)sb.st_size != sb.st_size)
+		return 0;
+
+	/*
+	 * The rest of the last page past the end of the file is zeroed, so 
+	 * that gets us our nul for free -- unless the file ends right at 
+	 * the end of a page.
+	 */
+	if ((pagesize = sysconf(_SC_PAGESIZE)) <= 0 || 
+			sb.st_size % pagesize == 0)
+		return 0;
+
+	map = mmap(NULL, (size_t)sb.st_size, PROT_READ | PROT_WRITE, 
+				MAP_PRIVATE, fileno(elf->fp), 0);
+	if (map == MAP_FAILED)
+		return 0;
+
+	/* If the file grew since we fstat()ed it, there's no nul */
+	if (map[sb.st_size] != 0)
+	{
+		munmap(map, (size_t)sb.st_size);
+		return 0;
+	}
+
+	*file_contents = map;
+	*file_contents_size = sb.st_size;
+	return 1;
+}
+
+void	unmap_elf_file (char *file_contents, off_t file_contents_size)
+{
+	if (file_contents)
+		munmap(file_contents, (size_t)file_contents_size);
+}
+
+/*
+ * Read up to 'n' bytes from 'elf'.  Returns the number of bytes read, 
+ * 0 at the end of the file, or -1 on error.
+ */
+ssize_t	epic_fread (struct epic_loadfile *elf, char *buf, size_t n)
+{
+	ssize_t	got;
+
+	if (elf->fp)
+		got = (ssize_t)fread(buf, 1, n, elf->fp);
+#ifdef HAVE_LIBARCHIVE
+	else if (elf->a)
+		got = archive_read_data(elf->a, buf, n);
+#endif
+	else if (elf->dc)
+		got = dc_fread(elf->dc, buf, n);
+	else
+		got = -1;
+
+	if (got <= 0)
+		elf->eof = 1;
+	return got;
+}
+
+/*
+ * epic_can_decompress: Returns 1 if we can decompress files that are
+ * compressed 'how' (COMPRESS_*) by ourselves.
+ */
+int	epic_can_decompress (int how)
+{
+	switch (how)
+	{
+#ifdef HAVE_ZLIB
+		case COMPRESS_GZIP:
+			return 1;
+#endif
+#ifdef HAVE_BZLIB
+		case COMPRESS_BZIP2:
+			return 1;
+#endif
+#ifdef HAVE_LZMA
+		case COMPRESS_XZ:
+			return 1;
+#endif
+		default:
+			return 0;
+	}
+}
+
+/*
+ * epic_fopen_decompress: Open 'filename', which is compressed 'how', 
+ * such that reading it gives you the uncompressed data.  You must check 
+ * epic_can_decompress(how) first.
+ */
+struct epic_loadfile *	epic_fopen_decompress (const char *filename, int how, int do_error)
+{
+	struct epic_loadfile *	elf;
+	struct epic_decompress *dc;
+
+	errno = 0;
+	dc = (struct epic_decompress *)new_malloc(sizeof(struct epic_decompress));
+	dc->filename = malloc_strdup(filename);
+	dc->how = how;
+
+	if (!dc_open(dc))
+	{
+		if (do_error)
+			yell("Cannot open file %s: %s", filename, 
+				errno ? strerror(errno) : "decompression failed");
+		dc_close(dc);
+		new_free(&dc->filename);
+		new_free(&dc);
+		return NULL;
+	}
+
+	elf = (struct epic_loadfile *)new_malloc(sizeof(struct epic_loadfile));
+	elf->fp = NULL;
+	elf->dc = dc;
+	elf->eof = 0;
+	return elf;
+}
+
+/*
+ * Start decompressing dc->filename from the beginning.  Returns 1 if 
+ * that worked.  If it didn't, you still need to dc_close() it.
+ */
+static int	dc_open (struct epic_decompress *dc)
+{
+	int	ok = 0;
+
+	dc->done = dc->error = 0;
+	dc->offset = 0;
+	dc->len = dc->pos = 0;
+
+	if (dc->how == COMPRESS_GZIP)
+	{
+#ifdef HAVE_ZLIB
+		if ((dc->gz = gzopen(dc->filename, "rb")))
+			ok = 1;
+#endif
+	}
+	else if ((dc->raw = fopen(dc->filename, "rb")))
+	{
+#ifdef HAVE_BZLIB
+		if (dc->how == COMPRESS_BZIP2)
+		{
+			int	bzerror;
+
+			dc->bz = BZ2_bzReadOpen(&bzerror, dc->raw, 0, 0, NULL, 0);
+			if (bzerror == BZ_OK)
+				ok = 1;
+			else
+				dc->bz = NULL;
+		}
+#endif
+#ifdef HAVE_LZMA
+		if (dc->how == COMPRESS_XZ)
+		{
+			lzma_stream init = LZMA_STREAM_INIT;
+
+			dc->xz = init;
+			if (lzma_stream_decoder(&dc->xz, UINT64_MAX, 
+					LZMA_CONCATENATED) == LZMA_OK)
+				ok = 1;
+		}
+#endif
+	}
+
+	return ok;
+}
+
+/*
+ * Decompress up to 'n' bytes into 'buf'.  Returns the number of bytes,
+ * 0 at the end, and -1 on error.
+ */
+static ssize_t	dc_read (struct epic_decompress *dc, char *buf, size_t n)
+{
+	if (dc->done || !buf || n == 0)
+		return 0;
+
+#ifdef HAVE_ZLIB
+	if (dc->how == COMPRESS_GZIP)
+	{
+		int	got;
+
+		if (n > INT_MAX)
+			n = INT_MAX;
+		if ((got = gzread(dc->gz, buf, (unsigned)n)) <= 0)
+			dc->done = 1;
+		return got;
+	}
+#endif
+#ifdef HAVE_BZLIB
+	if (dc->how == COMPRESS_BZIP2)
+	{
+		int	bzerror, got, nunused, c;
+		void *	unused;
+		char	save[BZ_MAX_UNUSED];
+
+		if (n > INT_MAX)
+			n = INT_MAX;
+		for (;;)
+		{
+			if (!dc->bz)
+				return 0;
+
+			got = BZ2_bzRead(&bzerror, dc->bz, buf, (int)n);
+			if (bzerror == BZ_OK)
+				return got;
+			if (bzerror != BZ_STREAM_END)
+			{
+				dc->done = 1;
+				return -1;
+			}
+
+			/* 
+			 * Parallel bzip2's write one stream after another,
+			 * so keep going if there's anything left.
+			 */
+			BZ2_bzReadGetUnused(&bzerror, dc->bz, &unused, &nunused);
+			memcpy(save, unused, nunused);
+			BZ2_bzReadClose(&bzerror, dc->bz);
+			dc->bz = NULL;
+
+			if (nunused == 0)
+			{
+				if ((c = getc(dc->raw)) == EOF)
+					dc->done = 1;
+				else
+					ungetc(c, dc->raw);
+			}
+			if (!dc->done)
+			{
+				dc->bz = BZ2_bzReadOpen(&bzerror, dc->raw, 0, 0, 
+							save, nunused);
+				if (bzerror != BZ_OK)
+				{
+					dc->bz = NULL;
+					dc->done = 1;
+				}
+			}
+
+			if (got > 0)
+				return got;
+			if (dc->done)
+				return 0;
+		}
+	}
+#endif
+#ifdef HAVE_LZMA
+	if (dc->how == COMPRESS_XZ)
+	{
+		lzma_ret	ret;
+		size_t		got;
+
+		dc->xz.next_out = (uint8_t *)buf;
+		dc->xz.avail_out = n;
+		for (;;)
+		{
+			if (dc->xz.avail_in == 0 && !feof(dc->raw))
+			{
+				dc->xz.next_in = dc->xzbuf;
+				dc->xz.avail_in = fread(dc->xzbuf, 1, 
+						sizeof(dc->xzbuf), dc->raw);
+				if (ferror(dc->raw))
+				{
+					dc->done = 1;
+					return -1;
+				}
+			}
+
+			ret = lzma_code(&dc->xz, 
+				feof(dc->raw) ? LZMA_FINISH : LZMA_RUN);
+			got = n - dc->xz.avail_out;
+
+			if (ret == LZMA_STREAM_END)
+			{
+				dc->done = 1;
+				return (ssize_t)got;
+			}
+			if (ret != LZMA_OK)
+			{
+				dc->done = 1;
+				return -1;
+			}
+			if (got > 0)
+				return (ssize_t)got;
+		}
+	}
+#endif
+
+	return -1;
+}
+
+static int	dc_getc (struct epic_decompress *dc)
+{
+	ssize_t	got;
+
+	if (dc->pos >= dc->len)
+	{
+		if ((got = dc_read(dc, (char *)dc->buf, sizeof(dc->buf))) <= 0)
+		{
+			if (got < 0)
+				dc->error = 1;
+			return EOF;
+		}
+		dc->len = (size_t)got;
+		dc->pos = 0;
+	}
+	dc->offset++;
+	return dc->buf[dc->pos++];
+}
+
+/*
+ * Like dc_read(), but takes whatever dc_getc() has buffered first, so
+ * you can mix the two.
+ */
+static ssize_t	dc_fread (struct epic_decompress *dc, char *buf, size_t n)
+{
+	size_t	have;
+	ssize_t	got;
+
+	if (dc->pos < dc->len)
+	{
+		have = dc->len - dc->pos;
+		if (have > n)
+			have = n;
+		memcpy(buf, dc->buf + dc->pos, have);
+		dc->pos += have;
+		dc->offset += have;
+		return (ssize_t)have;
+	}
+
+	if ((got = dc_read(dc, buf, n)) < 0)
+		dc->error = 1;
+	else
+		dc->offset += got;
+	return got;
+}
+
+static void	dc_close (struct epic_decompress *dc)
+{
+#ifdef HAVE_ZLIB
+	if (dc->gz)
+		gzclose(dc->gz);
+	dc->gz = NULL;
+#endif
+#ifdef HAVE_BZLIB
+	if (dc->bz)
+	{
+		int	bzerror;
+
+		BZ2_bzReadClose(&bzerror, dc->bz);
+		dc->bz = NULL;
+	}
+#endif
+#ifdef HAVE_LZMA
+	if (dc->how == COMPRESS_XZ)
+	{
+		lzma_stream init = LZMA_STREAM_INIT;
+
+		lzma_end(&dc->xz);
+		dc->xz = init;
+	}
+#endif
+	if (dc->raw)
+		fclose(dc->raw);
+	dc->raw = NULL;
+}
+
 int	string_feof(const char *__U(file_contents), off_t file_contents_size)
 {
 	if (file_contents_size > 0)
@@ -35,8 +35,9 @@
  */
 
 /* Function decls */
-static	void	TruncateAndEscape (char **, const char *, ssize_t, const char *);
-static	char *	alias_special_char (char **, char *, const char *, char *);
+static	void	expand_alias_into (Strbuf *, const char *, const char *);
+static	void	TruncateAndEscape (Strbuf *, const char *, ssize_t, const char *);
+static	char *	alias_special_char (Strbuf *, char *, const char *, char *);
 static	void	do_alias_string (void *, const char *);
 
 /************************** EXPRESSION MODE PARSER ***********************/
@@ -158,19 +159,47 @@ all_done:
  */
 char	*expand_alias	(const char *string, const char *args)
 {
-	char	*buffer = NULL,
-		*ptr,
-		*stuff = NULL,
-		*escape_str = NULL;
-	char	*escape_temp;
-	char	ch;
-	int	is_quote = 0;
+	ArenaMark	mark;
+	Strbuf		buffer;
+	char *		retval;
 
 	if (!string || !*string)
 		return malloc_strdup(empty_string);
 
-	escape_temp = alloca(2);
-	escape_temp[1] = 0;
+	arena_mark(&mark);
+	strbuf_init_temp(&buffer);
+	expand_alias_into(&buffer, string, args);
+	retval = malloc_strdup(buffer.str);
+	arena_release(&mark);
+	return retval;
+}
+
+/*
+ * expand_alias_temp: The same as expand_alias(), but the result is in the
+ * scratch arena, so you must not free it, and it goes away when the
+ * statement (or function call) you are in is done.
+ */
+char	*expand_alias_temp (const char *string, const char *args)
+{
+	Strbuf	buffer;
+
+	if (!string || !*string)
+		return arena_strdup(empty_string);
+
+	strbuf_init_temp(&buffer);
+	expand_alias_into(&buffer, string, args);
+	return strbuf_release(&buffer);
+}
+
+static void	expand_alias_into (Strbuf *buffer, const char *string, const char *args)
+{
+	Strbuf	escape_str;
+	char	*ptr,
+		*stuff = NULL;
+	char	ch;
+	int	is_quote = 0;
+
+	strbuf_init_temp(&escape_str);
 
 	ptr = stuff = LOCAL_COPY(string);
 
@@ -187,8 +216,6 @@ char	*expand_alias	(const char *string, const char *args)
 		{
 		    case '$':
 		    {
-			char *buffer1 = NULL;
-
 			/*
 			 * Replace the $ with a nul, then ptr points 
 			 * at the char after the $ (the expando)
@@ -200,12 +227,12 @@ char	*expand_alias	(const char *string, const char *args)
 				 * But if it's an $ at the end of
 				 * the string -> ignore it.
 				 */
-				malloc_strcat(&buffer, empty_string);
+				strbuf_cat(buffer, empty_string);
 				break;		/* Hrm. */
 			}
 
 			/* Append the stuff before the $ to the work buffer. */
-			malloc_strcat_ues(&buffer, stuff, empty_string);
+			strbuf_cat_ues(buffer, stuff, empty_string);
 
 			/* 
 			 * After a $ may be any number of ^x sequences,
@@ -216,20 +243,15 @@ char	*expand_alias	(const char *string, const char *args)
 				ptr++;
 				if (!*ptr)	/* Blah */
 					break;
-				escape_temp[0] = *ptr;
-				malloc_strcat(&escape_str, escape_temp);
+				strbuf_ncat(&escape_str, ptr, 1);
 			}
 
-			/* Now expand (and quote) the expando into 'buffer1' */
+			/* Now expand (and quote) the expando onto 'buffer' */
 			/* The retval (stuff) is the byte after the expando */
-			stuff = alias_special_char(&buffer1, ptr, args, escape_str);
-
-			/* And then append that to the work buffer. */
-			malloc_strcat(&buffer, buffer1);
+			stuff = alias_special_char(buffer, ptr, args, escape_str.str);
 
-			new_free(&buffer1);
-			if (escape_str)		/* Why ``stuff''? */
-				new_free(&escape_str);
+			if (escape_str.str)		/* Why ``stuff''? */
+				strbuf_free(&escape_str);
 
 			/* Set the next char to after the expando */
 			ptr = stuff;
@@ -243,7 +265,7 @@ char	*expand_alias	(const char *string, const char *args)
 
 			ch = *ptr;
 			*ptr = 0;
-			malloc_strcat_ues(&buffer, stuff, empty_string);
+			strbuf_cat_ues(buffer, stuff, empty_string);
 			stuff = ptr;
 
 			if ((span = MatchingBracket(stuff + 1, ch, 
@@ -263,7 +285,7 @@ char	*expand_alias	(const char *string, const char *args)
 			*stuff = ch;
 			ch = *ptr;
 			*ptr = 0;
-			malloc_strcat(&buffer, stuff);
+			strbuf_cat(buffer, stuff);
 			stuff = ptr;
 			*ptr = ch;
 			break;
@@ -283,28 +305,28 @@ char	*expand_alias	(const char *string, const char *args)
 	}
 
 	if (stuff)
-		malloc_strcat_ues(&buffer, stuff, empty_string);
+		strbuf_cat_ues(buffer, stuff, empty_string);
 
-	if (!buffer)
-		buffer = malloc_strdup(empty_string);
+	if (!buffer->str)
+		strbuf_cat(buffer, empty_string);
 
 	if (get_int_var(DEBUG_VAR) & DEBUG_EXPANSIONS)
-		privileged_yell("Expanded " BOLD_TOG_STR "[" BOLD_TOG_STR "%s" BOLD_TOG_STR "]" BOLD_TOG_STR " to " BOLD_TOG_STR "[" BOLD_TOG_STR "%s" BOLD_TOG_STR "]" BOLD_TOG_STR, string, buffer);
-
-	return buffer;
+		privileged_yell("Expanded " BOLD_TOG_STR "[" BOLD_TOG_STR "%s" BOLD_TOG_STR "]" BOLD_TOG_STR " to " BOLD_TOG_STR "[" BOLD_TOG_STR "%s" BOLD_TOG_STR "]" BOLD_TOG_STR, string, buffer->str);
 }
 
 /*
  * alias_special_char: Here we determine what to do with the character after
  * the $ in a line of text. The special characters are described more fully
  * in the help/ALIAS file.  But they are all handled here. Parameters are the
- * return char ** pointer to which things are placed,
+ * Strbuf onto which the expansion is appended,
  * a ptr to the string (the first character of which is the special
  * character), the args to the alias, and a character indication what
  * characters in the string should be quoted with a backslash.  It returns a
  * pointer to the character right after the converted alias.
+ *
+ * This uses the scratch arena, so your caller must have an arena mark.
  */
-static	char	*alias_special_char (char **buffer, char *ptr, const char *args, char *quote_em)
+static	char	*alias_special_char (Strbuf *buffer, char *ptr, const char *args, char *quote_em)
 {
 	char	*tmp,
 		c;
@@ -380,11 +402,13 @@ static	char	*alias_special_char (char **buffer, char *ptr, const char *args, cha
 		 */
 		case LEFT_PAREN:
 		{
-			char 	*sub_buffer = NULL,
-				*tmp2 = NULL, 
+			Strbuf	sub_buffer;
+			char 	*tmp2 = NULL, 
 				*tmpsav = NULL,
 				*ph = ptr + 1;
 
+			strbuf_init_temp(&sub_buffer);
+
 			if ((span = MatchingBracket(ph, '(', ')')) >= 0)
 				ptr = ph + span;
 			else if ((ptr = strchr(ph, ')')))
@@ -414,14 +438,14 @@ static	char	*alias_special_char (char **buffer, char *ptr, const char *args, cha
 				alias_special_char(&sub_buffer, tmp, args, quote_em);
 
 			/* Some kind of bogus expando */
-			if (sub_buffer == NULL)
-				sub_buffer = malloc_strdup(empty_string);
+			if (sub_buffer.str == NULL)
+				strbuf_cat(&sub_buffer, empty_string);
 
 			if (!(x_debug & DEBUG_SLASH_HACK))
-				TruncateAndEscape(buffer, sub_buffer, 
+				TruncateAndEscape(buffer, sub_buffer.str, 
 						length, quote_em);
 
-			new_free(&sub_buffer);
+			strbuf_free(&sub_buffer);
 			new_free(&tmpsav);
 			return (ptr);
 		}
@@ -518,14 +542,15 @@ static	char	*alias_special_char (char **buffer, char *ptr, const char *args, cha
 		case '@':
 		{
 			char 	c2 = 0;
-			char 	*sub_buffer = NULL;
+			Strbuf	sub_buffer;
 			char 	*rest, *val;
 			int	my_dummy;
 
+			strbuf_init_temp(&sub_buffer);
 			rest = after_expando(ptr + 1, 0, &my_dummy);
 			if (rest == ptr + 1)
 			{
-			    sub_buffer = malloc_strdup(args);
+			    strbuf_cat(&sub_buffer, args ? args : empty_string);
 			}
 			else
 			{
@@ -536,16 +561,16 @@ static	char	*alias_special_char (char **buffer, char *ptr, const char *args, cha
 			    *rest = c2;
 			}
 
-			if (!sub_buffer)
+			if (!sub_buffer.str)
 			    val = malloc_strdup(zero);
 			else if (c == '#')
-			    val = malloc_strdup(ltoa(count_words(sub_buffer, DWORD_EXTRACTW, "\"")));
+			    val = malloc_strdup(ltoa(count_words(sub_buffer.str, DWORD_EXTRACTW, "\"")));
 			else
-			    val = malloc_strdup(ltoa(strlen(sub_buffer)));
+			    val = malloc_strdup(ltoa(sub_buffer.len));
 
 			TruncateAndEscape(buffer, val, length, quote_em);
 			new_free(&val);
-			new_free(&sub_buffer);
+			strbuf_free(&sub_buffer);
 
 			if (c2)
 			    *rest = c2;
@@ -696,9 +721,8 @@ static	char	*alias_special_char (char **buffer, char *ptr, const char *args, cha
  * TruncateAndEscape: This handles string width formatting and \-escaping for irc 
  * variables when [] or ^x is specified.
  */
-static	void	TruncateAndEscape (char **buff, const char *add, ssize_t length, const char *quote_em)
+static	void	TruncateAndEscape (Strbuf *buff, const char *add, ssize_t length, const char *quote_em)
 {
-	char *	buffer;
 	char *	free_me = NULL;
 	int	justify;
 	int	pad;
@@ -725,17 +749,14 @@ static	void	TruncateAndEscape (char **buff, const char *add, ssize_t length, con
 		pad = get_int_var(PAD_CHAR_VAR);
 		add = free_me = fix_string_width(add, justify, pad, length, 1);
 	}
-	if (quote_em && add)	/* add shouldnt ever be NULL, though! */
+	if (buff)
 	{
-		/* Don't pass retval from "alloca" as func arg, use local. */
-		size_t	bufsiz = strlen(add) * 2 + 2;
-		buffer = alloca(bufsiz);
-		escape_chars(add, quote_em, buffer, bufsiz);
-		add = buffer;
+		/* Escape directly onto the end of the buffer */
+		if (quote_em)
+			strbuf_cat_escaped(buff, add, quote_em);
+		else
+			strbuf_cat(buff, add);
 	}
-
-	if (buff)
-		malloc_strcat(buff, add);
 	if (free_me)
 		new_free(&free_me);
 	return;
@@ -229,7 +229,7 @@ typedef struct
 /* Forward function references */
 	static	TOKEN	tokenize_raw (expr_info *c, const char *t);
 	static	char *	after_expando_special (expr_info *c);
-	static	char *	alias_special_char (char **buffer, char *ptr, 
+	static	char *	alias_special_char (Strbuf *buffer, char *ptr, 
 					const char *args, char *quote_em);
 	static	const char *	get_token_expanded (expr_info *c, TOKEN v);
 	static void 	math_error (expr_info *c, const char *format, ...);
@@ -584,6 +584,34 @@ static	TOKEN		tokenize_bool (expr_info *c, BooL t)
  * the most information, starting with expanded string, to the boolean
  * value. 
  */ 
+/*
+ * A "simple" lvalue is a variable name that doesn't need to be expanded
+ * (no $'s, no [...]'s, no function calls), like "i" or "::foo.bar".
+ * Its raw value is itself, and its value can be looked up directly.
+ */
+static	int	is_simple_lval (const char *s)
+{
+	if (*s == ':')
+		s++;
+	if (*s == ':')
+		s++;
+	if (!(isalpha((unsigned char)*s) || *s == '_'))
+		return 0;
+	for (s++; *s; s++)
+		if (!(isalnum((unsigned char)*s) || *s == '_' || *s == '.'))
+			return 0;
+	return 1;
+}
+
+static	int	is_simple_variable (expr_info *c, TOKEN v)
+{
+	if (c->noeval || v <= 0)
+		return 0;
+	if ((TOK(c, v).used & (USED_LVAL | USED_EXPANDED)) != USED_LVAL)
+		return 0;
+	return is_simple_lval(TOK(c, v).lval);
+}
+
 static	const char *	get_token_raw (expr_info *c, TOKEN v)
 {
 	if (v == MAGIC_TOKEN)	/* Magic token */
@@ -626,7 +654,10 @@ static	const char *	get_token_raw (expr_info *c, TOKEN v)
 			debug(DEBUG_NEW_MATH_DEBUG, ">>> Expanding var name [%d]: [%s]", 
 					v, TOK(c, v).lval);
 
-			TOK(c, v).raw_value = expand_alias(TOK(c, v).lval, 
+			if (is_simple_lval(TOK(c, v).lval))
+				TOK(c, v).raw_value = malloc_strdup(TOK(c, v).lval);
+			else
+				TOK(c, v).raw_value = expand_alias(TOK(c, v).lval, 
 								c->args);
 
 			debug(DEBUG_NEW_MATH_DEBUG, ">>> Expanded var name [%d]: [%s] to [%s]",
@@ -710,15 +741,17 @@ static	const char *	get_token_expanded (expr_info *c, TOKEN v)
 		 */
 		if (TOK(c, v).used & USED_LVAL)
 		{
-			char *buffer = NULL;
+			ArenaMark	mark;
+			Strbuf		buffer;
 
 			debug(DEBUG_NEW_MATH_DEBUG, ">>> Looking up variable [%d]: [%s]", 
 					v, myval);
 
+			arena_mark(&mark);
+			strbuf_init_temp(&buffer);
 			alias_special_char(&buffer, myval, c->args, NULL);
-			if (!buffer)
-				buffer = malloc_strdup(empty_string);
-			TOK(c, v).expanded_value = buffer;
+			TOK(c, v).expanded_value = malloc_strdup(buffer.str);
+			arena_release(&mark);
 
 			debug(DEBUG_NEW_MATH_DEBUG, "<<< Expanded variable [%d] [%s] to: [%s]",
 					v, myval, TOK(c, v).expanded_value);
@@ -792,8 +825,18 @@ static	intmax_t	get_token_integer (expr_info *c, TOKEN v)
 	
 	if ((TOK(c, v).used & USED_INTEGER) == 0)
 	{
-		const char *	myval = get_token_expanded(c, v);
+		const char *	myval;
+
+		/* Plain variables remember their own numeric value */
+		if (is_simple_variable(c, v) && 
+		    get_variable_integer(get_token_raw(c, v), 
+						&TOK(c, v).integer_value))
+		{
+			TOK(c, v).used |= USED_INTEGER;
+			return TOK(c, v).integer_value;
+		}
 
+		myval = get_token_expanded(c, v);
 		TOK(c, v).used |= USED_INTEGER;
 		TOK(c, v).integer_value = STR2INT(myval);
 	}
@@ -816,8 +859,17 @@ static	long double	get_token_float (expr_info *c, TOKEN v)
 	
 	if ((TOK(c, v).used & USED_FLOAT) == 0)
 	{
-		const char *	myval = get_token_expanded(c, v);
+		const char *	myval;
 
+		if (is_simple_variable(c, v) && 
+		    get_variable_float(get_token_raw(c, v), 
+						&TOK(c, v).float_value))
+		{
+			TOK(c, v).used |= USED_FLOAT;
+			return TOK(c, v).float_value;
+		}
+
+		myval = get_token_expanded(c, v);
 		TOK(c, v).used |= USED_FLOAT;
 		TOK(c, v).float_value = atolf(myval);
 	}
@@ -1124,7 +1176,7 @@ static void	reduce (expr_info *cx, int what)
 									\
 		w = tokenize_integer(cx, (intop));			\
 		t = get_token_expanded(cx, w);				\
-		add_var_alias(s, t, 0);					\
+		add_var_alias_integer(s, t, get_token_integer(cx, w));	\
 		push_token(cx, w);					\
 		break; 							\
 	}
@@ -1253,7 +1305,7 @@ static void	reduce (expr_info *cx, int what)
 									\
 		w = tokenize_integer(cx, (intop_assign));		\
 		t = get_token_expanded(cx, w);				\
-		add_var_alias(s, t, 0);					\
+		add_var_alias_integer(s, t, get_token_integer(cx, w));	\
 									\
 		push_integer(cx, (intop_result));			\
 		break; 							\
@@ -404,7 +404,7 @@ char *	file_read (int fd)
 		/* Do we need to truncate the result? */
 		if (end)
                     *end = 0;	/* Either the newline */
-		else if ( (ptr->elf->fp) && (ferror(ptr->elf->fp)) )
+		else if (epic_ferror(ptr->elf))
                     *ret = 0;	/* Or the whole thing on error */
 
 		/* XXX TODO -- this is just temporary */
@@ -434,7 +434,7 @@ char *	file_readb (int fd, size_t bytes_requested)
 		return malloc_strdup(empty_string);
 
 	buffer = new_malloc(bytes_requested + 1);
-	memset(&buffer, 0, bytes_requested + 1);
+	memset(buffer, 0, bytes_requested + 1);
 
 	if (ptr->elf->fp) {
 		clearerr(ptr->elf->fp);
@@ -447,6 +447,10 @@ char *	file_readb (int fd, size_t bytes_requested)
 		else
 			bytes_read = 0;
 #endif
+	} else if (ptr->elf->dc) {
+		ssize_t	got = epic_fread(ptr->elf, buffer, bytes_requested);
+
+		bytes_read = got > 0 ? (size_t)got : 0;
 	} else {
 		bytes_read = 0;
 	}
@@ -485,7 +489,7 @@ int	file_error (int fd)
 	if (!ptr)
 		return -1;
 	else
-		return ferror(ptr->elf->fp);
+		return epic_ferror(ptr->elf);
 }
 
 int	file_rewind (int fd)
@@ -495,8 +499,7 @@ int	file_rewind (int fd)
 	if (!(ptr = lookup_file(fd)))
 		return -1;
 
-	fseek(ptr->elf->fp, 0L, SEEK_SET);
-	return 0;
+	return epic_frewind(ptr->elf);
 }
 
 /* LONG should support 64 bit */
@@ -507,11 +510,11 @@ int	file_seek (int fd, off_t offset, const char *whence)
 		return -1;
 
 	if (!my_stricmp(whence, "SET"))
-		return fseeko(ptr->elf->fp, offset, SEEK_SET);
+		return epic_fseek(ptr->elf, offset, SEEK_SET);
 	else if (!my_stricmp(whence, "CUR"))
-		return fseeko(ptr->elf->fp, offset, SEEK_CUR);
+		return epic_fseek(ptr->elf, offset, SEEK_CUR);
 	else if (!my_stricmp(whence, "END"))
-		return fseeko(ptr->elf->fp, offset, SEEK_END);
+		return epic_fseek(ptr->elf, offset, SEEK_END);
 	else
 		return -1;
 }
@@ -522,8 +525,7 @@ intmax_t	file_tell (int fd)
 	if (!ptr)
 		return -1;
 	else
-		/* XXX Should call ftello(). */
-		return (intmax_t)ftell(ptr->elf->fp);
+		return (intmax_t)epic_ftell(ptr->elf);
 }
 
 int	file_skip (int fd, int num_lines)
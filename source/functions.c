@@ -82,6 +82,7 @@
 #include "ctcp.h"
 #include "cJSON.h"
 #include "scrambox.h"
+#include "profile.h"
 
 static	char	
 	*alias_sent_nick 	(void),
@@ -170,6 +171,7 @@ static	char
 	*function_tolower 	(char *),
 	*function_toupper 	(char *),
 	*function_userhost 	(char *),
+	*function_userinfo	(char *),
 	*function_word 		(char *),
 	*function_utime		(char *),
 	*function_strftime	(char *),
@@ -303,6 +305,7 @@ static	char
 	*function_longtoip	(char *),
 	*function_mask		(char *),
 	*function_maxlen	(char *),
+	*function_memctl	(char *),
 	*function_metric_time	(char *),
 	*function_midw 		(char *),
 	*function_mkdir		(char *),
@@ -611,6 +614,7 @@ static BuiltInFunctions	built_in_functions[] =
 	{ "MATCH",		function_match 		},
 	{ "MATCHITEM",          function_matchitem 	},
 	{ "MAXLEN",		function_maxlen		},
+	{ "MEMCTL",		function_memctl		},
 	{ "METRIC_TIME",	function_metric_time	},
 	{ "MID",		function_mid 		},
 	{ "MIDW",               function_midw 		},
@@ -736,6 +740,7 @@ static BuiltInFunctions	built_in_functions[] =
 	{ "UNSPLIT",		function_unsplit	},
 	{ "UNVEIL",		function_unveil		},
 	{ "USERHOST",		function_userhost 	},
+	{ "USERINFO",		function_userinfo	},
 	{ "USERMODE",		function_umode		},
 	{ "USETITEM",           function_usetitem 	},
 	{ "UTIME",		function_utime	 	},
@@ -791,6 +796,7 @@ char	*call_function (char *name, const char *args)
 	void *	arglist = NULL;
 	size_t	type;
 	char *	str = NULL;
+	ArenaMark	mark;
 
 	debugging = get_int_var(DEBUG_VAR);
 
@@ -825,13 +831,23 @@ char	*call_function (char *name, const char *args)
             return malloc_strdup(empty_string);
         }
 
-	tmp = expand_alias(lparen, args);
+	/* The expanded arguments only live as long as the call */
+	arena_mark(&mark);
+	tmp = expand_alias_temp(lparen, args);
 	debug_copy = LOCAL_COPY(tmp);
 
 	if (func && type != 1)
+	{
+		int	prof = PROFILE_ENTER(PROFILE_FUNCTION, str);
 		result = func(tmp);
+		PROFILE_LEAVE(prof);
+	}
 	else if (alias && type != 2)
+	{
+		int	prof = PROFILE_ENTER(PROFILE_ALIAS, str);
 		result = call_user_function(str, alias, tmp, arglist);
+		PROFILE_LEAVE(prof);
+	}
 
 	size = strlen(str) + strlen(debug_copy) + 15;
 	buf = (char *)alloca(size);
@@ -843,7 +859,7 @@ char	*call_function (char *name, const char *args)
 					str, debug_copy, result);
 
 	new_free(&str);
-	new_free(&tmp);
+	arena_release(&mark);
 	return result;
 }
 
@@ -1949,6 +1965,46 @@ static const char unknown_userhost[] = "<UNKNOWN>@<UNKNOWN>";
 	RETURN_MSTR(retval);
 }
 
+/*
+ * $userinfo(nick:dword field:dword) -> string
+ *
+ * Happy path:
+ *	What we know about <nick>, who is on one of your channels on the
+ *	current server.  <field> is one of
+ *		ACCOUNT		The services account they're logged into
+ *				(from an extended-join JOIN)
+ *		AWAY		1 if they're away, 0 if they're not (from a 
+ *				WHO reply or an away-notify AWAY)
+ *
+ * Specified errors (return the empty string)
+ *	- If <nick> or <field> is missing, or <field> is something else
+ *	- If we don't know (they aren't on your channels, or the server
+ *	  hasn't told us)
+ */
+BUILT_IN_FUNCTION(function_userinfo, input)
+{
+	char *		nick;
+	char *		field;
+	const char *	account;
+	int		away;
+
+	GET_FUNC_ARG(nick, input);
+	GET_FUNC_ARG(field, input);
+
+	if (!my_stricmp(field, "ACCOUNT"))
+	{
+		if ((account = fetch_user_account(from_server, nick)))
+			RETURN_STR(account);
+	}
+	else if (!my_stricmp(field, "AWAY"))
+	{
+		if ((away = fetch_user_away(from_server, nick)) >= 0)
+			RETURN_INT(away);
+	}
+
+	RETURN_EMPTY;
+}
+
 /* 
  * $strip(characters:dword text:string) -> string
  *
@@ -7767,6 +7823,11 @@ BUILT_IN_FUNCTION(function_logctl, input)
 	return logctl(input);
 }
 
+BUILT_IN_FUNCTION(function_memctl, input)
+{
+	return memctl(input);
+}
+
 /*
  * Joins the word lists in two different variables together with an
  * optional seperator string.
@@ -39,6 +39,7 @@
 #define __need_ArgList_t__
 #include "alias.h"
 #include "output.h"
+#include "profile.h"
 #include "commands.h"
 #include "ifcmd.h"
 #include "stack.h"
@@ -95,6 +96,11 @@ typedef struct	hook_stru
 	int	userial;	/* Unique serial for this hook */
 	int	skip;		/* hook will be treated like it doesn't exist */
 	char *	filename;	/* Where it was loaded */
+
+	/* A hook added with add_native_hook() calls this instead of stuff */
+	NativeHook	native;
+	void *		native_data;
+	void		(*native_release) (void *);
 }	Hook;
 
 /* 
@@ -253,6 +259,8 @@ static	const char *		current_implied_on_hook = NULL;
 
 extern char *	    function_cparse	(char *);
 static void 	    hook_add_to_list 	(Hook **list, Hook *item);
+static void	    hook_release_native	(Hook *item);
+static int	    hook_noise_prefix	(char **func);
 static Hook *	    hook_remove_from_list 	(Hook **list, char *item, int sernum);
 
 static void	initialize_hook_functions (void)
@@ -465,6 +473,8 @@ static int	add_hook (int which, char *nick, ArgList *arglist, char *stuff, int n
 		if ((new_h->userial = next_empty_hookslot()) == hooklist_size)
 			inc_hooklist(3);
 	}
+	else
+		hook_release_native(new_h);
 
 	new_h->type = which;
 	malloc_strcpy(&new_h->nick, nick);
@@ -491,6 +501,65 @@ static int	add_hook (int which, char *nick, ArgList *arglist, char *stuff, int n
 
 
 
+/*
+ * add_native_hook: Like /ON, but instead of running ircII code, the hook
+ * calls 'native' (passing 'data') with the event's arguments already split
+ * up.  This is how python's _epic.on() works.  'type' is like /ON's, 
+ * including the noise character (ie, "^MSG").  'description' is what /ON 
+ * shows for the hook.  'release' is called with 'data' when the hook goes 
+ * away.  Returns the hook's refnum, or -1 if 'type' is no good.
+ */
+int	add_native_hook (const char *type, int sernum, const char *nick, const char *description, NativeHook native, void *data, void (*release) (void *))
+{
+	char *	func;
+	int	noisy, which, userial;
+	Hook *	item;
+
+	if (!hook_functions_initialized)
+		initialize_hook_functions();
+
+	func = LOCAL_COPY(type);
+	noisy = hook_noise_prefix(&func);
+	if ((which = find_hook(func, NULL, 1)) == INVALID_HOOKNUM)
+		return -1;
+
+	userial = add_hook(which, LOCAL_COPY(nick), NULL, 
+				LOCAL_COPY(description), noisy, 0, sernum, 0);
+	item = hooklist[userial];
+	item->native = native;
+	item->native_data = data;
+	item->native_release = release;
+	return userial;
+}
+
+static void	hook_release_native (Hook *item)
+{
+	if (item->native_release && item->native_data)
+		item->native_release(item->native_data);
+	item->native = NULL;
+	item->native_data = NULL;
+	item->native_release = NULL;
+}
+
+/*
+ * Skip over the noise character at the start of an /ON type (if there is
+ * one), and return the noise level.
+ */
+static int	hook_noise_prefix (char **func)
+{
+	int	v;
+
+	for (v = 0; v < noise_level_num; v++)
+	{
+		if (noise_info[v]->identifier != 0 &&
+			noise_info[v]->identifier == **func)
+		{
+			(*func)++;
+			return noise_info[v]->value;
+		}
+	}
+	return default_noise;
+}
 
 /* * * * * * REMOVING A HOOK * * * * * * * */
 static void remove_hook (int which, char *nick, int sernum, int quiet)
@@ -515,6 +584,7 @@ static void remove_hook (int which, char *nick, int sernum, int quiet)
 			new_free(&(tmp->filename));
 			if (tmp->arglist != NULL)
 			    destroy_arglist(&(tmp->arglist));
+			hook_release_native(tmp);
 					
 	
 			hooklist[tmp->userial] = NULL;
@@ -556,6 +626,7 @@ static void remove_hook (int which, char *nick, int sernum, int quiet)
 		new_free(&(tmp->filename));
 		if (tmp->arglist != NULL)
 			destroy_arglist(&(tmp->arglist));
+		hook_release_native(tmp);
 		tmp->next = NULL;
 		
 		new_free((char **)&tmp);
@@ -798,6 +869,10 @@ static int 	do_hook_internal (int which, char **result, const char *format, va_l
 		char *buffer_copy;
 		int bestmatch = 0;
 		int currmatch;
+		int prof;
+		int userial;
+		NativeHook native;
+		void *native_data;
 
 		if (tmp->sernum < serial_number)
 		    continue;
@@ -848,8 +923,10 @@ static int 	do_hook_internal (int which, char **result, const char *format, va_l
 		stuff_copy = LOCAL_COPY(tmp->stuff);
 		quote = tmp->flexible ? '\'' : '"';
 
-		hook->userial = tmp->userial;
+		hook->userial = userial = tmp->userial;
 		tmp_arglist = clone_arglist(tmp->arglist);
+		native = tmp->native;
+		native_data = tmp->native_data;
 
 		/*
 		 * YOU CAN'T TOUCH ``tmp'' AFTER THIS POINT!!!
@@ -883,8 +960,44 @@ static int 	do_hook_internal (int which, char **result, const char *format, va_l
 		old = system_exception;
 
 		buffer_copy = LOCAL_COPY(hook->buffer);
+		prof = PROFILE_ENTER(PROFILE_HOOK, name);
+
+		/*
+		 * A native hook gets $0, $1, ... already split up, one for
+		 * each of the event's parameters, and nothing gets parsed.
+		 * (The alert above could have run an /ON that removed it.)
+		 */
+		if (native && hooklist[userial] && 
+				hooklist[userial]->native_data == native_data)
+		{
+			char **	argv;
+			char *	rest = buffer_copy;
+			int	argc;
+
+			argv = alloca(h->params * sizeof(char *));
+			for (argc = 0; argc < h->params - 1; argc++)
+				if (!(argv[argc] = next_arg(rest, &rest)))
+					argv[argc] = LOCAL_COPY(empty_string);
+			argv[argc++] = rest ? rest : LOCAL_COPY(empty_string);
 
-		if (hook->retval == RESULT_PENDING)
+			if (native(native_data, name, argc, argv))
+			{
+				if (hook->retval == RESULT_PENDING)
+					hook->retval = SUPPRESS_DEFAULT;
+			}
+			else if (hook->retval == RESULT_PENDING)
+				hook->retval = DONT_SUPPRESS_DEFAULT;
+			if (tmp_arglist)
+				destroy_arglist(&tmp_arglist);
+		}
+		else if (native)
+		{
+			if (hook->retval == RESULT_PENDING)
+				hook->retval = DONT_SUPPRESS_DEFAULT;
+			if (tmp_arglist)
+				destroy_arglist(&tmp_arglist);
+		}
+		else if (hook->retval == RESULT_PENDING)
 		{
 			char *xresult;
 
@@ -913,6 +1026,7 @@ static int 	do_hook_internal (int which, char **result, const char *format, va_l
 			if (tmp_arglist)
 				destroy_arglist(&tmp_arglist);
 		}
+		PROFILE_LEAVE(prof);
 
 		/*
 		 * Clean up the stuff that may have been mangled by the
@@ -1102,7 +1216,6 @@ BUILT_IN_COMMAND(oncmd)
 	 */
 	if ((func = next_arg(args, &args)) != NULL)
 	{
-		int v;
 		/*
 		 * Check to see if this has a serial number.
 		 */
@@ -1120,19 +1233,7 @@ BUILT_IN_COMMAND(oncmd)
 		/*
 		 * Get the verbosity level, if any.
 		 */
-		noisy = default_noise;
-
-		for (v = 0; v < noise_level_num; v++)
-		{
-			if (noise_info[v]->identifier != 0 &&
-				noise_info[v]->identifier == *func)
-				break;
-		}
-		if (v != noise_level_num)
-		{
-			noisy = noise_info[v]->value;
-			func++;
-		}
+		noisy = hook_noise_prefix(&func);
 		
 		/*
 		 * Check to see if the event type is valid
@@ -2305,6 +2406,7 @@ char *hookctl (char *input)
 					RETURN_STR(hook->stuff);
 				new_free (&(hook->stuff));
 				hook->stuff = malloc_strdup(str);
+				hook_release_native(hook);
 				RETURN_INT(1);
 				break;
 			
@@ -297,8 +297,8 @@ BUILT_IN_COMMAND(whilecmd)
 {
 	char	*exp = NULL,
 		*ptr,
-		*body = NULL,
 		*newexp = NULL;
+	Block	*body = NULL;
 	int 	whileval = !strcmp(command, "WHILE");
 	size_t	sigh;
 
@@ -324,7 +324,7 @@ BUILT_IN_COMMAND(whilecmd)
 		}
 	}
 
-	body = LOCAL_COPY(ptr);
+	body = compile_block(ptr);
 
 	will_catch_break_exceptions++;
 	will_catch_continue_exceptions++;
@@ -338,14 +338,14 @@ BUILT_IN_COMMAND(whilecmd)
 		 * parse_inline() will mangle our string
 		 * The use of strlen(exp)+1 is intentional.
 		 */
-		strlcpy(newexp, exp, sigh);
+		memcpy(newexp, exp, sigh);
 		ptr = parse_inline(newexp, subargs);
 		if (check_val(ptr) != whileval)
 			break;
 
 		new_free(&ptr);
 
-		runcmds(body, subargs);
+		run_block(body, subargs);
 		if (continue_exception)
 		{
 			continue_exception = 0;
@@ -364,6 +364,7 @@ BUILT_IN_COMMAND(whilecmd)
 	will_catch_break_exceptions--;
 	will_catch_continue_exceptions--;
 	new_free(&ptr);
+	destroy_block(&body);
 }
 
 BUILT_IN_COMMAND(foreach)
@@ -372,6 +373,7 @@ BUILT_IN_COMMAND(foreach)
 		*ptr,
 		*body = NULL,
 		*var = NULL;
+	Block	*block;
 	char	**sublist;
 	int	total;
 	int	i;
@@ -424,15 +426,18 @@ BUILT_IN_COMMAND(foreach)
 	}
 
 	slen = strlen(struc);
+	var = local_alias_name(var);
+	block = compile_block(body);
 
 	will_catch_break_exceptions++;
 	will_catch_continue_exceptions++;
 	for (i = 0; i < total; i++)
 	{
-		add_local_alias(var, sublist[i] + slen + 1, 0);
+		if (var)
+			set_local_alias(var, sublist[i] + slen + 1, 0);
 		new_free(&sublist[i]);
 
-		runcmds(body, subargs);
+		run_block(block, subargs);
 	
 		if (continue_exception)
 		{
@@ -456,6 +461,8 @@ BUILT_IN_COMMAND(foreach)
 
 	new_free((char **)&sublist);
 	new_free(&struc);
+	new_free(&var);
+	destroy_block(&block);
 }
 
 /*
@@ -476,7 +483,8 @@ BUILT_IN_COMMAND(fe)
 	int		doing_fe;
 	char		*mapvar = NULL;
 	const char	*mapsep;
-	char		*map = NULL;
+	Strbuf		map;
+	Block		*block;
 
 	var = alloca(sizeof(char *) * MAX_FE_VARS);
 	memset(var, 0, sizeof(char *) * MAX_FE_VARS);
@@ -581,6 +589,15 @@ BUILT_IN_COMMAND(fe)
 		return;
 	}
 
+	/*
+	 * Check the variable names and chop up the block just once,
+	 * rather than every time through the loop.
+	 */
+	for (y = 0; y < ind; y++)
+		var[y] = local_alias_name(var[y]);
+	block = compile_block(todo);
+	strbuf_init(&map);
+
 	placeholder = templist;
 
 	will_catch_break_exceptions++;
@@ -595,7 +612,8 @@ BUILT_IN_COMMAND(fe)
 
 				if (!(word = next_func_arg(templist, &templist)))
 					word = endstr(templist);
-				add_local_alias(var[y], word, 0);
+				if (var[y])
+					set_local_alias(var[y], word, 0);
 			}
 			else
 			{
@@ -611,17 +629,22 @@ BUILT_IN_COMMAND(fe)
 				templist += offset;
 				utf8buffer = alloca(16);
 				ucs_to_utf8(codepoint, utf8buffer, 16);
-				add_local_alias(var[y], utf8buffer, 0);
+				if (var[y])
+					set_local_alias(var[y], utf8buffer, 0);
 			}
 		}
-		runcmds(todo, subargs);
+		run_block(block, subargs);
 
 		if (mapvar)
 		{
 			for (y = 0; y < ind; y++) 
 			{
-				char *	foo = get_variable(var[y]);
-				malloc_strcat_wordlist(&map, mapsep, foo);
+				char *	foo;
+
+				if (!var[y])
+					continue;
+				foo = get_variable(var[y]);
+				strbuf_cat_wordlist(&map, mapsep, foo);
 				new_free(&foo);
 			}
 		}
@@ -644,9 +667,12 @@ BUILT_IN_COMMAND(fe)
 	will_catch_break_exceptions--;
 	will_catch_continue_exceptions--;
 
-	add_var_alias(mapvar, map, 0);
-	new_free(&map);
+	add_var_alias(mapvar, map.str, 0);
+	strbuf_free(&map);
 
+	for (y = 0; y < ind; y++)
+		new_free(&var[y]);
+	destroy_block(&block);
 	new_free(&placeholder);
 }
 
@@ -656,6 +682,7 @@ static void	for_next_cmd (int argc, char **argv, const char *subargs)
 	char 	*var, *cmds;
 	char *	istr;
 	int	start, end, step = 1, i;
+	Block *	block;
 
 	if (!subargs)
 		subargs = empty_string;
@@ -684,14 +711,17 @@ static void	for_next_cmd (int argc, char **argv, const char *subargs)
 
 	if (*cmds == '{')
 		cmds++;
+	var = local_alias_name(var);
+	block = compile_block(cmds);
 	will_catch_break_exceptions++;
 	will_catch_continue_exceptions++;
 	istr = alloca(256);
 	for (i = start; step > 0 ? i <= end : i >= end; i += step)
 	{
 		snprintf(istr, 255, "%d", i);
-		add_local_alias(var, istr, 0);
-		runcmds(cmds, subargs);
+		if (var)
+			set_local_alias(var, istr, 0);
+		run_block(block, subargs);
 
 		if (break_exception)
 		{
@@ -707,12 +737,15 @@ static void	for_next_cmd (int argc, char **argv, const char *subargs)
 	}
 	will_catch_break_exceptions--;
 	will_catch_continue_exceptions--;
+	new_free(&var);
+	destroy_block(&block);
 }
 
 static void	for_fe_cmd (int argc, char **argv, const char *subargs)
 {
 	char 	*var, *list, *cmds;
 	char	*next, *real_list, *x;
+	Block *	block;
 
 	if (!subargs)
 		subargs = empty_string;
@@ -731,13 +764,16 @@ static void	for_fe_cmd (int argc, char **argv, const char *subargs)
 	if (*list == '(')
 		list++;
 	x = real_list = expand_alias(list, subargs);
+	var = local_alias_name(var);
+	block = compile_block(cmds);
 	will_catch_break_exceptions++;
 	will_catch_continue_exceptions++;
 	while (real_list && *real_list)
 	{
 		next = next_func_arg(real_list, &real_list);
-		add_local_alias(var, next, 0);
-		runcmds(cmds, subargs);
+		if (var)
+			set_local_alias(var, next, 0);
+		run_block(block, subargs);
 
 		if (break_exception) {
 			break_exception = 0;
@@ -753,6 +789,8 @@ static void	for_fe_cmd (int argc, char **argv, const char *subargs)
 	will_catch_break_exceptions--;
 	will_catch_continue_exceptions--;
 	new_free(&x);
+	new_free(&var);
+	destroy_block(&block);
 }
 
 static void	for_pattern_cmd (int __U(argc), char **__U(argv), const char *__U(subargs))
@@ -807,7 +845,8 @@ BUILT_IN_COMMAND(forcmd)
 	char *	eval_copy   = NULL;
 	char *	iteration  = NULL;
 	char *	blah       = NULL;
-	char *	commands   = NULL;
+	Block *	commands   = NULL;
+	Block *	iterate    = NULL;
 	size_t	sigh;
 
 	if (!subargs)
@@ -851,7 +890,8 @@ BUILT_IN_COMMAND(forcmd)
 		my_error("FOR: badly formed commands");
 		return;
 	}
-	commands = LOCAL_COPY(working);
+	commands = compile_block(working);
+	iterate = compile_block(iteration);
 
 	runcmds(commence, subargs);
 
@@ -866,7 +906,7 @@ BUILT_IN_COMMAND(forcmd)
 		 * "eval_copy" gets mangled every time through, so we need
 		 * to take a fresh copy from scratch each time.
 		 */
-		strlcpy(eval_copy, evaluation, sigh);
+		memcpy(eval_copy, evaluation, sigh);
 		blah = parse_inline(eval_copy, subargs);
 		if (!check_val(blah))
 		{
@@ -875,7 +915,7 @@ BUILT_IN_COMMAND(forcmd)
 		}
 
 		new_free(&blah);
-		runcmds(commands, subargs);
+		run_block(commands, subargs);
 		if (break_exception)
 		{
 			break_exception = 0;
@@ -888,12 +928,14 @@ BUILT_IN_COMMAND(forcmd)
 		if (system_exception)
 			break;
 
-		runcmds(iteration, subargs);
+		run_block(iterate, subargs);
 	}
 	will_catch_break_exceptions--;
 	will_catch_continue_exceptions--;
 
 	new_free(&blah);
+	destroy_block(&commands);
+	destroy_block(&iterate);
 }
 
 /*
@@ -941,6 +941,9 @@ static	int		level = 0,
 		 */
 		check_context_queue(1);
 		level = 0;
+
+		/* Any arena marks were longjmp()ed over */
+		arena_reset();
 	}
 
 	level++;
@@ -48,6 +48,7 @@
 #include "list.h"
 #include "elf.h"
 #include "cJSON.h"
+#include "functions.h"
 
 /*
  * This is the basic overhead for every malloc allocation (16 bytes).
@@ -60,6 +61,7 @@
  * be 16-byte aligned, result in undefined behavior (oops)
  *
  * So the canary is now offically 16 bytes to avoid that.
+ * (With --with-malloc-profile, it's 32 bytes, to hold the call site)
  */
 typedef union _mo_money 
 {
@@ -68,8 +70,15 @@ typedef union _mo_money
 		uint32_t	magic;
 		int32_t		size;
 		uint32_t	canary2;
+#ifdef MALLOC_PROFILE
+		int32_t		site;
+#endif
 	};
+#ifdef MALLOC_PROFILE
+	char padding[32];
+#else
 	char padding[16];
+#endif
 } MO;
 
 #define mo_ptr(ptr) 	((MO *)( (char *)(ptr) - sizeof(MO) ))
@@ -78,6 +87,7 @@ typedef union _mo_money
 #define alloc_size(ptr) ((mo_ptr(ptr))->size)
 #define canary2(ptr)	((mo_ptr(ptr))->canary2)
 #define end_ptr(ptr) 	((char *)(ptr) + alloc_size(ptr))
+#define alloc_site(ptr)	((mo_ptr(ptr))->site)
 
 #define FREED_VAL 	-3
 #define ALLOC_CANARY1	(uint32_t)0x6f7a818d
@@ -264,6 +274,192 @@ static	int	recursion = 0;
 	}
 }
 
+#ifdef FAST_MALLOC
+/*
+ * The fast new_malloc() (configure --with-fast-malloc, for release builds)
+ *
+ * Small allocations come from slabs of same-sized chunks, one slab list 
+ * for each size class, instead of from malloc(3).  When they're new_free()d
+ * they go onto a free list for their size class and get reused.  Slabs are
+ * never given back.  The client only calls new_malloc() from the main 
+ * thread, so there is one set of slabs and no locking.
+ *
+ * Every allocation still has its MO header (RESIZE and MUST_BE_MALLOCED 
+ * need it).  new_free() always checks the magic number and whether it was
+ * already freed, but only checks the canaries one time in 
+ * FAST_MALLOC_CHECK_EVERY.  The memory is still zeroed when it's allocated
+ * (everybody counts on that) but not again when it's freed, and there are
+ * no valgrind mempools.
+ */
+#define SLAB_SIZE		65536
+#define SLAB_MAX		512	/* Biggest chunk, including the MO */
+#define FAST_MALLOC_CHECK_EVERY	64
+
+static	const size_t	slab_class_size[] = { 
+	32, 48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 512 
+};
+#define SLAB_CLASSES	(int)(sizeof(slab_class_size) / sizeof(slab_class_size[0]))
+
+static	char *		slab_free_list[SLAB_CLASSES];	/* Freed chunks */
+static	char *		slab_next[SLAB_CLASSES];	/* Unused part of a slab */
+static	char *		slab_end[SLAB_CLASSES];
+static	signed char	slab_class_of[SLAB_MAX / 16 + 1];
+static	unsigned	malloc_checks = 0;
+
+/* The next free chunk is kept where the caller's data was */
+#define slab_link(chunk)	(*(char **)((chunk) + sizeof(MO)))
+
+/* Which size class 'total' bytes (including the MO) go in, or -1 */
+static int	slab_class (size_t total)
+{
+	int	cls, i;
+
+	if (total > SLAB_MAX)
+		return -1;
+
+	if (slab_class_of[0] == 0)
+	{
+		for (i = cls = 0; i <= SLAB_MAX / 16; i++)
+		{
+			while ((size_t)i * 16 > slab_class_size[cls])
+				cls++;
+			slab_class_of[i] = cls;
+		}
+		slab_class_of[0] = -1;		/* Means "initialized" */
+	}
+	if (total == 0)
+		return 0;
+	return slab_class_of[(total + 15) / 16];
+}
+
+static char *	slab_alloc (int cls)
+{
+	char *	chunk;
+
+	if ((chunk = slab_free_list[cls]))
+	{
+		slab_free_list[cls] = slab_link(chunk);
+		return chunk;
+	}
+
+	if (!slab_next[cls] || 
+		(size_t)(slab_end[cls] - slab_next[cls]) < slab_class_size[cls])
+	{
+		if (!(slab_next[cls] = (char *)malloc(SLAB_SIZE)))
+			return NULL;
+		slab_end[cls] = slab_next[cls] + SLAB_SIZE;
+	}
+
+	chunk = slab_next[cls];
+	slab_next[cls] += slab_class_size[cls];
+	return chunk;
+}
+
+static void	slab_free (char *chunk, int cls)
+{
+	slab_link(chunk) = slab_free_list[cls];
+	slab_free_list[cls] = chunk;
+}
+#endif
+
+#ifdef MALLOC_PROFILE
+/*
+ * The malloc profile (configure --with-malloc-profile)
+ *
+ * Every new_malloc() already knows the file and line it was called from.
+ * The profile keeps a count for each of those places ("sites") of how 
+ * many bytes and objects it has that haven't been freed yet, and how many 
+ * times it has been called.  Each allocation remembers its site in its MO,
+ * so new_free() can give the bytes back to the place that took them, no
+ * matter who frees it.  You look at it with $memctl().
+ *
+ * The site table is malloc(3)ed, because it obviously can't new_malloc().
+ */
+typedef struct MallocSiteStru
+{
+	const char *	fn;
+	int		line;
+	int		next;		/* The next site in this bucket, or -1 */
+	intmax_t	bytes;		/* Bytes that haven't been freed */
+	intmax_t	objects;	/* Allocations that haven't been freed */
+	intmax_t	allocs;		/* Allocations ever */
+} MallocSite;
+
+#define MALLOC_SITE_BUCKETS	1024
+
+static	MallocSite *	malloc_sites = NULL;
+static	int		malloc_sites_used = 0;
+static	int		malloc_sites_max = 0;
+static	int		malloc_site_bucket[MALLOC_SITE_BUCKETS];  /* site + 1 */
+
+static int	malloc_site (const char *fn, int line)
+{
+	int	bucket;
+	int	i;
+
+	bucket = (unsigned)line % MALLOC_SITE_BUCKETS;
+	for (i = malloc_site_bucket[bucket] - 1; i >= 0; i = malloc_sites[i].next)
+		if (malloc_sites[i].line == line && 
+		    (malloc_sites[i].fn == fn || !strcmp(malloc_sites[i].fn, fn)))
+			return i;
+
+	if (malloc_sites_used == malloc_sites_max)
+	{
+		malloc_sites_max = malloc_sites_max ? malloc_sites_max * 2 : 256;
+		malloc_sites = (MallocSite *)realloc(malloc_sites, 
+				malloc_sites_max * sizeof(MallocSite));
+		if (!malloc_sites)
+			panic(1, "Could not grow the malloc profile to %d sites",
+					malloc_sites_max);
+	}
+
+	i = malloc_sites_used++;
+	malloc_sites[i].fn = fn;
+	malloc_sites[i].line = line;
+	malloc_sites[i].bytes = 0;
+	malloc_sites[i].objects = 0;
+	malloc_sites[i].allocs = 0;
+	malloc_sites[i].next = malloc_site_bucket[bucket] - 1;
+	malloc_site_bucket[bucket] = i + 1;
+	return i;
+}
+
+static void	malloc_profile_alloc (void *ptr, const char *fn, int line)
+{
+	int	site;
+
+	site = malloc_site(fn, line);
+	alloc_site(ptr) = site;
+	malloc_sites[site].bytes += alloc_size(ptr);
+	malloc_sites[site].objects++;
+	malloc_sites[site].allocs++;
+}
+
+static void	malloc_profile_free (void *ptr)
+{
+	int	site;
+
+	site = alloc_site(ptr);
+	if (site < 0 || site >= malloc_sites_used)
+		return;
+	malloc_sites[site].bytes -= alloc_size(ptr);
+	malloc_sites[site].objects--;
+}
+
+/* Biggest first; a tie goes to the one that has been called more */
+static int	malloc_site_cmp (const void *p1, const void *p2)
+{
+	const MallocSite *s1 = &malloc_sites[*(const int *)p1];
+	const MallocSite *s2 = &malloc_sites[*(const int *)p2];
+
+	if (s1->bytes != s2->bytes)
+		return s1->bytes < s2->bytes ? 1 : -1;
+	if (s1->allocs != s2->allocs)
+		return s1->allocs < s2->allocs ? 1 : -1;
+	return 0;
+}
+#endif
+
 /*
  * really_new_malloc - Our memory-defending wrapper for malloc(3) 
  *			DON'T CALL DIRECTLY - use new_malloc()
@@ -288,6 +484,9 @@ static	int	recursion = 0;
 void *	really_new_malloc (size_t size, const char *fn, int line)
 {
 	char	*ptr;
+#ifdef FAST_MALLOC
+	int	cls;
+#endif
 
 	/* 
 	 * Because we use -fwrapv, any math operation that results in a 
@@ -298,11 +497,24 @@ void *	really_new_malloc (size_t size, const char *fn, int line)
 		panic(1, "Malloc(%jd) request is too large from [%s/%d], giving up!",
 				(intmax_t)size, fn, line);
 				
+#ifdef FAST_MALLOC
+	if ((cls = slab_class(size + sizeof(MO))) >= 0)
+		ptr = slab_alloc(cls);
+	else
+		ptr = (char *)malloc(size + sizeof(MO));
+	if (!ptr)
+		panic(1, "Malloc(%jd) failed from [%s/%d], giving up!", 
+				(intmax_t)size, fn, line);
+
+	/* The header is filled in below */
+	memset(ptr + sizeof(MO), 0, size);
+#else
 	if (!(ptr = malloc(size + sizeof(MO))))
 		panic(1, "Malloc(%jd) failed from [%s/%d], giving up!", 
 				(intmax_t)size, fn, line);
 
 	memset(ptr, 0, size + sizeof(MO));
+#endif
 
 	/* Store the size of the allocation in the buffer. */
 	ptr += sizeof(MO);
@@ -310,8 +522,13 @@ void *	really_new_malloc (size_t size, const char *fn, int line)
 	canary1(ptr) = ALLOC_CANARY1;
 	canary2(ptr) = ALLOC_CANARY2;
 	alloc_size(ptr) = size;
+#ifdef MALLOC_PROFILE
+	malloc_profile_alloc(ptr, fn, line);
+#endif
+#ifndef FAST_MALLOC
 	VALGRIND_CREATE_MEMPOOL(mo_ptr(ptr), 0, 1);
 	VALGRIND_MEMPOOL_ALLOC(mo_ptr(ptr), ptr, size);
+#endif
 	return ptr;
 }
 
@@ -344,11 +561,37 @@ void *	really_new_malloc (size_t size, const char *fn, int line)
  */
 void *	really_new_free (void **ptr, const char *fn, int line)
 {
+#ifdef FAST_MALLOC
+	size_t	size;
+	int	cls;
+
+	if (*ptr)
+	{
+		if (magic(*ptr) != ALLOC_MAGIC || alloc_size(*ptr) == FREED_VAL ||
+				++malloc_checks % FAST_MALLOC_CHECK_EVERY == 0)
+			fatal_malloc_check(*ptr, NULL, fn, line);
+#ifdef MALLOC_PROFILE
+		malloc_profile_free(*ptr);
+#endif
+
+		size = alloc_size(*ptr);
+		alloc_size(*ptr) = FREED_VAL;
+		if ((cls = slab_class(size + sizeof(MO))) >= 0)
+			slab_free((char *)mo_ptr(*ptr), cls);
+		else
+			free((void *)(mo_ptr(*ptr)));
+		*ptr = NULL;
+	}
+	return NULL;
+#else
 	if (*ptr)
 	{
 		VALGRIND_MEMPOOL_FREE(mo_ptr(*ptr), *ptr);
 		VALGRIND_DESTROY_MEMPOOL(mo_ptr(*ptr));
 		fatal_malloc_check(*ptr, NULL, fn, line);
+#ifdef MALLOC_PROFILE
+		malloc_profile_free(*ptr);
+#endif
 		/* 
 		 * I am undecided if this is a good idea or bad.
 		 * Not clearing memory leaks it to the next allocator,
@@ -361,6 +604,7 @@ void *	really_new_free (void **ptr, const char *fn, int line)
 		*ptr = NULL;
 	}
 	return NULL;
+#endif
 }
 
 /* really_new_malloc in disguise */
@@ -422,7 +666,9 @@ void *	really_new_realloc (void **ptr, size_t size, const char *fn, int line)
 	else if (*ptr == NULL)
 	{
 		*ptr = really_new_malloc(size, fn, line);
+#ifndef FAST_MALLOC
 		memset(*ptr, 0, alloc_size(*ptr));
+#endif
 	}
 
 	/*
@@ -435,6 +681,22 @@ void *	really_new_realloc (void **ptr, size_t size, const char *fn, int line)
 		/* Whether we are moving it or not, just make sure everything is ok */
 		fatal_malloc_check(*ptr, NULL, fn, line);
 
+#ifdef FAST_MALLOC
+		/* If it still fits in its chunk, it doesn't have to move */
+		if ((ssize_t) size > (ssize_t)alloc_size(*ptr) &&
+		    slab_class(alloc_size(*ptr) + sizeof(MO)) >= 0 &&
+		    slab_class(alloc_size(*ptr) + sizeof(MO)) == 
+					slab_class(size + sizeof(MO)))
+		{
+			memset(end_ptr(*ptr), 0, size - alloc_size(*ptr));
+#ifdef MALLOC_PROFILE
+			malloc_sites[alloc_site(*ptr)].bytes += 
+					size - alloc_size(*ptr);
+#endif
+			alloc_size(*ptr) = size;
+		}
+#endif
+
 		/* Move it to a new buffer but only if we need more space */
 		if ((ssize_t) size > (ssize_t)alloc_size(*ptr))
 		{
@@ -466,6 +728,94 @@ void *	really_new_realloc (void **ptr, size_t size, const char *fn, int line)
 	return *ptr;
 }
 
+/*
+ * $memctl(PROFILE)
+ *	Returns 1 if the client was built --with-malloc-profile.
+ * $memctl(TOTALS)
+ *	Returns "<bytes> <objects> <allocs>" for the whole client
+ * $memctl(SITES [count])
+ *	Returns "file:line" for the [count] (all, by default) places
+ *	that have the most bytes that haven't been freed, biggest first.
+ * $memctl(GET <file:line>)
+ *	Returns "<bytes> <objects> <allocs>" for one place
+ *
+ * <bytes> and <objects> are what that place has new_malloc()ed that hasn't
+ * been new_free()d yet, no matter who frees it.  <allocs> is how many
+ * times it has ever called new_malloc().  Without --with-malloc-profile, 
+ * everything except PROFILE returns the empty string.
+ */
+char *	memctl (char *input)
+{
+	char *	listc;
+	int	len;
+#ifdef MALLOC_PROFILE
+	char *	retval = NULL;
+	char *	str;
+	char *	colon;
+	int *	order;
+	int	count, i, line;
+	intmax_t bytes = 0, objects = 0, allocs = 0;
+#endif
+
+	GET_FUNC_ARG(listc, input);
+	len = strlen(listc);
+	if (!my_strnicmp(listc, "PROFILE", len)) {
+#ifdef MALLOC_PROFILE
+		RETURN_INT(1);
+#else
+		RETURN_INT(0);
+#endif
+	}
+#ifdef MALLOC_PROFILE
+	else if (!my_strnicmp(listc, "TOTALS", len)) {
+		for (i = 0; i < malloc_sites_used; i++)
+		{
+			bytes += malloc_sites[i].bytes;
+			objects += malloc_sites[i].objects;
+			allocs += malloc_sites[i].allocs;
+		}
+		return malloc_sprintf(NULL, "%jd %jd %jd", bytes, objects, allocs);
+	} else if (!my_strnicmp(listc, "SITES", len)) {
+		count = malloc_sites_used;
+		if (input && *input)
+			GET_INT_ARG(count, input);
+		if (count > malloc_sites_used)
+			count = malloc_sites_used;
+
+		order = (int *)new_malloc(sizeof(int) * (malloc_sites_used + 1));
+		for (i = 0; i < malloc_sites_used; i++)
+			order[i] = i;
+		qsort(order, malloc_sites_used, sizeof(int), malloc_site_cmp);
+		for (i = 0; i < count; i++)
+		{
+			str = malloc_sprintf(NULL, "%s:%d", 
+				malloc_sites[order[i]].fn, malloc_sites[order[i]].line);
+			malloc_strcat_word(&retval, space, str, DWORD_DWORDS);
+			new_free(&str);
+		}
+		new_free(&order);
+		RETURN_MSTR(retval);
+	} else if (!my_strnicmp(listc, "GET", len)) {
+		GET_FUNC_ARG(str, input);
+		if (!(colon = strrchr(str, ':')))
+			RETURN_EMPTY;
+		*colon++ = 0;
+		line = my_atol(colon);
+		for (i = 0; i < malloc_sites_used; i++)
+		{
+			if (malloc_sites[i].line == line && 
+			    !strcmp(malloc_sites[i].fn, str))
+				return malloc_sprintf(NULL, "%jd %jd %jd", 
+					malloc_sites[i].bytes, 
+					malloc_sites[i].objects,
+					malloc_sites[i].allocs);
+		}
+	}
+#endif
+
+	RETURN_EMPTY;
+}
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 /*
  * malloc_sprintf: write a formatted string to heap memory
@@ -499,18 +849,18 @@ void *	really_new_realloc (void **ptr, size_t size, const char *fn, int line)
  *		_will_ be changed.
  *	The return value belongs to you.  You must new_free() it.
  */
-char *	malloc_sprintf (char **ptr, const char *format, ...)
+char *	really_malloc_sprintf (const char *fn, int line, char **ptr, const char *format, ...)
 {
 	char *		retval;
 	va_list		args;
 
 	va_start(args, format);
-	retval = malloc_vsprintf(ptr, format, args);
+	retval = really_malloc_vsprintf(ptr, format, args, fn, line);
 	va_end(args);
 	return retval;
 }
 
-char *	malloc_vsprintf (char **ptr, const char *format, va_list args)
+char *	really_malloc_vsprintf (char **ptr, const char *format, va_list args, const char *fn, int line)
 {
 	char *		buffer = NULL;
 	size_t		buffer_size;
@@ -527,7 +877,7 @@ char *	malloc_vsprintf (char **ptr, const char *format, va_list args)
 		 * try again -- until it does not overflow.
 		 */
 		buffer_size = strlen(format) * 2;
-		buffer = new_malloc(buffer_size + 1);
+		buffer = really_new_malloc(buffer_size + 1, fn, line);
 
 	        va_copy(orig_args, args);
 		for (;;)
@@ -558,7 +908,7 @@ char *	malloc_vsprintf (char **ptr, const char *format, va_list args)
 				break;
 			else
 				buffer_size = vsn_retval + 1;
-			RESIZE(buffer, char, buffer_size);
+			really_new_realloc((void **)&buffer, buffer_size, fn, line);
 
 			va_end(args);
 			va_copy(args, orig_args);
@@ -572,7 +922,7 @@ char *	malloc_vsprintf (char **ptr, const char *format, va_list args)
 
 	if (ptr)
 	{
-		new_free(ptr);
+		really_new_free((void **)ptr, fn, line);
 		*ptr = buffer;
 		return *ptr;
 	}
@@ -596,7 +946,7 @@ char *	malloc_vsprintf (char **ptr, const char *format, va_list args)
  *  You must deallocate the space later by passing a pointer to the return
  *	value to the new_free() function.
  */
-char *	malloc_strcdup (int numargs, ...)
+char *	really_malloc_strcdup (const char *fn, int line, int numargs, ...)
 {
 	char *		retval = NULL;
 	va_list		args, orig_args;
@@ -616,7 +966,7 @@ char *	malloc_strcdup (int numargs, ...)
 	}
 
 	retsize++;
-	retval = new_malloc(retsize);
+	retval = really_new_malloc(retsize, fn, line);
 	*retval = 0;
 
 	va_end(args);
@@ -767,12 +1117,12 @@ char *	malloc_strdup3 (const char *str1, const char *str2, const char *str3)
  *  You must deallocate the space later by passing (ptr) to the new_free() 
  *	function.
  */
-char *	malloc_strcpy (char **ptr, const char *src)
+char *	really_malloc_strcpy (char **ptr, const char *src, const char *fn, int line)
 {
 	size_t	size, size_src;
 
 	if (!src)
-		return new_free(ptr);	/* shrug */
+		return really_new_free((void **)ptr, fn, line);	/* shrug */
 
 	if (*ptr)
 	{
@@ -791,11 +1141,11 @@ char *	malloc_strcpy (char **ptr, const char *src)
 			return *ptr;
 		}
 
-		new_free(ptr);
+		really_new_free((void **)ptr, fn, line);
 	}
 
 	size = strlen(src);
-	*ptr = new_malloc(size + 1);
+	*ptr = really_new_malloc(size + 1, fn, line);
 	strlcpy(*ptr, src, size + 1);
 	return *ptr;
 }
@@ -846,8 +1196,10 @@ char *	malloc_strcat (char **ptr, const char *src)
 		ssize = strlen(src);
 		msize = psize + ssize + 1;
 
-		RESIZE(*ptr, char, msize);
-		strlcat(psize + *ptr, src, msize - psize);
+		/* Grow geometrically so repeated appends are amortized */
+		if (msize > (size_t)alloc_size(*ptr))
+			RESIZE(*ptr, char, MAX(msize, (size_t)alloc_size(*ptr) * 2));
+		memcpy(*ptr + psize, src, ssize + 1);
 		return (*ptr);
 	}
 
@@ -882,45 +1234,397 @@ char *	malloc_strcat (char **ptr, const char *src)
  * Just as with 'malloc_strcat', 'src' may be NULL and this function will
  * no-op (as opposed to crashing)
  *
- * The technique we use here is a hack, and it's expensive, but it works.
- * 1) Copy 'src' into a temporary buffer, removing any \'s as proscribed
- * 2) Append the temporary buffer to '*dest'
+ * The dequoting is done by strbuf_cat_ues(), which copies 'src' directly
+ * onto the end of '*dest', removing any \'s as proscribed.
  *
  * NOTES: This is the "dequoter", also known as "Quoting Hell".  Everything
  * that removes \'s uses this function to do it.
  */
 char *	malloc_strcat_ues (char **dest, const char *src, const char *special)
 {
-	char *workbuf, *p;
+	Strbuf	sb;
+
+	strbuf_adopt(&sb, dest);
+	strbuf_cat_ues(&sb, src, special);
+	return (*dest = strbuf_release(&sb));
+}
+
+char *	malloc_strcat_word (char **ptr, const char *word_delim, const char *word, int extended)
+{
+	Strbuf	sb;
+
+	strbuf_adopt(&sb, ptr);
+	strbuf_cat_word(&sb, word_delim, word, extended);
+	return (*ptr = strbuf_release(&sb));
+}
+
+/*
+ * malloc_strcat_wordlist: Append a word list to another word list using a delimiter
+ *
+ * Arguments:
+ *  'ptr' - A pointer to a variable pointer that is either NULL or a valid
+ *		heap pointer which shall contain a valid C string which 
+ *		represents a word list (words separated by delimiters)
+ *  'word_delim' - The delimiter to use to separate (*ptr) from 'word_list'.
+ *		May be NULL if no delimiter is desired.
+ *  'word_list' - The word list to append to (*ptr).
+ *		May be NULL.
+ *
+ * Return value:
+ *  If "wordlist" is either NULL or a zero-length string, this function
+ *	does nothing, and returns the original value of (*ptr).
+ *  If "wordlist" is not NULL and not a zero-length string, and (*ptr) is
+ *	either NULL or a zero-length string, (*ptr) is set to "wordlist",
+ *	and the new value of (*ptr) is returned.
+ *  If "wordlist" is not NULL and not a zero-length string, and (*ptr) is
+ *	not NULL and not a zero-length string, (*ptr) is set to the 
+ *	catenation of (*ptr), 'word_delim', and 'wordlist' and is the
+ *	return value.  
+ *  This function will not return (panic) if (*ptr) is not NULL and is 
+ *	not a valid heap pointer.
+ *
+ * Notes:
+ *  The idea of this function is given two word lists, either of which 
+ *	may contain zero or more words, paste them together using a
+ *	delimiter, which for word lists, is usually a space, but could
+ *	be any character.
+ *  Unless "wordlist" is NULL or a zero-length string, the original value
+ *	of (*ptr) is invalidated and may not be used after this function
+ *	returns.
+ *  You must deallocate the space later by passing (ptr) to the new_free() 
+ *	function.
+ *  A WORD LIST IS CONSIDERED TO HAVE ONE ELEMENT IF IT HAS ANY CHARACTERS
+ *	EVEN IF THAT CHARACTER IS A DELIMITER (ie, a space).
+ */
+char *	malloc_strcat_wordlist (char **ptr, const char *word_delim, const char *wordlist)
+{
+	/* XXX is this right? */
+	if (!ptr)
+		return NULL;
+
+	if (wordlist && *wordlist)
+	{
+	    if (*ptr && **ptr)
+		malloc_strcat(ptr, nonull(word_delim));
+	    return malloc_strcat(ptr, wordlist);
+	}
+	else
+	    return *ptr;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/*
+ * The scratch arena holds strings that only live as long as the statement
+ * (or function call) that is running.  Running one statement used to do 
+ * dozens of new_malloc()/new_free() pairs for things like the expanded 
+ * command line and function arguments, and every one of them paid for the
+ * canaries and the memset()s.  Arena memory is handed out by bumping a 
+ * pointer, and is all given back at once when the statement is done.
+ *
+ * Usage:
+ *	ArenaMark	mark;
+ *	arena_mark(&mark);
+ *	...  p = arena_alloc(...), arena_strdup(...), strbuf_init_temp() ...
+ *	arena_release(&mark);		-- Everything since arena_mark() is gone
+ *
+ * Marks must be released in the reverse order they were taken, which is 
+ * automatic as long as you release them in the same function.
+ * Never new_free() arena memory and never keep a pointer to it after the
+ * mark is released.
+ *
+ * If you /XDEBUG +ARENA, every arena allocation is made with new_malloc() 
+ * and new_free()d when its mark is released, so the usual checks apply.
+ */
+#define ARENA_CHUNK_SIZE	65536
+#define ARENA_ALIGN(x)		(((x) + 7) & ~(size_t)7)
+
+typedef struct ArenaChunkStru
+{
+	struct ArenaChunkStru *	prev;
+	size_t			size;		/* Bytes in data[] */
+	size_t			used;		/* Bytes of data[] handed out */
+	char			data[];
+} ArenaChunk;
+
+static	ArenaChunk *	arena_chunk = NULL;	/* The one we allocate from */
+static	ArenaChunk *	arena_spare = NULL;	/* Kept to avoid churn */
+static	void **		arena_checked = NULL;	/* For /XDEBUG +ARENA */
+static	size_t		arena_checked_count = 0;
+static	size_t		arena_checked_max = 0;
+
+static void	arena_pop_chunk (void)
+{
+	ArenaChunk *	c = arena_chunk;
+
+	arena_chunk = c->prev;
+	if (!arena_spare && c->size == ARENA_CHUNK_SIZE)
+		arena_spare = c;
+	else
+		new_free((char **)&c);
+}
+
+static void	arena_push_chunk (size_t size)
+{
+	ArenaChunk *	c;
+
+	if (size <= ARENA_CHUNK_SIZE && arena_spare)
+	{
+		c = arena_spare;
+		arena_spare = NULL;
+	}
+	else
+	{
+		size = MAX(size, ARENA_CHUNK_SIZE);
+		c = new_malloc(sizeof(ArenaChunk) + size);
+		c->size = size;
+	}
+
+	c->used = 0;
+	c->prev = arena_chunk;
+	arena_chunk = c;
+}
+
+void	arena_mark (ArenaMark *mark)
+{
+	mark->chunk = arena_chunk;
+	mark->used = arena_chunk ? arena_chunk->used : 0;
+	mark->checked = arena_checked_count;
+}
+
+void	arena_release (const ArenaMark *mark)
+{
+	while (arena_checked_count > mark->checked)
+		new_free(&arena_checked[--arena_checked_count]);
+
+	while (arena_chunk && arena_chunk != mark->chunk)
+		arena_pop_chunk();
+	if (arena_chunk)
+		arena_chunk->used = mark->used;
+}
+
+/*
+ * Throw away everything.  This is only for after a panic(), when 
+ * the marks that were outstanding have been longjmp()ed over.
+ */
+void	arena_reset (void)
+{
+	while (arena_checked_count > 0)
+		new_free(&arena_checked[--arena_checked_count]);
+	while (arena_chunk)
+		arena_pop_chunk();
+}
+
+void *	arena_alloc (size_t size)
+{
+	void *	ptr;
+
+	if (x_debug & DEBUG_ARENA)
+	{
+		if (arena_checked_count >= arena_checked_max)
+		{
+			arena_checked_max = arena_checked_max ? arena_checked_max * 2 : 64;
+			RESIZE(arena_checked, void *, arena_checked_max);
+		}
+		ptr = new_malloc(size);
+		arena_checked[arena_checked_count++] = ptr;
+		return ptr;
+	}
+
+	size = ARENA_ALIGN(size);
+	if (!arena_chunk || arena_chunk->size - arena_chunk->used < size)
+		arena_push_chunk(size);
+
+	ptr = arena_chunk->data + arena_chunk->used;
+	arena_chunk->used += size;
+	return ptr;
+}
+
+/*
+ * Make an arena allocation of 'oldsize' bytes bigger.  If it was the 
+ * last thing allocated, it can usually grow where it is.
+ */
+void *	arena_realloc (void *ptr, size_t oldsize, size_t newsize)
+{
+	char *	p = ptr;
+	void *	newptr;
+
+	if (!p)
+		return arena_alloc(newsize);
+
+	if (arena_chunk && p >= arena_chunk->data &&
+	    p + ARENA_ALIGN(oldsize) == arena_chunk->data + arena_chunk->used &&
+	    (size_t)(p - arena_chunk->data) + ARENA_ALIGN(newsize) <= arena_chunk->size)
+	{
+		arena_chunk->used = (p - arena_chunk->data) + ARENA_ALIGN(newsize);
+		return ptr;
+	}
+
+	newptr = arena_alloc(newsize);
+	memcpy(newptr, ptr, MIN(oldsize, newsize));
+	return newptr;
+}
+
+char *	arena_strdup (const char *str)
+{
+	size_t	size;
+	char *	ptr;
+
+	if (!str)
+		str = empty_string;
+
+	size = strlen(str) + 1;
+	ptr = arena_alloc(size);
+	memcpy(ptr, str, size);
+	return ptr;
+}
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+/*
+ * A Strbuf is a string you are building up a piece at a time.
+ *
+ * The malloc_strcat() family has to strlen() the whole string every time
+ * you append to it, so building a string out of N pieces is O(N^2).  A 
+ * Strbuf remembers how long its string is, and since new_malloc() already
+ * remembers how big the buffer is, it never has to go looking for either.
+ * The buffer grows geometrically, so appending is amortized O(1).
+ *
+ * Usage:
+ *	Strbuf	sb;
+ *	strbuf_init(&sb);
+ *	strbuf_cat(&sb, "one");
+ *	strbuf_cat(&sb, "two");
+ *	retval = strbuf_release(&sb);	  -- YOU OWN 'retval' NOW.
+ *
+ * sb.str is always either NULL or a new_malloc()ed nul-terminated string,
+ * so you can look at it at any time.  If you want to give up, you must 
+ * strbuf_free() it.
+ *
+ * If you use strbuf_init_temp() instead, the string is built in the scratch
+ * arena (see above), and strbuf_release() gives you arena memory.
+ */
+void	strbuf_init (Strbuf *sb)
+{
+	sb->str = NULL;
+	sb->len = 0;
+	sb->size = 0;
+	sb->temp = 0;
+}
+
+void	strbuf_init_temp (Strbuf *sb)
+{
+	sb->str = NULL;
+	sb->len = 0;
+	sb->size = 0;
+	sb->temp = 1;
+}
+
+/*
+ * Take over an existing new_malloc()ed string (which may be NULL) and 
+ * keep appending to it.  (*ptr) is set to NULL, because the string 
+ * belongs to the Strbuf now.
+ */
+void	strbuf_adopt (Strbuf *sb, char **ptr)
+{
+	sb->temp = 0;
+	if ((sb->str = *ptr))
+	{
+		if (alloc_size(sb->str) == FREED_VAL)
+			panic(1, "free()d pointer passed to strbuf_adopt");
+		sb->len = strlen(sb->str);
+		sb->size = alloc_size(sb->str);
+	}
+	else
+		sb->len = sb->size = 0;
+	*ptr = NULL;
+}
+
+/*
+ * Make sure there is room for 'more' bytes after the end of the string
+ * (not counting the nul).
+ */
+void	strbuf_reserve (Strbuf *sb, size_t more)
+{
+	size_t	need = sb->len + more + 1;
+
+	if (need <= sb->size)
+		return;
+	if (need < sb->size * 2)
+		need = sb->size * 2;
+	if (need < 32)
+		need = 32;
+	if (sb->temp)
+		sb->str = arena_realloc(sb->str, sb->size, need);
+	else
+		RESIZE(sb->str, char, need);
+	sb->size = need;
+}
+
+/*
+ * Append the first 'len' bytes of 'src' (which must not contain a nul)
+ */
+char *	strbuf_ncat (Strbuf *sb, const char *src, size_t len)
+{
+	strbuf_reserve(sb, len);
+	memcpy(sb->str + sb->len, src, len);
+	sb->len += len;
+	sb->str[sb->len] = 0;
+	return sb->str;
+}
+
+/*
+ * Append 'src', which may be NULL (meaning "append nothing")
+ */
+char *	strbuf_cat (Strbuf *sb, const char *src)
+{
+	if (!src)
+		return sb->str;
+	return strbuf_ncat(sb, src, strlen(src));
+}
+
+/*
+ * Append 'src', backslashing any character in 'quote_em' (see 
+ * escape_chars() for the details).
+ */
+char *	strbuf_cat_escaped (Strbuf *sb, const char *src, const char *quote_em)
+{
+	size_t	room;
+
+	room = strlen(src) * 2 + 2;
+	strbuf_reserve(sb, room);
+	escape_chars(src, quote_em, sb->str + sb->len, room);
+	sb->len += strlen(sb->str + sb->len);
+	return sb->str;
+}
+
+/*
+ * Append 'src', dequoting it according to 'special'.  
+ * See malloc_strcat_ues() for the rules.
+ */
+char *	strbuf_cat_ues (Strbuf *sb, const char *src, const char *special)
+{
 	const char *s;
+	char *	p;
 
 	/*
-	 * The callers expect (*dest) to be an empty string if
+	 * The callers expect the result to be an empty string if
 	 * 'src' is null or empty.
 	 */
 	if (!src || !*src)
-	{
-		malloc_strcat(dest, empty_string);
-		return *dest;
-	}
+		return strbuf_ncat(sb, empty_string, 0);
 
 	/* If we're not dequoting, cut it short and return. */
 	if (special == NULL)
-	{
-		malloc_strcat(dest, src);
-		return *dest;
-	}
+		return strbuf_cat(sb, src);
 
 	/* 
-	 * Set up a working buffer for our copy.
-	 * Reserve two extra spaces because the algorithm below
-	 * may copy two nuls to 'workbuf', and we need the space
-	 * for the second nul.
+	 * The dequoted string can't be longer than 'src'.
+	 * Reserve one extra byte because the algorithm below
+	 * may copy two nuls.
 	 */
-	workbuf = alloca(strlen(src) + 2);
+	strbuf_reserve(sb, strlen(src) + 1);
 
 	/* Walk 'src' looking for characters to dequote */
-	for (s = src, p = workbuf; ; s++, p++)
+	for (s = src, p = sb->str + sb->len; ; s++, p++)
 	{
 	    /* 
 	     * If we see a backslash, it is not at the end of the
@@ -994,101 +1698,83 @@ char *	malloc_strcat_ues (char **dest, const char *src, const char *special)
 			break;
 	}
 
-	/*
-	 * We're done!  Append 'workbuf' to 'dest'.
-	 */
-	malloc_strcat(dest, workbuf);
-	return *dest;
+	sb->len = p - sb->str;
+	return sb->str;
 }
 
-char *	malloc_strcat_word (char **ptr, const char *word_delim, const char *word, int extended)
+/*
+ * Append a word list to the string, using 'word_delim' between them.
+ * See malloc_strcat_wordlist() for the rules.
+ */
+char *	strbuf_cat_wordlist (Strbuf *sb, const char *word_delim, const char *wordlist)
+{
+	if (wordlist && *wordlist)
+	{
+	    if (sb->len)
+		strbuf_cat(sb, nonull(word_delim));
+	    strbuf_cat(sb, wordlist);
+	}
+	return sb->str;
+}
+
+/*
+ * Append a single word to the string, using 'word_delim' between them,
+ * and double quoting it if it needs to be (and the caller wants that).
+ */
+char *	strbuf_cat_word (Strbuf *sb, const char *word_delim, const char *word, int extended)
 {
 	/* You MUST turn on /xdebug dword to get double quoted words */
 	if (extended == DWORD_DWORDS && !(x_debug & DEBUG_DWORD))
-		return malloc_strcat_wordlist(ptr, word_delim, word);
+		return strbuf_cat_wordlist(sb, word_delim, word);
 	if (extended == DWORD_EXTRACTW && !(x_debug & DEBUG_EXTRACTW))
-		return malloc_strcat_wordlist(ptr, word_delim, word);
+		return strbuf_cat_wordlist(sb, word_delim, word);
 	if (extended == DWORD_NO)
-		return malloc_strcat_wordlist(ptr, word_delim, word);
+		return strbuf_cat_wordlist(sb, word_delim, word);
 
 	if (word && *word)
 	{
-		if (*ptr && **ptr)
-			malloc_strcat(ptr, word_delim);
+		if (sb->len)
+			strbuf_cat(sb, word_delim);
 
 		/* Remember, any double quotes therein need to be quoted! */
 		if (strpbrk(word, word_delim))
 		{
-			char *	oofda = NULL;
-			char *	oofda2 = NULL;
-			size_t	oofda_siz;
-
-			oofda_siz = strlen(word) * 2 + 2;
-			oofda = alloca(oofda_siz);
-			escape_chars(word, "\"", oofda, oofda_siz);
-			malloc_sprintf(&oofda2, "\"%s\"", oofda);
-			malloc_strcat(ptr, oofda2);
-			new_free(&oofda2);
+			strbuf_ncat(sb, "\"", 1);
+			strbuf_cat_escaped(sb, word, "\"");
+			strbuf_ncat(sb, "\"", 1);
 		}
 		else
-			malloc_strcat(ptr, word);
+			strbuf_cat(sb, word);
 	}
 
-	return *ptr;
+	return sb->str;
 }
 
 /*
- * malloc_strcat_wordlist: Append a word list to another word list using a delimiter
- *
- * Arguments:
- *  'ptr' - A pointer to a variable pointer that is either NULL or a valid
- *		heap pointer which shall contain a valid C string which 
- *		represents a word list (words separated by delimiters)
- *  'word_delim' - The delimiter to use to separate (*ptr) from 'word_list'.
- *		May be NULL if no delimiter is desired.
- *  'word_list' - The word list to append to (*ptr).
- *		May be NULL.
- *
- * Return value:
- *  If "wordlist" is either NULL or a zero-length string, this function
- *	does nothing, and returns the original value of (*ptr).
- *  If "wordlist" is not NULL and not a zero-length string, and (*ptr) is
- *	either NULL or a zero-length string, (*ptr) is set to "wordlist",
- *	and the new value of (*ptr) is returned.
- *  If "wordlist" is not NULL and not a zero-length string, and (*ptr) is
- *	not NULL and not a zero-length string, (*ptr) is set to the 
- *	catenation of (*ptr), 'word_delim', and 'wordlist' and is the
- *	return value.  
- *  This function will not return (panic) if (*ptr) is not NULL and is 
- *	not a valid heap pointer.
- *
- * Notes:
- *  The idea of this function is given two word lists, either of which 
- *	may contain zero or more words, paste them together using a
- *	delimiter, which for word lists, is usually a space, but could
- *	be any character.
- *  Unless "wordlist" is NULL or a zero-length string, the original value
- *	of (*ptr) is invalidated and may not be used after this function
- *	returns.
- *  You must deallocate the space later by passing (ptr) to the new_free() 
- *	function.
- *  A WORD LIST IS CONSIDERED TO HAVE ONE ELEMENT IF IT HAS ANY CHARACTERS
- *	EVEN IF THAT CHARACTER IS A DELIMITER (ie, a space).
+ * Hand the finished string over to the caller.  YOU OWN THE RETURN VALUE.
+ * It is NULL if nothing was ever appended.  The Strbuf is empty again
+ * afterwards and can be reused.
  */
-char *	malloc_strcat_wordlist (char **ptr, const char *word_delim, const char *wordlist)
+char *	strbuf_release (Strbuf *sb)
 {
-	/* XXX is this right? */
-	if (!ptr)
-		return NULL;
+	char *	retval = sb->str;
 
-	if (wordlist && *wordlist)
-	{
-	    if (*ptr && **ptr)
-		malloc_strcat(ptr, nonull(word_delim));
-	    return malloc_strcat(ptr, wordlist);
-	}
+	sb->str = NULL;
+	sb->len = sb->size = 0;
+	return retval;
+}
+
+/*
+ * Throw away whatever you've built so far.  (Temp strings are really
+ * given back when the arena mark is released)
+ */
+void	strbuf_free (Strbuf *sb)
+{
+	if (sb->temp)
+		sb->str = NULL;
 	else
-	    return *ptr;
+		new_free(&sb->str);
+	sb->len = sb->size = 0;
 }
 
 /*
@@ -1687,6 +2373,31 @@ int	server_strnicmp (const char *str1, const char *str2, size_t n, int servref)
 		return utf8_strnicmp(str1, str2, n);
 }
 
+/*
+ * server_strhash -- A hash of 'str' for a table keyed by server_stricmp().
+ * Any two strings that server_stricmp() thinks are the same hash the same,
+ * whatever the server's stricmp table is: ascii letters are folded with
+ * the rfc1459 table (which folds everything the ascii one does), and 
+ * everything else is folded the way utf8_strnicmp() does it.
+ */
+uint32_t	server_strhash (const char *str)
+{
+	uint32_t	h = 2166136261U;
+	ptrdiff_t	offset;
+	int		c;
+
+	while ((c = next_code_point2(str, &offset, 1)) > 0)
+	{
+		str += offset;
+		if (c < 0x80)
+			c = rfc1459_stricmp_table[c];
+		else
+			c = mkupper_l(c);
+		h = (h ^ (uint32_t)c) * 16777619U;
+	}
+	return h;
+}
+
 int	alist_stricmp (const char *str1, const char *str2, size_t __U(ignored))
 {
 	return my_stricmp(str1, str2);
@@ -2551,7 +3262,8 @@ static int		setup				= 0;
 static 	Filename 	path_to_gunzip;
 static	Filename 	path_to_uncompress;
 static 	Filename 	path_to_bunzip2;
-	int 		ok_to_decompress 		= 0;
+static 	Filename 	path_to_unxz;
+	int 		ok_to_decompress 		= COMPRESS_NONE;
 	Filename	fullname;
 	Filename	candidate;
 
@@ -2569,6 +3281,9 @@ static 	Filename 	path_to_bunzip2;
 		if (path_search("bunzip2", getenv("PATH"), path_to_bunzip2))
 		    path_search("bunzip", getenv("PATH"), path_to_bunzip2);
 
+		*path_to_unxz = 0;
+		path_search("unxz", getenv("PATH"), path_to_unxz);
+
 		setup = 1;
 	}
 
@@ -2598,14 +3313,14 @@ static 	Filename 	path_to_bunzip2;
         {
             /* these are handled differently */
             if (end_strcmp(*filename, ".tar.gz", 7)) {
-                if (!*path_to_gunzip)
+                if (!*path_to_gunzip && !epic_can_decompress(COMPRESS_GZIP))
                 {
                     if (do_error)
                             yell("Cannot open file %s because gunzip "
                                      "was not found", *filename);
                         goto error_cleanup;
                 }
-                ok_to_decompress = 2;
+                ok_to_decompress = COMPRESS_GZIP;
             }
             if (path_search(*filename, path, fullname))
                 goto file_not_found;
@@ -2621,13 +3336,13 @@ static 	Filename 	path_to_bunzip2;
 			goto error_cleanup;
 		}
 
-		ok_to_decompress = 1;
+		ok_to_decompress = COMPRESS_Z;
 		if (path_search(*filename, path, fullname))
 			goto file_not_found;
 	}
 	else if (!end_strcmp(*filename, ".bz2", 4))
 	{
-		if (!*path_to_bunzip2)
+		if (!*path_to_bunzip2 && !epic_can_decompress(COMPRESS_BZIP2))
 		{
 			if (do_error)
 				yell("Cannot open file %s because bunzip "
@@ -2635,7 +3350,21 @@ static 	Filename 	path_to_bunzip2;
 			goto error_cleanup;
 		}
 
-		ok_to_decompress = 3;
+		ok_to_decompress = COMPRESS_BZIP2;
+		if (path_search(*filename, path, fullname))
+			goto file_not_found;
+	}
+	else if (!end_strcmp(*filename, ".xz", 3))
+	{
+		if (!*path_to_unxz && !epic_can_decompress(COMPRESS_XZ))
+		{
+			if (do_error)
+				yell("Cannot open file %s because unxz "
+					"was not found", *filename);
+			goto error_cleanup;
+		}
+
+		ok_to_decompress = COMPRESS_XZ;
 		if (path_search(*filename, path, fullname))
 			goto file_not_found;
 	}
@@ -2647,35 +3376,42 @@ static 	Filename 	path_to_bunzip2;
 	    {
 		/* Trivially, see if the file we were passed exists */
 		if (!path_search(*filename, path, fullname)) {
-			ok_to_decompress = 0;
+			ok_to_decompress = COMPRESS_NONE;
 			break;
 		}
 
 		/* Is there a "filename.gz"? */
 		snprintf(candidate, sizeof(candidate), "%s.gz", *filename);
 		if (!path_search(candidate, path, fullname)) {
-			ok_to_decompress = 2;
+			ok_to_decompress = COMPRESS_GZIP;
 			break;
 		}
 
 		/* Is there a "filename.Z"? */
 		snprintf(candidate, sizeof(candidate), "%s.Z", *filename);
 		if (!path_search(candidate, path, fullname)) {
-			ok_to_decompress = 1;
+			ok_to_decompress = COMPRESS_Z;
 			break;
 		}
 
 		/* Is there a "filename.z"? */
 		snprintf(candidate, sizeof(candidate), "%s.z", *filename);
 		if (!path_search(candidate, path, fullname)) {
-			ok_to_decompress = 2;
+			ok_to_decompress = COMPRESS_GZIP;
 			break;
 		}
 
 		/* Is there a "filename.bz2"? */
 		snprintf(candidate, sizeof(candidate), "%s.bz2", *filename);
 		if (!path_search(candidate, path, fullname)) {
-			ok_to_decompress = 3;
+			ok_to_decompress = COMPRESS_BZIP2;
+			break;
+		}
+
+		/* Is there a "filename.xz"? */
+		snprintf(candidate, sizeof(candidate), "%s.xz", *filename);
+		if (!path_search(candidate, path, fullname)) {
+			ok_to_decompress = COMPRESS_XZ;
 			break;
 		}
 
@@ -2700,19 +3436,24 @@ static 	Filename 	path_to_bunzip2;
 
         /*
          * At this point, we should have a filename in the variable
-         * *filename, and it should exist.  If ok_to_decompress is one, then
-         * we can gunzip the file if gunzip is available.  else we
-         * uncompress the file.
+         * *filename, and it should exist.  If it's compressed, we
+         * decompress it ourselves if we can, or else run the program
+         * that decompresses it.
 	 */
 	malloc_strcpy(filename, fullname);
 	if (ok_to_decompress)
 	{
-		     if ((ok_to_decompress <= 2) && *path_to_gunzip)
+		if (epic_can_decompress(ok_to_decompress))
+			return epic_fopen_decompress(*filename, ok_to_decompress, do_error);
+
+		     if ((ok_to_decompress == COMPRESS_GZIP || ok_to_decompress == COMPRESS_Z) && *path_to_gunzip)
 			return open_compression(path_to_gunzip, *filename);
-		else if ((ok_to_decompress == 1) && *path_to_uncompress)
+		else if ((ok_to_decompress == COMPRESS_Z) && *path_to_uncompress)
 			return open_compression(path_to_uncompress, *filename);
-		else if ((ok_to_decompress == 3) && *path_to_bunzip2)
+		else if ((ok_to_decompress == COMPRESS_BZIP2) && *path_to_bunzip2)
 			return open_compression(path_to_bunzip2, *filename);
+		else if ((ok_to_decompress == COMPRESS_XZ) && *path_to_unxz)
+			return open_compression(path_to_unxz, *filename);
 
 		if (do_error)
 			yell("Cannot open compressed file %s becuase no "
@@ -110,7 +110,7 @@ typedef struct Key Key;
 	static	Key *	_head_keymap = NULL; 
 
 /********************************************************/
-static	alist	keyspaces = { NULL, 0, 0, my_strnicmp, HASH_INSENSITIVE };
+static	alist	keyspaces = { NULL, 0, 0, my_strnicmp, HASH_INSENSITIVE, NULL };
 static	Key *	_current_keymap = NULL;
 static	Key *	head_keymap (void)
 {
@@ -658,7 +658,7 @@ void *	handle_keypress (void *lastp, Timespec pressed, uint32_t keyx, int quote_
 		add_timer(0, empty_string, 
 				get_int_var(KEY_INTERVAL_VAR) / 1000.0, 1,
 				do_input_timeouts, NULL, NULL, GENERAL_TIMER, 
-				-1, 0, 0);
+				-1, 0, 0, 0);
 
 	/*
 	 * If this node is NOT ambiguous, but it is not a terminal node
@@ -54,6 +54,8 @@ typedef struct	lastlog_stru
 	char	*msg;
 	struct	lastlog_stru	*older;
 	struct	lastlog_stru	*newer;
+	struct	lastlog_stru	*wolder;	/* Older item in this window */
+	struct	lastlog_stru	*wnewer;	/* Newer item in this window */
 	time_t	created;
 	time_t	expires;
 	int	visible;
@@ -66,16 +68,88 @@ typedef struct	lastlog_stru
 static	intmax_t global_lastlog_refnum = 0;
 	double	output_expires_after = 0.0;
 
-static int	show_lastlog (Lastlog **l, int *skip, int *number, Mask *level_mask, char *match, regex_t *rex, char *nomatch, regex_t *norex, int *max, const char *target, int mangler, int window, int exempt, char **, int, int);
+/*
+ * Every item is on the global lastlog (lastlog_oldest/lastlog_newest,
+ * through ->older and ->newer) and also on its window's lastlog (through
+ * ->wolder and ->wnewer), so things that only care about one window
+ * don't have to look at everybody else's items.  Both are in refnum
+ * order.  The window lastlogs are indexed by (internal) window refnum.
+ */
+typedef struct	window_lastlog_stru
+{
+	Lastlog *	oldest;
+	Lastlog *	newest;
+	int		visible;	/* How many items are visible */
+}	WindowLastlog;
+
+static	WindowLastlog *	window_lastlogs = NULL;
+static	int		window_lastlogs_max = 0;
+
+/*
+ * The lastlog index (/SET LASTLOG_INDEX) lets a search skip the lines 
+ * that can't possibly match without running the pattern or regex on them.
+ * The text index has a posting for each trigram (3 chars in a row, with
+ * case folded) that appears in any line, holding every item that has it.
+ * The target index has a posting for each target.  Postings are kept in
+ * refnum order, so new items go on the end and trimmed ones come off the 
+ * front.  All of this only exists while LASTLOG_INDEX is on.
+ */
+typedef struct	lastlog_posting_stru
+{
+	struct lastlog_posting_stru *next;	/* Next in the hash bucket */
+	uint32_t	trigram;		/* For the text index */
+	char *		target;			/* For the target index */
+	Lastlog **	items;			/* items[head] is the oldest */
+	int		head;
+	int		count;
+	int		max;
+}	LastlogPosting;
+
+#define LASTLOG_TEXT_BUCKETS	65536
+#define LASTLOG_TARGET_BUCKETS	1024
+
+static	LastlogPosting **	lastlog_text_index = NULL;
+static	LastlogPosting **	lastlog_target_index = NULL;
+static	unsigned char		lastlog_fold[256];
+
+/*
+ * A LastlogSearch is the set of items that might match a search, as
+ * told by the index.  If 'narrowed' is 0 the index couldn't help, and 
+ * every item might match.  Otherwise only the items whose refnums are 
+ * in 'refnums' (sorted) might match.  Refnums (and not pointers) are 
+ * kept so nothing goes bad if items are removed during a search.
+ */
+typedef struct	lastlog_search_stru
+{
+	LastlogPosting **lists;		/* Postings that all must be in */
+	int		nlists;
+	intmax_t *	targets;	/* Items with a matching target */
+	int		ntargets;
+	int		use_targets;
+	int		empty;		/* A trigram nobody has */
+	int		narrowed;
+	intmax_t *	refnums;
+	int		count;
+}	LastlogSearch;
+
+static int	show_lastlog (Lastlog **l, int *skip, int *number, Mask *level_mask, char *match, regex_t *rex, char *nomatch, regex_t *norex, int *max, const char *target, int mangler, int window, int exempt, char **, int, int, LastlogSearch *);
 static Lastlog *oldest_lastlog_for_window (int window);
 static Lastlog *newer_lastlog_entry (Lastlog *item, int window);
-#if 0
-static Lastlog *older_lastlog_entry (Lastlog *item, int window);
 static Lastlog *newest_lastlog_for_window (int window);
-#endif
 static void	remove_lastlog_item (Lastlog *item);
-static void	move_lastlog_item (Lastlog *item, int newwin);
 static void	expire_lastlog_entries (void);
+static WindowLastlog *get_window_lastlog (int window, int create);
+static void	link_window_lastlog_item (Lastlog *item, Lastlog *before);
+static void	unlink_window_lastlog_item (Lastlog *item);
+static void	index_lastlog_item (Lastlog *item);
+static void	unindex_lastlog_item (Lastlog *item);
+static void	lastlog_search_begin (LastlogSearch *s);
+static void	lastlog_search_pattern (LastlogSearch *s, const char *pattern);
+static void	lastlog_search_regex (LastlogSearch *s, const char *regex);
+static void	lastlog_search_target (LastlogSearch *s, const char *target);
+static void	lastlog_search_ready (LastlogSearch *s);
+static int	lastlog_search_maybe (LastlogSearch *s, Lastlog *item);
+static void	lastlog_search_end (LastlogSearch *s);
 
 Lastlog *	lastlog_oldest = NULL;
 Lastlog *	lastlog_newest = NULL;
@@ -212,14 +286,17 @@ intmax_t	add_to_lastlog (int window, const char *line)
 {
 	Lastlog *new_l;
 	Mask	mask;
+	intmax_t refnum;
 
 	window = get_window_refnum(window);
 
 	new_l = (Lastlog *)new_malloc(sizeof(Lastlog));
 	new_l->dead = 0;
-	new_l->refnum = global_lastlog_refnum++;
+	new_l->refnum = refnum = global_lastlog_refnum++;
 	new_l->older = lastlog_newest;
 	new_l->newer = NULL;
+	new_l->wolder = NULL;
+	new_l->wnewer = NULL;
 	new_l->level = get_who_level();
 	new_l->msg = malloc_strdup(line);
 	new_l->window = window;
@@ -234,7 +311,7 @@ intmax_t	add_to_lastlog (int window, const char *line)
 		new_l->expires = time(NULL) + output_expires_after;
 		add_timer(0, empty_string, output_expires_after, 1, 
 			  do_expire_lastlog_entries, NULL, NULL, 
-			  GENERAL_TIMER, -1, 0, 0);
+			  GENERAL_TIMER, -1, 0, 0, 1);
 	}
 	else
 		new_l->expires = 0;
@@ -252,19 +329,19 @@ intmax_t	add_to_lastlog (int window, const char *line)
 
 	memset(&mask, 0, sizeof(mask));
 	get_window_lastlog_mask(window, &mask);
-	if (mask_isset(&mask, new_l->level))
+	new_l->visible = mask_isset(&mask, new_l->level) ? 1 : 0;
+	new_l->needed = 1;
+	link_window_lastlog_item(new_l, NULL);
+	index_lastlog_item(new_l);
+
+	if (new_l->visible)
 	{
-		new_l->visible = 1;
 		set_window_lastlog_size_incr(window);
-		trim_lastlog(window);
+		trim_lastlog(window);		/* This might remove 'new_l'! */
 	}
-	else
-		new_l->visible = 0;
-
-	new_l->needed = 1;
 
 	/* * * */
-	return new_l->refnum;
+	return refnum;
 }
 
 /* 
@@ -336,20 +413,20 @@ void 	truncate_lastlog (int window)
  */
 void	dont_need_lastlog_item (int window, intmax_t item_refnum)
 {
-	Lastlog *item;
+	Lastlog *	item;
 
 	window = get_window_refnum(window);
 
-	item = oldest_lastlog_for_window(window);
-	while (item)
+	/* It's usually a recent one, so start at the newest */
+	for (item = newest_lastlog_for_window(window); 
+		item && item->refnum >= item_refnum; item = item->wolder)
 	{
-		Lastlog *next_item = newer_lastlog_entry(item, window);
-
 		if (item->refnum == item_refnum)
+		{
 			item->needed = 0;
-		item = next_item;
+			break;
+		}
 	}
-
 }
 
 /*
@@ -546,7 +623,9 @@ BUILT_IN_COMMAND(lastlog)
 	int		window;
 	int		this_server = 0;
 	int		global = 0;
+	LastlogSearch	search;
 
+	lastlog_search_begin(&search);
 	window = get_window_refnum(0);
 	lc = set_context(from_server, window, NULL, NULL, LEVEL_OTHER);
 	cnt = get_window_lastlog_size(window);
@@ -828,6 +907,21 @@ BUILT_IN_COMMAND(lastlog)
 		norex = &realnoreg;
 	}
 
+	/*
+	 * Ask the index which lines might match.  It knows nothing about
+	 * mangled lines, so -MANGLE can only be helped with -TARGET.
+	 */
+	if (!mangler)
+	{
+		if (match)
+			lastlog_search_pattern(&search, match);
+		if (regex)
+			lastlog_search_regex(&search, regex);
+	}
+	if (target)
+		lastlog_search_target(&search, target);
+	lastlog_search_ready(&search);
+
 	debug(DEBUG_LASTLOG, "Lastlog summary status:");
 	debug(DEBUG_LASTLOG, "Pattern: [%s]", match ? match : "<none>");
 	debug(DEBUG_LASTLOG, "Regex: [%s]", regex ? regex : "<none>");
@@ -938,7 +1032,7 @@ restart:
 		matching = show_lastlog(&l, &skip, &number, &level_mask, 
 					match, rex, nomatch, norex, &max, target, 
 					mangler, window, exempt, &result, 
-					global, this_server);
+					global, this_server, &search);
 
 		/* 
 		 * Now if the present entry "matches" and we are already in a context
@@ -1129,7 +1223,7 @@ restart2:
 		matching = show_lastlog(&l, &skip, &number, &level_mask, 
 					match, rex, nomatch, norex, &max, target, 
 					mangler, window, exempt, &result,
-					global, this_server);
+					global, this_server, &search);
 
 		/* 
 		 * Now if the present entry "matches" and we are already in a context
@@ -1277,6 +1371,7 @@ bail:
 		regfree(rex);
 	if (norex)
 		regfree(norex);
+	lastlog_search_end(&search);
 	set_window_lastlog_mask(0, save_mask);
 	pop_context(lc);
 	return;
@@ -1286,7 +1381,7 @@ bail:
  * This returns 1 if the current item pointed to by 'l' is something that
  * should be displayed based on the criteron provided.
  */
-static int	show_lastlog (Lastlog **l, int *skip, int *__U(number), Mask *level_mask, char *match, regex_t *rex, char *nomatch, regex_t *norex, int *max, const char *target, int mangler, int window, int exempt, char **result, int global, int this_server)
+static int	show_lastlog (Lastlog **l, int *skip, int *__U(number), Mask *level_mask, char *match, regex_t *rex, char *nomatch, regex_t *norex, int *max, const char *target, int mangler, int window, int exempt, char **result, int global, int this_server, LastlogSearch *search)
 {
 	const char *str = NULL;
 	int	retval = 1;
@@ -1331,6 +1426,17 @@ static int	show_lastlog (Lastlog **l, int *skip, int *__U(number), Mask *level_m
 			return 0;			/* Not of proper level */
 	}
 
+	if (!lastlog_search_maybe(search, *l))
+	{
+		debug(DEBUG_LASTLOG, "Line [%s] ruled out by the index", 
+					(*l)->msg);
+
+		if (exempt)
+			retval = 0;
+		else
+			return 0;			/* Can't match */
+	}
+
 	if (mangler)
 	{
 		char *	output, *rresult;
@@ -1417,9 +1523,9 @@ void	reconstitute_scrollback (int window)
 {
 	Lastlog *li;
 
-	for (li = lastlog_oldest; li; li = li->newer)
+	for (li = oldest_lastlog_for_window(window); li; li = li->wnewer)
 	{
-	    if (li->window == window && li->needed)
+	    if (li->needed)
 	    {
 		debuglog("reconstitute_scrollback: YES window %d (%d) refnum %ld msg %s", li->window, window, li->refnum, li->msg);
 		add_to_window_scrollback(window, li->msg, li->refnum);
@@ -1475,29 +1581,16 @@ BUILT_IN_FUNCTION(function_line, word)
 		RETURN_EMPTY;
 
 	/* Get the line from the lastlog */
-	for (start_pos = lastlog_newest; line > 0; start_pos = start_pos->older)
+	for (start_pos = newest_lastlog_for_window(win); start_pos; 
+					start_pos = start_pos->wolder)
 	{
-		if (start_pos->window != win)
-			continue;
-		if (start_pos->visible)
-			line--;
+		if (start_pos->visible && --line == 0)
+			break;
 	}
 
-	if (!start_pos)
-		start_pos = lastlog_oldest;
-	else
-		start_pos = start_pos->newer;
-
-	while ((start_pos->visible == 0 || start_pos->window != win) && 
-				start_pos->newer)
-		start_pos = start_pos->newer;
-
-#if 0
-	/* XXX CPPCHECK - Checking for something is probably correct, but not 'start_pos' */
 	/* If there are no visible lastlog items, punt */
 	if (!start_pos)
 		RETURN_EMPTY;
-#endif
 
 	malloc_strcat(&retval, start_pos->msg);
 
@@ -1526,6 +1619,7 @@ BUILT_IN_FUNCTION(function_lastlog, word)
 	Mask	lastlog_levels;
 	int	line = 1;
 	char *	rejects = NULL;
+	LastlogSearch	search;
 
 	GET_FUNC_ARG(windesc, word);
 	GET_DWORD_ARG(pattern, word);
@@ -1536,18 +1630,22 @@ BUILT_IN_FUNCTION(function_lastlog, word)
 	if ((win = lookup_window(windesc)) < 1)
 		RETURN_EMPTY;
 
-	for (iter = lastlog_newest; iter; iter = iter->older)
+	lastlog_search_begin(&search);
+	lastlog_search_pattern(&search, pattern);
+	lastlog_search_ready(&search);
+
+	for (iter = newest_lastlog_for_window(win); iter; iter = iter->wolder)
 	{
-		if (iter->window != win)
-			continue;
 		if (iter->visible == 0)
 			continue;
 
 		if (mask_isset(&lastlog_levels, iter->level))
-		    if (wild_match(pattern, iter->msg))
+		    if (lastlog_search_maybe(&search, iter) &&
+					wild_match(pattern, iter->msg))
 			malloc_strcat_word(&retval, space, ltoa(line), DWORD_NO);
 		line++;
 	}
+	lastlog_search_end(&search);
 
 	if (retval)
 		return retval;
@@ -1555,6 +1653,48 @@ BUILT_IN_FUNCTION(function_lastlog, word)
 	RETURN_EMPTY;
 }
 
+/*
+ * walk_window_lastlog: Call 'func' for lines 'start' through 
+ * 'start + count - 1' of a window's lastlog, oldest first.  Lines are 
+ * numbered the same as $line(): 1 is the newest visible line.  If 'count' 
+ * is negative, it goes back to the oldest line.  Each line is passed with 
+ * its refnum, its level, its target, its text and when it was created.
+ * Returns how many lines were passed, or -1 if 'window' is no good.
+ */
+int	walk_window_lastlog (int window, int start, int count, void (*func) (void *, intmax_t, const char *, const char *, const char *, time_t), void *data)
+{
+	Lastlog *iter, *oldest = NULL;
+	int	line = 0, last, passed = 0;
+
+	if (!window_is_valid(window))
+		return -1;
+	if (start < 1)
+		start = 1;
+	last = count < 0 ? INT_MAX : start + count - 1;
+
+	/* Find the oldest line they want... */
+	for (iter = newest_lastlog_for_window(window); iter && line < last; 
+						iter = iter->wolder)
+	{
+		if (iter->visible == 0)
+			continue;
+		if (++line >= start)
+			oldest = iter;
+	}
+
+	/* ... and work forward to the newest one they want */
+	for (iter = oldest; iter && line >= start; iter = iter->wnewer)
+	{
+		if (iter->visible == 0)
+			continue;
+		func(data, iter->refnum, level_to_str(iter->level), 
+				iter->target, iter->msg, iter->created);
+		passed++;
+		line--;
+	}
+	return passed;
+}
+
 
 #if 0
 /*
@@ -1631,53 +1771,125 @@ BUILT_IN_FUNCTION(function_lastlogctl, input)
 
 /************************************************************************/
 
-static Lastlog *oldest_lastlog_for_window (int window)
+/*
+ * get_window_lastlog: The lastlog chain for window 'window'.  If it doesn't
+ * have one yet, it gets one if 'create' is 1, otherwise you get NULL.
+ */
+static WindowLastlog *get_window_lastlog (int window, int create)
 {
-	return newer_lastlog_entry(NULL, window);
+	int	i;
+
+	if (window < 0)
+		return NULL;
+
+	if (window >= window_lastlogs_max)
+	{
+		if (!create)
+			return NULL;
+
+		i = window_lastlogs_max;
+		window_lastlogs_max = window + 1;
+		RESIZE(window_lastlogs, WindowLastlog, window_lastlogs_max);
+		for (; i < window_lastlogs_max; i++)
+		{
+			window_lastlogs[i].oldest = NULL;
+			window_lastlogs[i].newest = NULL;
+			window_lastlogs[i].visible = 0;
+		}
+	}
+
+	return &window_lastlogs[window];
 }
 
-static Lastlog *newer_lastlog_entry (Lastlog *item, int window)
+/*
+ * link_window_lastlog_item: Put 'item' on its window's lastlog, just 
+ * before (older than) 'before', which must be in that window's lastlog.
+ * If 'before' is NULL, 'item' becomes the newest item in the window.
+ */
+static void	link_window_lastlog_item (Lastlog *item, Lastlog *before)
 {
-	Lastlog *i;
+	WindowLastlog *	wl;
 
-	i = item ? item->newer : lastlog_oldest;
+	if (!(wl = get_window_lastlog(item->window, 1)))
+		return;
 
-	while (i && i->window != window)
-		i = i->newer;
+	item->wnewer = before;
+	if (before)
+	{
+		item->wolder = before->wolder;
+		before->wolder = item;
+	}
+	else
+	{
+		item->wolder = wl->newest;
+		wl->newest = item;
+	}
+
+	if (item->wolder)
+		item->wolder->wnewer = item;
+	else
+		wl->oldest = item;
 
-	return i;
+	if (item->visible)
+		wl->visible++;
 }
 
-/* Apparently I do not yet have a use case for this yet */
-#if 0
-static Lastlog *older_lastlog_entry (Lastlog *item, int window)
+/* unlink_window_lastlog_item: Take 'item' off of its window's lastlog */
+static void	unlink_window_lastlog_item (Lastlog *item)
 {
-	Lastlog *i;
+	WindowLastlog *	wl;
+
+	if (!(wl = get_window_lastlog(item->window, 0)))
+		return;
+
+	if (item->wolder)
+		item->wolder->wnewer = item->wnewer;
+	else
+		wl->oldest = item->wnewer;
+
+	if (item->wnewer)
+		item->wnewer->wolder = item->wolder;
+	else
+		wl->newest = item->wolder;
+
+	item->wolder = item->wnewer = NULL;
+
+	if (item->visible)
+		wl->visible--;
+}
 
-	i = item ? item->older : lastlog_newest;
+static Lastlog *oldest_lastlog_for_window (int window)
+{
+	WindowLastlog *	wl;
 
-	while (i && i->window != window)
-		i = i->older;
+	if (!(wl = get_window_lastlog(window, 0)))
+		return NULL;
+	return wl->oldest;
+}
 
-	return i;
+static Lastlog *newer_lastlog_entry (Lastlog *item, int window)
+{
+	if (!item)
+		return oldest_lastlog_for_window(window);
+	return item->wnewer;
 }
 
 static Lastlog *newest_lastlog_for_window (int window)
 {
-	return older_lastlog_entry(NULL, window);
+	WindowLastlog *	wl;
+
+	if (!(wl = get_window_lastlog(window, 0)))
+		return NULL;
+	return wl->newest;
 }
-#endif
 
 int	recount_window_lastlog (int window)
 {
-	Lastlog *i;
-	int	count = 0;
-
-	for (i = lastlog_oldest; i; i = i->newer)
-		if (i->window == window && i->visible)
-			count++;
+	WindowLastlog *	wl;
 
-	return count;
+	if (!(wl = get_window_lastlog(window, 0)))
+		return 0;
+	return wl->visible;
 }
 
 static void	remove_lastlog_item (Lastlog *item)
@@ -1726,6 +1938,8 @@ static void	remove_lastlog_item (Lastlog *item)
 	if (item->newer)
 		item->newer->older = item->older;
 	item->newer = item->older = NULL;
+	unlink_window_lastlog_item(item);
+	unindex_lastlog_item(item);
 
 	item->dead = 1;
 	new_free((char **)&item->msg);
@@ -1734,68 +1948,695 @@ static void	remove_lastlog_item (Lastlog *item)
 }
 
 /***************************************************************************/
-static void	move_lastlog_item (Lastlog *item, int newwin)
+/*
+ * set_lastlog_index: called whenever a "SET LASTLOG_INDEX" is done.
+ * Turning it on indexes every item already in the lastlog; turning it 
+ * off throws the whole index away.
+ */
+void	set_lastlog_index (void *stuff)
 {
-	int	oldwin = item->window;
+	VARIABLE *	v;
+	Lastlog *	item;
+	LastlogPosting *p;
+	int		i, c;
 
-	item->window = newwin;
-	if (item->visible)
+	v = stuff;
+
+	if (v->integer && !lastlog_text_index)
 	{
-		set_window_lastlog_size_decr(oldwin);
-		set_window_lastlog_size_incr(newwin);
+		/* Fold the same way wild_match() does.  High bytes all look alike. */
+		for (i = 0; i < 256; i++)
+		{
+			c = tolower(i);
+			lastlog_fold[i] = (i >= 0x80 || c >= 0x80) ? 0x80 : c;
+		}
+
+		lastlog_text_index = (LastlogPosting **)new_malloc(
+			sizeof(LastlogPosting *) * LASTLOG_TEXT_BUCKETS);
+		lastlog_target_index = (LastlogPosting **)new_malloc(
+			sizeof(LastlogPosting *) * LASTLOG_TARGET_BUCKETS);
+		for (i = 0; i < LASTLOG_TEXT_BUCKETS; i++)
+			lastlog_text_index[i] = NULL;
+		for (i = 0; i < LASTLOG_TARGET_BUCKETS; i++)
+			lastlog_target_index[i] = NULL;
+
+		for (item = lastlog_oldest; item; item = item->newer)
+			index_lastlog_item(item);
 	}
+	else if (!v->integer && lastlog_text_index)
+	{
+		for (i = 0; i < LASTLOG_TEXT_BUCKETS; i++)
+		{
+			while ((p = lastlog_text_index[i]))
+			{
+				lastlog_text_index[i] = p->next;
+				new_free((char **)&p->items);
+				new_free((char **)&p);
+			}
+		}
+		for (i = 0; i < LASTLOG_TARGET_BUCKETS; i++)
+		{
+			while ((p = lastlog_target_index[i]))
+			{
+				lastlog_target_index[i] = p->next;
+				new_free(&p->target);
+				new_free((char **)&p->items);
+				new_free((char **)&p);
+			}
+		}
+		new_free((char **)&lastlog_text_index);
+		new_free((char **)&lastlog_target_index);
+	}
+}
 
-	window_scrollback_needs_rebuild(oldwin);
-	window_scrollback_needs_rebuild(newwin);
+static uint32_t	trigram_bucket (uint32_t trigram)
+{
+	return (trigram * 2654435761U) >> 16 & (LASTLOG_TEXT_BUCKETS - 1);
 }
 
-void	move_all_lastlog (int oldwin, int newwin)
+static int	trigram_cmp (const void *a, const void *b)
+{
+	uint32_t	x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * lastlog_trigrams: Every different trigram in 'str', folded, in order.
+ * Returns how many there are; you must new_free() '*trigrams'.
+ */
+static int	lastlog_trigrams (const char *str, uint32_t **trigrams)
+{
+	const unsigned char *	s = (const unsigned char *)str;
+	uint32_t *t;
+	int	count = 0, i, j;
+
+	*trigrams = NULL;
+	if (strlen(str) < 3)
+		return 0;
+
+	t = (uint32_t *)new_malloc(sizeof(uint32_t) * (strlen(str) - 2));
+	for (; s[0] && s[1] && s[2]; s++)
+		t[count++] = (uint32_t)lastlog_fold[s[0]] << 16 | 
+			     (uint32_t)lastlog_fold[s[1]] << 8 | 
+			     lastlog_fold[s[2]];
+
+	qsort(t, count, sizeof(uint32_t), trigram_cmp);
+	for (i = j = 1; i < count; i++)
+		if (t[i] != t[j - 1])
+			t[j++] = t[i];
+
+	*trigrams = t;
+	return j;
+}
+
+static LastlogPosting *	find_text_posting (uint32_t trigram, int create)
+{
+	LastlogPosting **bucket, *p;
+
+	bucket = &lastlog_text_index[trigram_bucket(trigram)];
+	for (p = *bucket; p; p = p->next)
+		if (p->trigram == trigram)
+			return p;
+
+	if (!create)
+		return NULL;
+
+	p = (LastlogPosting *)new_malloc(sizeof(LastlogPosting));
+	p->trigram = trigram;
+	p->target = NULL;
+	p->items = NULL;
+	p->head = p->count = p->max = 0;
+	p->next = *bucket;
+	*bucket = p;
+	return p;
+}
+
+static LastlogPosting *	find_target_posting (const char *target, int create)
+{
+	LastlogPosting **bucket, *p;
+
+	bucket = &lastlog_target_index[server_strhash(target) & 
+					(LASTLOG_TARGET_BUCKETS - 1)];
+	for (p = *bucket; p; p = p->next)
+		if (!strcmp(p->target, target))
+			return p;
+
+	if (!create)
+		return NULL;
+
+	p = (LastlogPosting *)new_malloc(sizeof(LastlogPosting));
+	p->trigram = 0;
+	p->target = malloc_strdup(target);
+	p->items = NULL;
+	p->head = p->count = p->max = 0;
+	p->next = *bucket;
+	*bucket = p;
+	return p;
+}
+
+/*
+ * Where 'refnum' is in posting 'p', or -1.  Only live items are ever in 
+ * a posting, so it's ok to look at them.
+ */
+static int	posting_find (LastlogPosting *p, intmax_t refnum)
 {
-	Lastlog *l;
+	int	lo = p->head, hi = p->head + p->count - 1, mid;
 
-	for (l = lastlog_oldest; l; l = l->newer)
+	while (lo <= hi)
 	{
-		if (l->window == oldwin)
-			move_lastlog_item(l, newwin);
+		mid = lo + (hi - lo) / 2;
+		if (p->items[mid]->refnum == refnum)
+			return mid;
+		else if (p->items[mid]->refnum < refnum)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
 	}
+	return -1;
 }
 
-void	move_lastlog_item_by_string (int oldwin, int newwin, const char *str)
+/* New items always have the biggest refnum, so they go on the end */
+static void	posting_append (LastlogPosting *p, Lastlog *item)
 {
-	Lastlog *l;
+	if (p->head + p->count == p->max)
+	{
+		if (p->head > p->count)
+		{
+			memmove(p->items, p->items + p->head, 
+					sizeof(Lastlog *) * p->count);
+			p->head = 0;
+		}
+		else
+		{
+			p->max = p->max ? p->max * 2 : 4;
+			RESIZE(p->items, Lastlog *, p->max);
+		}
+	}
+	p->items[p->head + p->count++] = item;
+}
 
-	for (l = lastlog_oldest; l; l = l->newer)
+/*
+ * Take 'item' out of posting 'p'.  Returns 1 if 'p' is empty now.
+ * Trimmed items are the oldest, and come off the front for free.
+ */
+static int	posting_remove (LastlogPosting *p, Lastlog *item)
+{
+	int	i;
+
+	if ((i = posting_find(p, item->refnum)) < 0)
+		return 0;
+
+	if (i - p->head < p->head + p->count - 1 - i)
 	{
-		if (l->window == oldwin && stristr(l->msg, str) >= 0)
-			move_lastlog_item(l, newwin);
+		memmove(p->items + p->head + 1, p->items + p->head, 
+				sizeof(Lastlog *) * (i - p->head));
+		p->head++;
 	}
+	else
+		memmove(p->items + i, p->items + i + 1, 
+			sizeof(Lastlog *) * (p->head + p->count - 1 - i));
+	p->count--;
+	return p->count == 0;
 }
 
-void	move_lastlog_item_by_target (int oldwin, int newwin, const char *str)
+static void	free_posting (LastlogPosting **bucket, LastlogPosting *p)
+{
+	for (; *bucket; bucket = &(*bucket)->next)
+	{
+		if (*bucket == p)
+		{
+			*bucket = p->next;
+			break;
+		}
+	}
+	new_free(&p->target);
+	new_free((char **)&p->items);
+	new_free((char **)&p);
+}
+
+static void	index_lastlog_item (Lastlog *item)
+{
+	uint32_t *trigrams;
+	int	i, count;
+
+	if (!lastlog_text_index)
+		return;
+
+	count = lastlog_trigrams(item->msg, &trigrams);
+	for (i = 0; i < count; i++)
+		posting_append(find_text_posting(trigrams[i], 1), item);
+	new_free((char **)&trigrams);
+
+	if (item->target)
+		posting_append(find_target_posting(item->target, 1), item);
+}
+
+static void	unindex_lastlog_item (Lastlog *item)
 {
-	Lastlog *l;
+	uint32_t *	trigrams;
+	int		i, count;
+	LastlogPosting *p;
 
-	for (l = lastlog_oldest; l; l = l->newer)
+	if (!lastlog_text_index)
+		return;
+
+	count = lastlog_trigrams(item->msg, &trigrams);
+	for (i = 0; i < count; i++)
 	{
-		if (l->window == oldwin && !my_stricmp(l->target, str))
-			move_lastlog_item(l, newwin);
+		if ((p = find_text_posting(trigrams[i], 0)) && 
+				posting_remove(p, item))
+			free_posting(&lastlog_text_index[trigram_bucket(p->trigram)], p);
 	}
+	new_free((char **)&trigrams);
+
+	if (item->target && (p = find_target_posting(item->target, 0)) &&
+			posting_remove(p, item))
+		free_posting(&lastlog_target_index[server_strhash(item->target) & 
+					(LASTLOG_TARGET_BUCKETS - 1)], p);
 }
 
-void	move_lastlog_item_by_level (int oldwin, int newwin, Mask *levels)
+/*
+ * The lastlog search.  You lastlog_search_begin(), then tell it about
+ * the pattern, regex and target the lines must match, then call
+ * lastlog_search_ready().  After that, lastlog_search_maybe() tells you
+ * if a line could match (you still have to check it).  
+ * lastlog_search_end() cleans up.
+ */
+static void	lastlog_search_begin (LastlogSearch *s)
+{
+	s->lists = NULL;
+	s->nlists = 0;
+	s->targets = NULL;
+	s->ntargets = 0;
+	s->use_targets = 0;
+	s->empty = 0;
+	s->narrowed = 0;
+	s->refnums = NULL;
+	s->count = 0;
+}
+
+/* The line must have every trigram in 'run' (which is 'len' chars) */
+static void	lastlog_search_run (LastlogSearch *s, const char *run, size_t len)
+{
+	char *		str;
+	uint32_t *	trigrams;
+	int		i, count;
+	LastlogPosting *p;
+
+	if (len < 3)
+		return;
+
+	str = alloca(len + 1);
+	memcpy(str, run, len);
+	str[len] = 0;
+
+	count = lastlog_trigrams(str, &trigrams);
+	for (i = 0; i < count; i++)
+	{
+		if (!(p = find_text_posting(trigrams[i], 0)))
+			s->empty = 1;
+		else
+		{
+			RESIZE(s->lists, LastlogPosting *, s->nlists + 1);
+			s->lists[s->nlists++] = p;
+		}
+	}
+	new_free((char **)&trigrams);
+}
+
+/*
+ * A line that wild_match()es 'pattern' must have every run of regular 
+ * chars in 'pattern' in it somewhere.  Don't bother with \[...\] 
+ */
+static void	lastlog_search_pattern (LastlogSearch *s, const char *pattern)
+{
+	char *	run;
+	size_t	len = 0;
+
+	if (!lastlog_text_index || !pattern || strstr(pattern, "\\["))
+		return;
+
+	run = alloca(strlen(pattern) + 1);
+	for (; *pattern; pattern++)
+	{
+		if (*pattern == '*' || *pattern == '%' || *pattern == '?')
+		{
+			lastlog_search_run(s, run, len);
+			len = 0;
+			continue;
+		}
+		if (*pattern == '\\' && !*++pattern)
+			break;
+		run[len++] = *pattern;
+	}
+	lastlog_search_run(s, run, len);
+}
+
+/*
+ * A line that regexec()s 'regex' (extended, ignoring case) has to have 
+ * every run of plain chars that isn't optional.  This only picks out the
+ * easy runs -- anything in a group, a bracket, or next to a quantifier 
+ * is left out.  With a | anywhere, nothing has to be in the line.  Letters
+ * that might match something other than themselves ignoring case (like
+ * the Kelvin sign and 'k') and non-ascii chars are left out too.
+ */
+/* Skip from the [ that starts a bracket expression to the ] that ends it */
+static const char *	skip_bracket (const char *p)
+{
+	p++;
+	if (*p == '^')
+		p++;
+	if (*p == ']')
+		p++;
+	for (; *p && *p != ']'; p++)
+	{
+		if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '='))
+		{
+			char	end = p[1];
+
+			for (p += 2; *p && !(*p == end && p[1] == ']'); p++)
+				;
+			if (!*p)
+				break;
+			p++;
+		}
+	}
+	return p;
+}
+
+static void	lastlog_search_regex (LastlogSearch *s, const char *regex)
+{
+	char *	run;
+	size_t	len = 0;
+	int	literal = 0, depth;
+	const char *p;
+	char	c;
+
+	if (!lastlog_text_index || !regex || strchr(regex, '|'))
+		return;
+
+	run = alloca(strlen(regex) + 1);
+	for (p = regex; *p; p++)
+	{
+		c = *p;
+		if (c == '*' || c == '?' || c == '{')
+		{
+			if (literal)
+				len--;		/* That char was optional */
+			if (c == '{')
+				while (p[1] && *p != '}')
+					p++;
+		}
+		else if (c == '[')
+		{
+			if (!*(p = skip_bracket(p)))
+				break;
+		}
+		else if (c == '(')
+		{
+			for (depth = 1; depth && p[1]; )
+			{
+				p++;
+				if (*p == '\\' && p[1])
+					p++;
+				else if (*p == '[' && !*(p = skip_bracket(p)))
+					break;
+				else if (*p == '(')
+					depth++;
+				else if (*p == ')')
+					depth--;
+			}
+			if (!*p)
+				break;
+		}
+		else if (c == '\\' && p[1] && !isalnum((unsigned char)p[1]) &&
+			 (unsigned char)p[1] < 0x80)
+		{
+			run[len++] = *++p;
+			literal = 1;
+			continue;
+		}
+		else if (c == '\\')
+		{
+			if (p[1])
+				p++;
+		}
+		else if (c == '+' || c == '.' || c == '^' || c == '$' || 
+			 c == ')' || (unsigned char)c >= 0x80 || 
+			 strchr("iksIKS", c))
+			;
+		else
+		{
+			run[len++] = c;
+			literal = 1;
+			continue;
+		}
+
+		/* Anything else ends the run */
+		lastlog_search_run(s, run, len);
+		len = 0;
+		literal = 0;
+	}
+	lastlog_search_run(s, run, len);
+}
+
+static int	refnum_cmp (const void *a, const void *b)
+{
+	intmax_t	x = *(const intmax_t *)a, y = *(const intmax_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * The line's target must wild_match() 'target'.  There aren't that many
+ * different targets, so just try them all.
+ */
+static void	lastlog_search_target (LastlogSearch *s, const char *target)
 {
-	Lastlog *l;
+	LastlogPosting *p;
+	int		i, j;
 
-	for (l = lastlog_oldest; l; l = l->newer)
+	if (!lastlog_target_index || !target)
+		return;
+
+	s->use_targets = 1;
+	for (i = 0; i < LASTLOG_TARGET_BUCKETS; i++)
 	{
-		if (l->window == oldwin && mask_isset(levels, l->level))
-			move_lastlog_item(l, newwin);
+		for (p = lastlog_target_index[i]; p; p = p->next)
+		{
+			if (!wild_match(target, p->target))
+				continue;
+
+			RESIZE(s->targets, intmax_t, s->ntargets + p->count);
+			for (j = 0; j < p->count; j++)
+				s->targets[s->ntargets++] = p->items[p->head + j]->refnum;
+		}
 	}
+	qsort(s->targets, s->ntargets, sizeof(intmax_t), refnum_cmp);
+}
+
+static int	posting_count_cmp (const void *a, const void *b)
+{
+	const LastlogPosting *x = *(const LastlogPosting * const *)a;
+	const LastlogPosting *y = *(const LastlogPosting * const *)b;
+
+	return x->count - y->count;
+}
+
+/*
+ * Work out which items are in all of the postings (and have a matching
+ * target).  Start with the smallest set, and look up each of those in
+ * the others, so the big postings don't cost much.
+ */
+static void	lastlog_search_ready (LastlogSearch *s)
+{
+	intmax_t	r;
+	int		i, j, k, l, lo, hi, mid, found;
+
+	if (!s->nlists && !s->use_targets && !s->empty)
+		return;
+
+	s->narrowed = 1;
+	if (s->empty)
+		return;
+
+	qsort(s->lists, s->nlists, sizeof(LastlogPosting *), posting_count_cmp);
+	if (s->use_targets && (!s->nlists || s->ntargets <= s->lists[0]->count))
+	{
+		s->refnums = s->targets;
+		s->count = s->ntargets;
+		s->targets = NULL;
+		s->use_targets = 0;
+		i = 0;
+	}
+	else
+	{
+		s->count = s->lists[0]->count;
+		s->refnums = (intmax_t *)new_malloc(sizeof(intmax_t) * (s->count + 1));
+		for (j = 0; j < s->count; j++)
+			s->refnums[j] = s->lists[0]->items[s->lists[0]->head + j]->refnum;
+		i = 1;
+	}
+
+	for (j = k = 0; j < s->count; j++)
+	{
+		r = s->refnums[j];
+		found = 1;
+		for (l = i; found && l < s->nlists; l++)
+			found = posting_find(s->lists[l], r) >= 0;
+
+		if (found && s->use_targets)
+		{
+			for (found = 0, lo = 0, hi = s->ntargets - 1; !found && lo <= hi; )
+			{
+				mid = lo + (hi - lo) / 2;
+				if (s->targets[mid] == r)
+					found = 1;
+				else if (s->targets[mid] < r)
+					lo = mid + 1;
+				else
+					hi = mid - 1;
+			}
+		}
+
+		if (found)
+			s->refnums[k++] = r;
+	}
+	s->count = k;
+}
+
+static int	lastlog_search_maybe (LastlogSearch *s, Lastlog *item)
+{
+	int	lo, hi, mid;
+
+	if (!s->narrowed)
+		return 1;
+
+	for (lo = 0, hi = s->count - 1; lo <= hi; )
+	{
+		mid = lo + (hi - lo) / 2;
+		if (s->refnums[mid] == item->refnum)
+			return 1;
+		else if (s->refnums[mid] < item->refnum)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return 0;
+}
+
+static void	lastlog_search_end (LastlogSearch *s)
+{
+	new_free((char **)&s->lists);
+	new_free((char **)&s->targets);
+	new_free((char **)&s->refnums);
+}
+
+/***************************************************************************/
+/*
+ * move_lastlog_items: Move every item in 'oldwin's lastlog that 'test' 
+ * likes over to 'newwin'.  The items that move are taken off 'oldwin's 
+ * lastlog in order, and then merged into 'newwin's lastlog in one pass, 
+ * so this only looks at the items in those two windows.
+ */
+static void	move_lastlog_items (int oldwin, int newwin, int (*test) (Lastlog *, const void *), const void *data)
+{
+	Lastlog *	item, *next;
+	Lastlog *	moving = NULL, *moving_last = NULL;
+	Lastlog *	before;
+
+	for (item = oldest_lastlog_for_window(oldwin); item; item = next)
+	{
+		next = item->wnewer;
+		if (!test(item, data))
+			continue;
+
+		if (oldwin == newwin)
+		{
+			window_scrollback_needs_rebuild(oldwin);
+			continue;
+		}
+
+		/* Keep them in order on 'moving' (chained through ->wnewer) */
+		unlink_window_lastlog_item(item);
+		if (moving_last)
+			moving_last->wnewer = item;
+		else
+			moving = item;
+		moving_last = item;
+
+		if (item->visible)
+		{
+			set_window_lastlog_size_decr(oldwin);
+			set_window_lastlog_size_incr(newwin);
+		}
+	}
+
+	if (!moving)
+		return;
+
+	before = oldest_lastlog_for_window(newwin);
+	for (item = moving; item; item = next)
+	{
+		next = item->wnewer;
+		while (before && before->refnum < item->refnum)
+			before = before->wnewer;
+		item->window = newwin;
+		link_window_lastlog_item(item, before);
+	}
+
+	window_scrollback_needs_rebuild(oldwin);
+	window_scrollback_needs_rebuild(newwin);
+}
+
+static int	lastlog_item_any (Lastlog *__U(item), const void *__U(data))
+{
+	return 1;
+}
+
+static int	lastlog_item_has_string (Lastlog *item, const void *data)
+{
+	return stristr(item->msg, (const char *)data) >= 0;
+}
+
+static int	lastlog_item_has_target (Lastlog *item, const void *data)
+{
+	return !my_stricmp(item->target, (const char *)data);
+}
+
+static int	lastlog_item_has_level (Lastlog *item, const void *data)
+{
+	return mask_isset((Mask *)data, item->level);
+}
+
+static int	lastlog_item_has_regex (Lastlog *item, const void *data)
+{
+	return !regexec((const regex_t *)data, item->msg, 0, NULL, 0);
+}
+
+void	move_all_lastlog (int oldwin, int newwin)
+{
+	move_lastlog_items(oldwin, newwin, lastlog_item_any, NULL);
+}
+
+void	move_lastlog_item_by_string (int oldwin, int newwin, const char *str)
+{
+	move_lastlog_items(oldwin, newwin, lastlog_item_has_string, str);
+}
+
+void	move_lastlog_item_by_target (int oldwin, int newwin, const char *str)
+{
+	move_lastlog_items(oldwin, newwin, lastlog_item_has_target, str);
+}
+
+void	move_lastlog_item_by_level (int oldwin, int newwin, Mask *levels)
+{
+	move_lastlog_items(oldwin, newwin, lastlog_item_has_level, levels);
 }
 
 void	move_lastlog_item_by_regex (int oldwin, int newwin, const char *str)
 {
-	Lastlog *l;
 	regex_t preg;
 	int	errcode;
 
@@ -1811,12 +2652,7 @@ void	move_lastlog_item_by_regex (int oldwin, int newwin, const char *str)
 		return;
 	}
 
-	for (l = lastlog_oldest; l; l = l->newer)
-	{
-		if (l->window == oldwin && !regexec(&preg, l->msg, 0, NULL, 0))
-			move_lastlog_item(l, newwin);
-	}
-
+	move_lastlog_items(oldwin, newwin, lastlog_item_has_regex, &preg);
 	regfree(&preg);
 }
 
@@ -1829,18 +2665,17 @@ int	do_expire_lastlog_entries (void *__U(ignored))
 
 static void	expire_lastlog_entries (void)
 {
-	Lastlog *l;
+	Lastlog *l, *next;
 	time_t	nowtime;
 
 	time(&nowtime);
-	for (l = lastlog_oldest; l; l = l->newer)
+	for (l = lastlog_oldest; l; l = next)
 	{
+		next = l->newer;
 		if (l->expires > 0 && l->expires <= nowtime) 
 		{
 			window_scrollback_needs_rebuild(l->window);
 			remove_lastlog_item(l);
-			if (!(l = lastlog_oldest))	/* Start over */
-				break;
 		}
 	}
 }
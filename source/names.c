@@ -46,16 +46,51 @@
 #include "hook.h"
 #include "parse.h"
 
+struct	channel_stru;
+struct	user_stru;
+
+/*
+ * A Nick is one person on one channel.  Everything about the person that
+ * isn't about the channel (their nick, userhost, and so on) is in their
+ * User, which all of their Nicks share.  What's left is a few bits:
+ */
+#define NICK_CHANOP	0x01	/* They are a channel operator */
+#define NICK_HALFOP	0x02	/* They are a halfop */
+#define NICK_HALFOP_UK	0x04	/* They might be a halfop (we don't know) */
+#define NICK_VOICE	0x08	/* They are voiced */
+#define NICK_VOICE_UK	0x10	/* They might be voiced (we don't know) */
+#define NICK_SUSPICIOUS	0x20	/* Their nick might be truncated */
+
 typedef struct nick_stru
 {
-	char *		nick;		/* nickname of person on channel */
-	char *		userhost;	/* Their userhost, if we know it */
-	short		suspicious;	/* True if the nick might be truncated */
-	short		chanop;		/* True if they are a channel operator */
-	short		voice;		/* 1 if they are, 0 if theyre not, -1 if uk */
-	short		half_assed;	/* 1 if they are, 0 if theyre not, -1 if uk */
+struct	user_stru *	user;		/* Who this is */
+struct	channel_stru *	channel;	/* The channel this is for */
+	unsigned char	modes;		/* NICK_* bits */
 }	Nick;
 
+/*
+ * A User is everything on one server that has the same nick, that is, all
+ * the channels that a person is on.  When someone QUITs or changes their
+ * nick, we only have to look at the channels they're actually on.
+ * 'member' is kept with the newest channel first (the same order as the 
+ * channel list) so what_channel() and walk_channels() don't change.
+ * There's only ever one copy of their nick and userhost, no matter how
+ * many of your channels they're on.
+ */
+typedef struct user_stru
+{
+	char *		nick;		/* As we last saw it */
+	char *		userhost;	/* Their userhost, if we know it */
+	char *		account;	/* Their services account, if we know it */
+	int		away;		/* 1 if they are, 0 if theyre not, -1 if uk */
+	int		server;
+	uint32_t	hashval;	/* server_strhash(nick) */
+struct	user_stru *	hnext;		/* Next user in the hash bucket */
+	Nick **		member;		/* One for each channel they're on */
+	int		members;
+	int		members_max;
+}	User;
+
 static	int	current_channel_counter = 0;
 
 /* ChannelList: structure for the list of channels you are current on */
@@ -82,13 +117,56 @@ struct	channel_stru *	prev;		/* pointer to previous channel */
 	char		voice;		/* true if i'm a channel voice */
 	char		half_assed;	/* true if i'm a channel helper */
 	Timespec	join_time;	/* When we joined the channel */
+
+	uint32_t	hashval;	/* server_strhash(channel) */
+struct	channel_stru *	hnext;		/* Next channel in the hash bucket */
+	unsigned long	serial;		/* Newer channels have bigger ones */
 }	Channel;
 
 
 /* channel_list: list of all the channels you are currently on */
 static	Channel *	channel_list = NULL;
 
+/*
+ * Each server also has a hash table of its channels, so find_channel() 
+ * doesn't have to look at every channel on every server.  The buckets are
+ * chained through Channel->hnext.  The hash is server_strhash(), so it
+ * doesn't matter what CASEMAPPING the server says later on.
+ */
+typedef struct channel_table_stru
+{
+	Channel **	bucket;
+	int		size;		/* Always a power of two */
+	int		count;
+}	ChannelTable;
+
+static	ChannelTable *	channel_tables = NULL;
+static	int		channel_tables_max = 0;
+static	unsigned long	channel_serial = 0;
+
+/* And each server has a table of Users, which works the same way */
+typedef struct user_table_stru
+{
+	User **		bucket;
+	int		size;		/* Always a power of two */
+	int		count;
+}	UserTable;
+
+static	UserTable *	user_tables = NULL;
+static	int		user_tables_max = 0;
+
+static	void	hash_channel (Channel *chan);
+static	void	unhash_channel (Channel *chan);
+static	User *	find_user (int server, const char *nick);
+static	void	add_nick_to_user (int server, Nick *n, const char *nick);
+static	void	remove_nick_from_user (Nick *n);
+static	void	destroy_nick (Nick *n);
+static	Nick *	new_channel_nick (Channel *chan, const char *nick, const char *prefix_modes, int suspicious, int oper, int voice, int ha);
+static	int	nick_mode (Nick *n, int yes, int maybe);
+static	void	set_nick_mode (Nick *n, int yes, int maybe, int value);
+
 static	void	channel_hold_election (int window);
+static	void	nick_status (Nick *n, char *buffer);
 
 #define NICK(l, i)	((Nick *)(l . list[i] -> data))
 
@@ -126,7 +204,9 @@ static int	traverse_all_channels (Channel **ptr, int server, int only_this_serve
 
 static Channel *find_channel (const char *channel, int server)
 {
-	Channel *ch = NULL;
+	Channel *	ch;
+	ChannelTable *	t;
+	uint32_t	hashval;
 
 	if (server == NOSERV)
 		server = primary_server;
@@ -136,13 +216,99 @@ static Channel *find_channel (const char *channel, int server)
 		if (!(channel = get_window_echannel(0)))
 			return NULL;		/* sb colten */
 
-	while (traverse_all_channels(&ch, server, 1))
-	    if (!server_stricmp(ch->channel, channel, server))
+	if (server < 0 || server >= channel_tables_max)
+		return NULL;
+	t = &channel_tables[server];
+	if (!t->count)
+		return NULL;
+
+	hashval = server_strhash(channel);
+	for (ch = t->bucket[hashval & (t->size - 1)]; ch; ch = ch->hnext)
+	    if (ch->hashval == hashval && !server_stricmp(ch->channel, channel, server))
 		return ch;
 
 	return NULL;
 }
 
+/* Put a channel in its server's table (after its name and server are set) */
+static void	hash_channel (Channel *chan)
+{
+	ChannelTable *	t;
+	Channel *	ch;
+	Channel **	old;
+	int		old_size, i;
+
+	if (chan->server < 0)
+		return;
+
+	if (chan->server >= channel_tables_max)
+	{
+		i = channel_tables_max;
+		channel_tables_max = chan->server + 1;
+		RESIZE(channel_tables, ChannelTable, channel_tables_max);
+		for (; i < channel_tables_max; i++)
+		{
+			channel_tables[i].bucket = NULL;
+			channel_tables[i].size = 0;
+			channel_tables[i].count = 0;
+		}
+	}
+
+	t = &channel_tables[chan->server];
+	if (t->count >= t->size)
+	{
+		old = t->bucket;
+		old_size = t->size;
+		t->size = t->size ? t->size * 2 : 16;
+		t->bucket = (Channel **)new_malloc(sizeof(Channel *) * t->size);
+		for (i = 0; i < old_size; i++)
+		{
+			while ((ch = old[i]))
+			{
+				old[i] = ch->hnext;
+				ch->hnext = t->bucket[ch->hashval & (t->size - 1)];
+				t->bucket[ch->hashval & (t->size - 1)] = ch;
+			}
+		}
+		new_free((char **)&old);
+	}
+
+	chan->hashval = server_strhash(chan->channel);
+	chan->hnext = t->bucket[chan->hashval & (t->size - 1)];
+	t->bucket[chan->hashval & (t->size - 1)] = chan;
+	t->count++;
+	chan->serial = ++channel_serial;
+}
+
+/* Take a channel out of its server's table (before its name or server change) */
+static void	unhash_channel (Channel *chan)
+{
+	ChannelTable *	t;
+	Channel **	p;
+
+	if (chan->server < 0 || chan->server >= channel_tables_max)
+		return;
+
+	t = &channel_tables[chan->server];
+	if (!t->size)
+		return;
+
+	for (p = &t->bucket[chan->hashval & (t->size - 1)]; *p; p = &(*p)->hnext)
+	{
+		if (*p == chan)
+		{
+			*p = chan->hnext;
+			chan->hnext = NULL;
+			if (--t->count == 0)
+			{
+				new_free((char **)&t->bucket);
+				t->size = 0;
+			}
+			return;
+		}
+	}
+}
+
 /* Channel constructor */
 static Channel *create_channel (const char *name, int server)
 {
@@ -175,6 +341,7 @@ static Channel *create_channel (const char *name, int server)
 	if (channel_list)
 		channel_list->prev = new_c;
 	channel_list = new_c;
+	hash_channel(new_c);
 	return new_c;
 }
 
@@ -185,13 +352,12 @@ static void 	clear_channel (Channel *chan)
 
 	for (i = 0; i < chan->nicks.max; i++)
 	{
-		Nick *x = (Nick *)chan->nicks.list[i]->data;
-		new_free(&x->nick);
-		new_free(&x->userhost);
-		new_free(&(chan->nicks.list[i]->data));
+		destroy_nick((Nick *)chan->nicks.list[i]->data);
 		new_free(&(chan->nicks.list[i]->name));
+		new_free((char **)&(chan->nicks.list[i]));
 	}
 	new_free((void **)&chan->nicks.list);
+	alist_free_index(&chan->nicks);
 	chan->nicks.max = chan->nicks.total_max = 0;
 }
 
@@ -218,6 +384,7 @@ static void 	destroy_channel (Channel *chan)
 
 	if (chan->next)
 		chan->next->prev = chan->prev;
+	unhash_channel(chan);
 
 	/*
 	 * If we are a current window, then we will no longer be so;
@@ -265,6 +432,14 @@ volatile /* BAH~! */ Channel *new_c;
 		destroy_channel((Channel *)new_c);
 		malloc_strcpy(&(((Channel *)new_c)->channel), name);
 		new_c->server = server;
+
+		/* destroy_channel() took it out of the list; put it back */
+		new_c->prev = NULL;
+		new_c->next = channel_list;
+		if (channel_list)
+			channel_list->prev = (Channel *)new_c;
+		channel_list = (Channel *)new_c;
+		hash_channel((Channel *)new_c);
 	}
 	else
 		new_c = create_channel(name, server);
@@ -334,18 +509,200 @@ void 	remove_channel (const char *channel, int server)
 
 /*
  *
- * Nickname maintainance
+ * User maintainance
  *
  */
-static Nick *	find_nick_on_channel (Channel *ch, const char *nick)
+static User *	find_user (int server, const char *nick)
 {
-	int cnt, loc;
-	Nick *new_n = (Nick *)find_alist_item(&ch->nicks, nick, &cnt, &loc);
+	UserTable *	t;
+	User *		u;
+	uint32_t	hashval;
 
-	if (cnt >= 0 || !new_n)
+	if (server < 0 || server >= user_tables_max)
+		return NULL;
+	t = &user_tables[server];
+	if (!t->count)
 		return NULL;
 
-	return new_n;
+	hashval = server_strhash(nick);
+	for (u = t->bucket[hashval & (t->size - 1)]; u; u = u->hnext)
+	    if (u->hashval == hashval && !server_stricmp(u->nick, nick, server))
+		return u;
+
+	return NULL;
+}
+
+static void	hash_user (User *u)
+{
+	UserTable *	t;
+	User *		x;
+	User **		old;
+	int		old_size, i;
+
+	if (u->server >= user_tables_max)
+	{
+		i = user_tables_max;
+		user_tables_max = u->server + 1;
+		RESIZE(user_tables, UserTable, user_tables_max);
+		for (; i < user_tables_max; i++)
+		{
+			user_tables[i].bucket = NULL;
+			user_tables[i].size = 0;
+			user_tables[i].count = 0;
+		}
+	}
+
+	t = &user_tables[u->server];
+	if (t->count >= t->size)
+	{
+		old = t->bucket;
+		old_size = t->size;
+		t->size = t->size ? t->size * 2 : 64;
+		t->bucket = (User **)new_malloc(sizeof(User *) * t->size);
+		for (i = 0; i < old_size; i++)
+		{
+			while ((x = old[i]))
+			{
+				old[i] = x->hnext;
+				x->hnext = t->bucket[x->hashval & (t->size - 1)];
+				t->bucket[x->hashval & (t->size - 1)] = x;
+			}
+		}
+		new_free((char **)&old);
+	}
+
+	u->hashval = server_strhash(u->nick);
+	u->hnext = t->bucket[u->hashval & (t->size - 1)];
+	t->bucket[u->hashval & (t->size - 1)] = u;
+	t->count++;
+}
+
+static void	unhash_user (User *u)
+{
+	UserTable *	t;
+	User **		p;
+
+	t = &user_tables[u->server];
+	for (p = &t->bucket[u->hashval & (t->size - 1)]; *p; p = &(*p)->hnext)
+	{
+		if (*p == u)
+		{
+			*p = u->hnext;
+			u->hnext = NULL;
+			if (--t->count == 0)
+			{
+				new_free((char **)&t->bucket);
+				t->size = 0;
+			}
+			return;
+		}
+	}
+}
+
+/* 'n->channel' must be set.  'nick' is how the server spelled it this time */
+static void	add_nick_to_user (int server, Nick *n, const char *nick)
+{
+	User *	u;
+	int	i;
+
+	if (!(u = find_user(server, nick)))
+	{
+		u = (User *)new_malloc(sizeof(User));
+		u->nick = malloc_strdup(nick);
+		u->userhost = NULL;
+		u->account = NULL;
+		u->away = -1;
+		u->server = server;
+		u->member = NULL;
+		u->members = u->members_max = 0;
+		hash_user(u);
+	}
+	else if (strcmp(u->nick, nick))
+		malloc_strcpy(&u->nick, nick);	/* Same hash, it's case blind */
+
+	if (u->members == u->members_max)
+	{
+		u->members_max = u->members_max ? u->members_max * 2 : 4;
+		RESIZE(u->member, Nick *, u->members_max);
+	}
+
+	/* Newest channel first */
+	for (i = u->members; i > 0; i--)
+	{
+		if (u->member[i - 1]->channel->serial > n->channel->serial)
+			break;
+		u->member[i] = u->member[i - 1];
+	}
+	u->member[i] = n;
+	u->members++;
+	n->user = u;
+}
+
+static void	remove_nick_from_user (Nick *n)
+{
+	User *	u;
+	int	i;
+
+	if (!(u = n->user))
+		return;
+	n->user = NULL;
+
+	for (i = 0; i < u->members; i++)
+		if (u->member[i] == n)
+			break;
+	if (i == u->members)
+		return;
+
+	memmove(&u->member[i], &u->member[i + 1], 
+			sizeof(Nick *) * (u->members - i - 1));
+	if (--u->members > 0)
+		return;
+
+	unhash_user(u);
+	new_free(&u->nick);
+	new_free(&u->userhost);
+	new_free(&u->account);
+	new_free((char **)&u->member);
+	new_free((char **)&u);
+}
+
+/* 'n' has already been taken out of its channel's nick list */
+static void	destroy_nick (Nick *n)
+{
+	remove_nick_from_user(n);
+	new_free((char **)&n);
+}
+
+/* Returns 1 if 'n' has the 'yes' bit, -1 if it has the 'maybe' bit, else 0 */
+static int	nick_mode (Nick *n, int yes, int maybe)
+{
+	if (n->modes & yes)
+		return 1;
+	else if (n->modes & maybe)
+		return -1;
+	else
+		return 0;
+}
+
+/* The other way around */
+static void	set_nick_mode (Nick *n, int yes, int maybe, int value)
+{
+	n->modes &= ~(yes | maybe);
+	if (value > 0)
+		n->modes |= yes;
+	else if (value < 0)
+		n->modes |= maybe;
+}
+
+
+/*
+ *
+ * Nickname maintainance
+ *
+ */
+static Nick *	find_nick_on_channel (Channel *ch, const char *nick)
+{
+	return (Nick *)alist_lookup(&ch->nicks, nick, 0);
 }
 
 static Nick *	find_nick (int server, const char *channel, const char *nick)
@@ -374,7 +731,7 @@ static Nick *	find_suspicious_on_channel (Channel *ch, const char *nick)
 	for (pos = 0; pos < ch->nicks.max; pos++)
 	{
 		Nick *	n = ch->nicks.list[pos]->data;
-		char *	s = n->nick;
+		char *	s = n->user->nick;
 		size_t	siz = strlen(s);
 
 		/* 
@@ -391,7 +748,7 @@ static Nick *	find_suspicious_on_channel (Channel *ch, const char *nick)
 		 * --- Note that we take no corrective action here.
 		 * That is on purpose.  Please don't change that.
 		 */
-		if (n->suspicious == 1)
+		if (n->modes & NICK_SUSPICIOUS)
 			return n;
 	}
 
@@ -401,28 +758,18 @@ static Nick *	find_suspicious_on_channel (Channel *ch, const char *nick)
 
 
 /*
- * add_to_channel: adds the given nickname to the given channel.  If the
- * nickname is already on the channel, nothing happens.  If the channel is
- * not on the channel list, nothing happens (although perhaps the channel
- * should be addded to the list?  but this should never happen) 
+ * Makes a new Nick for 'chan' out of a nick from a NAMES or WHO reply,
+ * taking off any nick prefix symbols it has ('prefix_modes' is from
+ * get_server_prefix_modes()), and gives it to its User.
+ * If the nick is yours, the channel's idea of your modes is updated too.
+ * The Nick isn't put on the channel; that's up to you.
  */
-void 	add_to_channel (const char *channel, const char *nick, int server, int suspicious, int oper, int voice, int ha)
+static Nick *	new_channel_nick (Channel *chan, const char *nick, const char *prefix_modes, int suspicious, int oper, int voice, int ha)
 {
-	Nick 	*new_n, *old;
-	Channel *chan;
+	Nick 	*new_n;
 	int	ischop = oper;
 	int	isvoice = voice;
 	int	half_assed = ha;
-const	char	*prefix;
-
-	if (!(chan = find_channel(channel, server)))
-		return;
-
-	prefix = get_server_005(from_server, "PREFIX");
-	if (prefix && *prefix == '(' && (prefix = strchr(prefix, ')')))
-		prefix++;
-	if (!prefix || !*prefix)
-		prefix = "@%+";
 
 	/* 
 	 * This is defensive just in case someone in the future
@@ -430,21 +777,21 @@ const	char	*prefix;
 	 */
 	for (;;)
 	{
-		if (!strchr(prefix, *nick))
+		if (!prefix_modes[(unsigned char)*nick])
 		{
 			break;
 		}
 		else if (*nick == '+')
 		{
 			nick++;
-			if (is_me(server, nick))
+			if (is_me(chan->server, nick))
 				chan->voice = 1;
 			isvoice = 1;
 		}
 		else if (*nick == '@')
 		{
 			nick++;
-			if (is_me(server, nick))
+			if (is_me(chan->server, nick))
 				chan->chop = 1;
 			else 
 			{
@@ -458,7 +805,7 @@ const	char	*prefix;
 		else if (*nick == '%')
 		{
 			nick++;
-			if (is_me(server, nick))
+			if (is_me(chan->server, nick))
 				chan->half_assed = 1;
 			else
 			{
@@ -475,24 +822,97 @@ const	char	*prefix;
 	}
 
 	new_n = (Nick *)new_malloc(sizeof(Nick));
-	new_n->nick = malloc_strdup(nick);
-	new_n->userhost = NULL;
-	new_n->suspicious = suspicious;
-	new_n->chanop = ischop;
-	new_n->voice = isvoice;
-	new_n->half_assed = half_assed;
-
-	if ((old = (Nick *)add_to_alist(&chan->nicks, nick, new_n)))
+	new_n->channel = chan;
+	new_n->user = NULL;
+	new_n->modes = 0;
+	if (suspicious)
+		new_n->modes |= NICK_SUSPICIOUS;
+	if (ischop)
+		new_n->modes |= NICK_CHANOP;
+	set_nick_mode(new_n, NICK_VOICE, NICK_VOICE_UK, isvoice);
+	set_nick_mode(new_n, NICK_HALFOP, NICK_HALFOP_UK, half_assed);
+	add_nick_to_user(chan->server, new_n, nick);
+	return new_n;
+}
+
+/*
+ * add_to_channel: adds the given nickname to the given channel.  If the
+ * nickname is already on the channel, nothing happens.  If the channel is
+ * not on the channel list, nothing happens (although perhaps the channel
+ * should be addded to the list?  but this should never happen) 
+ */
+void 	add_to_channel (const char *channel, const char *nick, int server, int suspicious, int oper, int voice, int ha)
+{
+	Nick 	*new_n, *old;
+	Channel *chan;
+
+	if (!(chan = find_channel(channel, server)))
+		return;
+
+	new_n = new_channel_nick(chan, nick, get_server_prefix_modes(chan->server),
+				suspicious, oper, voice, ha);
+	if ((old = (Nick *)add_to_alist(&chan->nicks, new_n->user->nick, new_n)))
+		destroy_nick(old);
+}
+
+/*
+ * add_names_to_channel: adds all the nicks in a NAMES reply ('line') to
+ * a channel that is syncing.  A big channel sends thousands of these, so
+ * the nicks are just put on the end of the list, and the list is sorted
+ * once by channel_names_done() when the server says it's done (366).  
+ * You can still look nicks up in the meantime.
+ */
+void	add_names_to_channel (const char *channel, const char *line, int server)
+{
+	Nick 	*new_n, *old;
+	Channel *chan;
+const	char	*prefix_modes;
+	char	*line_copy;
+	char	*nick;
+
+	if (!(chan = find_channel(channel, server)))
+		return;
+
+	prefix_modes = get_server_prefix_modes(chan->server);
+	line_copy = LOCAL_COPY(line);
+	while ((nick = next_arg(line_copy, &line_copy)) != NULL)
 	{
-		new_free(&old->nick);
-		new_free(&old->userhost);
+		/*
+		 * XXX If the last nickname on the list ends with \  
+		 * and there is a space after it, that would end up
+		 * in 'nick' here -> trim it.  (This actually happens)
+		 */
+		remove_trailing_spaces(nick, 0);
+
+		/*
+		 * 1999 Oct 29 -- This is a hack to compensate for
+		 * a bug in older ircd implementations that can result
+		 * in a truncated nickname at the end of a names reply.
+		 * The last nickname in a names list is then always
+		 * treated with suspicion until the WHO reply is 
+		 * completed and we know that its not truncated. --esl
+		 */
+		new_n = new_channel_nick(chan, nick, prefix_modes, 
+				(!line_copy || !*line_copy) ? 1 : 0, 0, 0, 0);
+		if ((old = (Nick *)alist_append(&chan->nicks, new_n->user->nick, new_n)))
+			destroy_nick(old);
 	}
 }
 
+/* The server is done sending NAMES for this channel, so sort them now */
+void	channel_names_done (const char *channel, int server)
+{
+	Channel *chan;
+
+	if ((chan = find_channel(channel, server)))
+		alist_sort(&chan->nicks);
+}
+
 void 	add_userhost_to_channel (const char *channel, const char *nick, int server, const char *uh)
 {
 	Channel *chan;
 	Nick *new_n = NULL;
+	Nick *old;
 
 	/*
 	 * This call implicitly occurs during a race condition.  It is 
@@ -521,9 +941,11 @@ void 	add_userhost_to_channel (const char *channel, const char *nick, int server
 		 */
 		else
 		{
-		    remove_from_alist(&chan->nicks, new_n->nick);
-		    malloc_strcpy(&new_n->nick, nick);
-		    add_to_alist(&chan->nicks, nick, new_n);
+		    remove_from_alist(&chan->nicks, new_n->user->nick);
+		    remove_nick_from_user(new_n);
+		    add_nick_to_user(chan->server, new_n, nick);
+		    if ((old = (Nick *)add_to_alist(&chan->nicks, nick, new_n)))
+			destroy_nick(old);
 		    debug(DEBUG_CHANNELS, "Detected and corrected a nickname mangled by server-side truncation bug");
 		    debug(DEBUG_CHANNELS, "Server [%d] Channel [%s] Nickname [%s]", server, channel, nick);
 
@@ -536,7 +958,8 @@ void 	add_userhost_to_channel (const char *channel, const char *nick, int server
 		}
 	}
 
-	malloc_strcpy(&new_n->userhost, uh);
+	if (!new_n->user->userhost || strcmp(new_n->user->userhost, uh))
+		malloc_strcpy(&new_n->user->userhost, uh);
 }
 
 
@@ -547,23 +970,27 @@ void 	add_userhost_to_channel (const char *channel, const char *nick, int server
  */
 void 	remove_from_channel (const char *channel, const char *nick, int server)
 {
-	Channel *chan = NULL;
+	Channel *chan;
 	Nick	*tmp;
+	User	*u;
 
 	if (server == NOSERV) return;
 
-	while (traverse_all_channels(&chan, server, 1))
+	if (channel)
 	{
-		/* This is correct, dont change it! */
-		if (channel && server_stricmp(channel, chan->channel, server))
-			continue;
-
+		if (!(chan = find_channel(channel, server)))
+			return;
 		if ((tmp = (Nick *)remove_from_alist(&chan->nicks, nick)))
-		{
-			new_free(&tmp->nick);
-			new_free(&tmp->userhost); /* Da5id reported mf here */
-			new_free((char **)&tmp);
-		}
+			destroy_nick(tmp);
+		return;
+	}
+
+	/* Every channel they're on (this is a QUIT) */
+	while ((u = find_user(server, nick)) && u->members)
+	{
+		tmp = u->member[0];
+		remove_from_alist(&tmp->channel->nicks, u->nick);
+		destroy_nick(tmp);	/* This might free 'u' */
 	}
 }
 
@@ -574,20 +1001,43 @@ void 	remove_from_channel (const char *channel, const char *nick, int server)
  */
 void 	rename_nick (const char *old_nick, const char *new_nick, int server)
 {
-	Channel *chan = NULL;
-	Nick	*tmp;
+	User	*u;
+	User	*other;
+	Nick	*old;
+	int	i;
 
 	if (server == NOSERV) return;		/* Sanity check */
 
-	while (traverse_all_channels(&chan, server, 1))
+	if (!(u = find_user(server, old_nick)))
+		return;
+
+	/*
+	 * If we think someone else already has the new nick, we missed
+	 * them leaving.  Get rid of them, so there's only one of it.
+	 */
+	if ((other = find_user(server, new_nick)) && other != u)
+		remove_from_channel(NULL, new_nick, server);
+
+	/*
+	 * The User stays the same (so we keep their away status and 
+	 * account); it just moves to its new hash bucket.
+	 */
+	for (i = 0; i < u->members; i++)
+		remove_from_alist(&u->member[i]->channel->nicks, u->nick);
+
+	unhash_user(u);
+	malloc_strcpy(&u->nick, new_nick);
+	hash_user(u);
+
+	for (i = 0; i < u->members; i++)
 	{
-		if ((tmp = (Nick *)remove_from_alist(&chan->nicks, old_nick)))
-		{
-			malloc_strcpy(&tmp->nick, new_nick);
-			malloc_strcpy(&tmp->userhost, FromUserHost);
-			add_to_alist(&chan->nicks, new_nick, tmp);
-		}
+		old = (Nick *)add_to_alist(&u->member[i]->channel->nicks, 
+						new_nick, u->member[i]);
+		if (old && old != u->member[i])
+			destroy_nick(old);
 	}
+
+	malloc_strcpy(&u->userhost, FromUserHost);
 }
 
 
@@ -620,7 +1070,7 @@ int 	is_chanop (const char *channel, const char *nick)
 	Nick *n;
 
 	if ((n = find_nick(from_server, channel, nick)))
-		return n->chanop;
+		return (n->modes & NICK_CHANOP) ? 1 : 0;
 	else
 		return 0;
 }
@@ -630,7 +1080,7 @@ int	is_chanvoice (const char *channel, const char *nick)
 	Nick *n;
 
 	if ((n = find_nick(from_server, channel, nick)))
-		return n->voice;
+		return nick_mode(n, NICK_VOICE, NICK_VOICE_UK);
 	else
 		return 0;
 }
@@ -640,7 +1090,7 @@ int	is_halfop (const char *channel, const char *nick)
 	Nick *n;
 
 	if ((n = find_nick(from_server, channel, nick)))
-		return n->half_assed;
+		return nick_mode(n, NICK_HALFOP, NICK_HALFOP_UK);
 	else
 		return 0;
 }
@@ -658,52 +1108,58 @@ int	number_on_channel (const char *name, int server)
 char	*create_nick_list (const char *name, int server)
 {
 	Channel *channel = find_channel(name, server);
-	char 	*str = NULL;
+	Strbuf	str;
 	int 	i;
 
 	if (!channel)
 		return NULL;
 
+	strbuf_init(&str);
+	alist_sort(&channel->nicks);
 	for (i = 0; i < channel->nicks.max; i++)
-		malloc_strcat_word(&str, space, NICK(channel->nicks, i)->nick, DWORD_NO);
+		strbuf_cat_word(&str, space, NICK(channel->nicks, i)->user->nick, DWORD_NO);
 
-	return str;
+	return strbuf_release(&str);
 }
 
 char	*create_chops_list (const char *name, int server)
 {
 	Channel *channel = find_channel(name, server);
-	char 	*str = NULL;
+	Strbuf	str;
 	int 	i;
 
 	if (!channel)
 		return malloc_strdup(empty_string);
 
+	strbuf_init(&str);
+	alist_sort(&channel->nicks);
 	for (i = 0; i < channel->nicks.max; i++)
-	    if (NICK(channel->nicks, i)->chanop)
-		malloc_strcat_word(&str, space, NICK(channel->nicks, i)->nick, DWORD_NO);
+	    if (NICK(channel->nicks, i)->modes & NICK_CHANOP)
+		strbuf_cat_word(&str, space, NICK(channel->nicks, i)->user->nick, DWORD_NO);
 
-	if (!str)
+	if (!str.str)
 		return malloc_strdup(empty_string);
-	return str;
+	return strbuf_release(&str);
 }
 
 char	*create_nochops_list (const char *name, int server)
 {
 	Channel *channel = find_channel(name, server);
-	char 	*str = NULL;
+	Strbuf	str;
 	int 	i;
 
 	if (!channel)
 		return malloc_strdup(empty_string);
 
+	strbuf_init(&str);
+	alist_sort(&channel->nicks);
 	for (i = 0; i < channel->nicks.max; i++)
-	    if (!NICK(channel->nicks, i)->chanop)
-		malloc_strcat_word(&str, space, NICK(channel->nicks, i)->nick, DWORD_NO);
+	    if (!(NICK(channel->nicks, i)->modes & NICK_CHANOP))
+		strbuf_cat_word(&str, space, NICK(channel->nicks, i)->user->nick, DWORD_NO);
 
-	if (!str)
+	if (!str.str)
 		return malloc_strdup(empty_string);
-	return str;
+	return strbuf_release(&str);
 }
 
 /*
@@ -743,29 +1199,7 @@ static const char *	get_cmode (Channel *chan)
  */
 int	chanmodetype (char mode)
 {
-const	char	*chanmodes, *prefix;
-	char	modetype = 3;
-
-	if (strchr("+-", mode))
-		return 1;
-
-	prefix = get_server_005(from_server, "PREFIX");
-	if (!prefix || *prefix++ != '(')
-		prefix = "ohv";
-	for (; *prefix && *prefix != ')'; prefix++)
-		if (*prefix == mode)
-			return 2;
-
-	chanmodes = get_server_005(from_server, "CHANMODES");
-	if (!chanmodes)
-		chanmodes = "b,k,l,imnpst";
-	for (; *chanmodes; chanmodes++)
-		if (*chanmodes == ',')
-			modetype++;
-		else if (*chanmodes == mode)
-			return modetype;
-
-	return 0;
+	return get_server_chanmode_type(from_server, mode);
 }
 
 /*
@@ -873,7 +1307,7 @@ static void	decifer_mode (const char *modes, Channel *chan)
 			if (is_me(from_server, arg))
 				chan->chop = add;
 			if ((nick = find_nick_on_channel(chan, arg)))
-				nick->chanop = add;
+				set_nick_mode(nick, NICK_CHANOP, 0, add);
 			continue;
 		}
 		case 'v':
@@ -890,7 +1324,7 @@ static void	decifer_mode (const char *modes, Channel *chan)
 			if (is_me(from_server, arg))
 				chan->voice = add;
 			if ((nick = find_nick_on_channel(chan, arg)))
-				nick->voice = add;
+				set_nick_mode(nick, NICK_VOICE, NICK_VOICE_UK, add);
 			continue;
 		}
 		case 'h': /* erfnet's borked 'half-assed oper' mode */
@@ -907,7 +1341,7 @@ static void	decifer_mode (const char *modes, Channel *chan)
 			if (is_me(from_server, arg))
 				chan->half_assed = add;
 			if ((nick = find_nick_on_channel(chan, arg)))
-				nick->half_assed = add;
+				set_nick_mode(nick, NICK_HALFOP, NICK_HALFOP_UK, add);
 			continue;
 		}
 
@@ -1045,22 +1479,24 @@ int	is_channel_anonymous (const char *channel, int server_index)
  */
 static void 	show_channel (Channel *chan)
 {
-	char *	buffer = NULL;
+	Strbuf	buffer;
 	char *	ptr;
 	int	i;
 
 	ptr = alloca(BIG_BUFFER_SIZE);
+	strbuf_init(&buffer);
 
+	alist_sort(&chan->nicks);
 	for (i = 0; i < chan->nicks.max; i++)
 	{
-		strlcpy(ptr, NICK(chan->nicks, i)->nick, BIG_BUFFER_SIZE);
-		if (NICK(chan->nicks, i)->userhost)
+		strlcpy(ptr, NICK(chan->nicks, i)->user->nick, BIG_BUFFER_SIZE);
+		if (NICK(chan->nicks, i)->user->userhost)
 		{
 			strlcat(ptr, "!", BIG_BUFFER_SIZE);
-			strlcat(ptr, NICK(chan->nicks, i)->userhost, BIG_BUFFER_SIZE);
+			strlcat(ptr, NICK(chan->nicks, i)->user->userhost, BIG_BUFFER_SIZE);
 		}
 		strlcat(ptr, space, BIG_BUFFER_SIZE);
-		malloc_strcat_wordlist(&buffer, space, ptr);
+		strbuf_cat_wordlist(&buffer, space, ptr);
 	}
 
 	say("\t%s +%s (%s) (Win: %d): %s", 
@@ -1068,45 +1504,84 @@ static void 	show_channel (Channel *chan)
 		get_cmode(chan),
 		get_server_name(chan->server), 
 		(chan->window > 0) ? get_window_user_refnum(chan->window) : -1,
-		buffer);
-	new_free(&buffer);
+		buffer.str);
+	strbuf_free(&buffer);
 }
 
 char	*scan_channel (char *cname)
 {
 	Channel *	wc = find_channel(cname, from_server);
 	char *		buffer;
-	char		*retval = NULL;
+	Strbuf		retval;
 	int		i;
 
 	if (!wc)
 		return malloc_strdup(empty_string);
 
+	strbuf_init(&retval);
 	buffer = alloca(NICKNAME_LEN + 5);
+	alist_sort(&wc->nicks);
 	for (i = 0; i < wc->nicks.max; i++)
 	{
-		if (NICK(wc->nicks, i)->chanop)
-			buffer[0] = '@';
-		else if (NICK(wc->nicks, i)->half_assed == 1)
-			buffer[0] = '%';
-		else
-			buffer[0] = '.';
-
-		if (NICK(wc->nicks, i)->voice == 1)
-			buffer[1] = '+';
-		else if (NICK(wc->nicks, i)->voice == -1)
-			buffer[1] = '?';
-		else
-			buffer[1] = '.';
-
-		strlcpy(buffer + 2, NICK(wc->nicks, i)->nick, NICKNAME_LEN);
-		malloc_strcat_word(&retval, space, buffer, DWORD_NO);
+		nick_status(NICK(wc->nicks, i), buffer);
+		strlcpy(buffer + 2, NICK(wc->nicks, i)->user->nick, NICKNAME_LEN);
+		strbuf_cat_word(&retval, space, buffer, DWORD_NO);
 	}
 
-	if (retval == NULL)
+	if (retval.str == NULL)
 		return malloc_strdup(empty_string);		/* Don't return NULL */
 
-	return retval;
+	return strbuf_release(&retval);
+}
+
+/*
+ * nick_status: Put the two status characters that $channel() shows for
+ * a nick into 'buffer' (which must have room for three): '@', '%' or '.' 
+ * for chanop, halfop or neither, and '+', '?' or '.' for voice.
+ */
+static void	nick_status (Nick *n, char *buffer)
+{
+	if (n->modes & NICK_CHANOP)
+		buffer[0] = '@';
+	else if (n->modes & NICK_HALFOP)
+		buffer[0] = '%';
+	else
+		buffer[0] = '.';
+
+	if (n->modes & NICK_VOICE)
+		buffer[1] = '+';
+	else if (n->modes & NICK_VOICE_UK)
+		buffer[1] = '?';
+	else
+		buffer[1] = '.';
+
+	buffer[2] = 0;
+}
+
+/*
+ * walk_channel_nicks: Call 'func' for every nick on a channel, in order,
+ * with their status (as $channel() shows it) and their userhost (NULL if
+ * we don't know it).  This is for callers who want the whole channel at
+ * once without building and re-parsing a string.  Returns the number of 
+ * nicks, or -1 if you're not on the channel.
+ */
+int	walk_channel_nicks (const char *name, int server, void (*func) (void *, const char *, const char *, const char *), void *data)
+{
+	Channel *	ch;
+	char		status[3];
+	int		i;
+
+	if (!(ch = find_channel(name, server)))
+		return -1;
+
+	alist_sort(&ch->nicks);
+	for (i = 0; i < ch->nicks.max; i++)
+	{
+		nick_status(NICK(ch->nicks, i), status);
+		func(data, NICK(ch->nicks, i)->user->nick, status, 
+				NICK(ch->nicks, i)->user->userhost);
+	}
+	return ch->nicks.max;
 }
 
 
@@ -1235,16 +1710,17 @@ const char *  window_current_channel (int window, int server)
 
 char *	window_all_channels (int window, int server)
 {
-	char *str = NULL;
+	Strbuf	str;
 	Channel *tmp = NULL;
 
+	strbuf_init(&str);
 	while (traverse_all_channels(&tmp, server, 1))
 	{
 		if (tmp->window != window)
 			continue;
-		malloc_strcat_word(&str, space, tmp->channel, DWORD_NO);
+		strbuf_cat_word(&str, space, tmp->channel, DWORD_NO);
 	}
-	return str;
+	return strbuf_release(&str);
 }
 
 int     is_current_channel (const char *channel, int server)
@@ -1295,51 +1771,104 @@ void 	destroy_server_channels (int server)
 
 const char *	what_channel (const char *nick, int servref)
 {
-	Channel *tmp = NULL;
+	User	*u;
 
-	while (traverse_all_channels(&tmp, servref, 1))
-	{
-		if (find_nick_on_channel(tmp, nick))
-			return tmp->channel;
-	}
+	if ((u = find_user(servref, nick)) && u->members)
+		return u->member[0]->channel->channel;
 
 	return NULL;
 }
 
+/*
+ * Each call returns the next channel 'nick' is on.  The user is looked up 
+ * again each time, because the hooks our callers run between calls can
+ * change things.
+ */
 const char *	walk_channels (int init, const char *nick)
 {
-	static	Channel *tmp = (Channel *) 0;
+	static	int	next = 0;
+	User	*u;
 
 	if (init)
-		tmp = NULL;
+		next = 0;
 
-	while (traverse_all_channels(&tmp, from_server, 1))
-	{
-		if (find_nick_on_channel(tmp, nick))
-			return (tmp->channel);
-	}
+	if (!(u = find_user(from_server, nick)) || next >= u->members)
+		return NULL;
 
-	return NULL;
+	return u->member[next++]->channel->channel;
 }
 
 const char *	fetch_userhost (int server, const char *chan, const char *nick)
 {
 	Channel *tmp = NULL;
 	Nick *user = NULL;
+	User *u;
 
 	if (server == NOSERV) return NULL;		/* Sanity check */
 
 	if (chan && (tmp = find_channel(chan, server)) &&
 			(user = find_nick_on_channel(tmp, nick)))
-		return user->userhost;
-	else while (traverse_all_channels(&tmp, server, 1))
-		if ((user = find_nick_on_channel(tmp, nick)) && 
-				user->userhost)
-			return user->userhost;
+		return user->user->userhost;
+	else if ((u = find_user(server, nick)))
+		return u->userhost;
+
+	return NULL;
+}
+
+/*
+ * Remember whether 'nick' is away (from a WHO reply, or an AWAY from a
+ * server doing away-notify).  We only know about people on our channels.
+ */
+void	set_user_away (int server, const char *nick, int away)
+{
+	User *u;
+
+	if ((u = find_user(server, nick)))
+		u->away = away;
+}
+
+/*
+ * Whether 'nick' is away: 1 if they are, 0 if they aren't, and -1 if we
+ * don't know (or they aren't on any of our channels).
+ */
+int	fetch_user_away (int server, const char *nick)
+{
+	User *u;
+
+	if ((u = find_user(server, nick)))
+		return u->away;
+	return -1;
+}
+
+/*
+ * The services account 'nick' is logged into, or NULL if they aren't
+ * (or we don't know, or they aren't on any of our channels).
+ */
+const char *	fetch_user_account (int server, const char *nick)
+{
+	User *u;
 
+	if ((u = find_user(server, nick)))
+		return u->account;
 	return NULL;
 }
 
+/*
+ * Remember the services account 'nick' is logged into (from an extended 
+ * JOIN).  The server says "*" if they aren't logged in.
+ */
+void	set_user_account (int server, const char *nick, const char *account)
+{
+	User *u;
+
+	if (!(u = find_user(server, nick)))
+		return;
+	if (!account || !strcmp(account, "*"))
+		new_free(&u->account);
+	else
+		malloc_strcpy(&u->account, account);
+}
+
 int 	get_channel_oper (const char *channel, int server)
 {
 	Channel *chan;
@@ -1589,15 +2118,16 @@ void	reassign_window_channels (int window_src)
 char *	create_channel_list (int server)
 {
 	Channel	*tmp = NULL;
-	char	*retval = NULL;
+	Strbuf	retval;
 
+	strbuf_init(&retval);
 	if (server >= 0)
 	{
 		while (traverse_all_channels(&tmp, server, 1))
-			malloc_strcat_word(&retval, space, tmp->channel, DWORD_NO);
+			strbuf_cat_word(&retval, space, tmp->channel, DWORD_NO);
 	}
 
-	return retval ? retval : malloc_strdup(empty_string);
+	return retval.str ? strbuf_release(&retval) : malloc_strdup(empty_string);
 }
 
 /* I don't know if this belongs here. */
@@ -174,9 +174,13 @@ static	int	polls = 0;
 		if (io_rec[fd] && !io_rec[fd]->clean)
 			return 1;
 
-	/* How long shall we sleep for? */
+	/* 
+	 * How long shall we sleep for?  Round up, because waking up a
+	 * fraction of a millisecond early means the timer isn't due yet, 
+	 * and we'd just spin here with 0ms timeouts until it is.
+	 */
 	ms = timeout->tv_sec * 1000;
-	ms += (timeout->tv_nsec / 1000000);
+	ms += (timeout->tv_nsec + 999999) / 1000000;
 
 	/* What shall we sleep waiting for? */
 	pollers = new_malloc(sizeof(struct pollfd) * (global_max_fd + 2));
@@ -581,33 +581,7 @@ void 	numbered_command (const char *from, const char *comm, char const **args)
 
 		if (channel_is_syncing(channel, from_server))
 		{
-		    char *line_copy;
-		    char *nick;
-
-		    line_copy = LOCAL_COPY(line);
-		    while ((nick = next_arg(line_copy, &line_copy)) != NULL)
-		    {
-			/*
-			 * XXX If the last nickname on the list ends with \  
-			 * and there is a space after it, that would end up
-			 * in 'nick' here -> trim it.  (This actually happens)
-			 */
-			remove_trailing_spaces(nick, 0);
-
-			/*
-			 * 1999 Oct 29 -- This is a hack to compensate for
-			 * a bug in older ircd implementations that can result
-			 * in a truncated nickname at the end of a names reply.
-			 * The last nickname in a names list is then always
-			 * treated with suspicion until the WHO reply is 
-			 * completed and we know that its not truncated. --esl
-			 */
-			if (!line_copy || !*line_copy)
-				add_to_channel(channel, nick, from_server, 1, 0, 0, 0);
-			else
-				add_to_channel(channel, nick, from_server, 0, 0, 0, 0);
-		    }
-
+		    add_names_to_channel(channel, line, from_server);
 		    break;
 		}
 
@@ -619,6 +593,19 @@ void 	numbered_command (const char *from, const char *comm, char const **args)
 		xwhoreply(from_server, NULL, comm, args);
 		goto END;
 
+	case 366:		/* #define RPL_ENDOFNAMES       366 */
+	{
+		const char	*channel;
+
+		if (!(channel = args[0]))
+			{ rfc1459_odd(from, comm, args); goto END; }
+
+		/* Sort the nicks we got from 353 (before anyone hooks this) */
+		if (channel_is_syncing(channel, from_server))
+			channel_names_done(channel, from_server);
+		break;
+	}
+
 	/* XXX Yea yea, these are out of order. so shoot me. */
 	case 346:               /* #define RPL_INVITELIST (+I for erf) */
 	case 348:               /* #define RPL_EXCEPTLIST (+e for erf) */
@@ -1585,6 +1572,10 @@ static void	add_user_who (int refnum, const char *from, const char *__U(comm), c
 	uh = alloca(size);
 	snprintf(uh, size, "%s@%s", user, host);
 	add_userhost_to_channel(channel, nick, refnum, uh);
+
+	/* The status starts with H (here) or G (gone) */
+	if (args[5] && (*args[5] == 'H' || *args[5] == 'G'))
+		set_user_away(refnum, nick, *args[5] == 'G');
 }
 
 static void	add_user_end (int refnum, const char *from, const char *__U(comm), const char **args)
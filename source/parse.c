@@ -52,11 +52,6 @@
 #include "parse.h"
 #include "timer.h"
 
-#define STRING_CHANNEL 	'+'
-#define MULTI_CHANNEL 	'#'
-#define LOCAL_CHANNEL 	'&'
-#define ID_CHANNEL	'!'
-
 #define parse_space 	' '	/* Taken from rfc 1459 */
 #define	MAXPARA		20	/* RFC1459 says 15, but RusNet uses more */
 
@@ -78,22 +73,16 @@ static	void		strip_modes (const char *, const char *, const char *);
  *	1	- 'to' is a channel name
  *		  Channels begin with a character in 005 CHANTYPES.
  *		  Or, alternatively, they begin with +, #, &, or !
+ *		  (see is_server_chantype())
  *	0	- 'to' is not a channel
  *		   - possibly because it is empty or missing
  */
 int 	is_channel (const char *to)
 {
-	const	char	*chantypes;
-
 	if (!to || !*to)
 		return 0;
 
-	chantypes = get_server_005(from_server, "CHANTYPES");
-	if (chantypes && *chantypes)
-		return (!!strchr(chantypes, *to));
-
-	return ((*to == MULTI_CHANNEL) || (*to == STRING_CHANNEL) ||
-		(*to == LOCAL_CHANNEL) || (*to == ID_CHANNEL));
+	return is_server_chantype(from_server, *to);
 }
 
 /*
@@ -635,6 +624,10 @@ static void	p_join (const char *from, const char *comm, const char **arglist)
 	{
 		add_to_channel(channel, from, from_server, 0, op, vo, ha);
 		add_userhost_to_channel(channel, from, from_server, FromUserHost);
+
+		/* An extended-join says what account they're logged into */
+		if (arglist[1])
+			set_user_account(from_server, from, arglist[1]);
 	}
 
 	set_server_joined_nick(from_server, from);
@@ -743,6 +736,15 @@ static void	p_ping (const char *from, const char *comm, const char **arglist)
 		send_to_server("PONG %s", message);
 }
 
+/*
+ * A server doing away-notify tells us when people on our channels go away
+ * (with a message) or come back (without one).  We just keep track of it.
+ */
+static void	p_away (const char *from, const char *__U(comm), const char **arglist)
+{
+	set_user_away(from_server, from, arglist[0] && *arglist[0] ? 1 : 0);
+}
+
 static void	p_silence (const char *from, const char *comm, const char **arglist)
 {
 	const char *target;
@@ -1377,7 +1379,7 @@ typedef struct {
 static protocol_command rfc1459[] = {
 {	"ADMIN",	NULL,		0		},
 {	"AUTHENTICATE",	p_authenticate,	0,		},
-{	"AWAY",		NULL,		0		},
+{	"AWAY",		p_away,		0		},
 {	"CAP",		p_cap,		0		},
 { 	"CONNECT",	NULL,		0		},
 {	"ERROR",	p_error,	0		},
@@ -0,0 +1,364 @@
+/*
+ * profile.c -- The script profiler
+ *
+ * Copyright 2026 EPIC Software Labs
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notices, the above paragraph (the one permitting redistribution),
+ *    this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. The names of the author(s) may not be used to endorse or promote
+ *    products derived from this software without specific prior written
+ *    permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHORS ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "irc.h"
+#include "ircaux.h"
+#include "alist.h"
+#include "output.h"
+#include "profile.h"
+
+/*
+ * The profiler keeps exact counts (not samples) of every alias, hook,
+ * built in function and built in command that runs while it is turned on.
+ * Built in functions and commands (and most hooks) don't get a frame on 
+ * the runtime call stack (call_stack/wind_index in alias.c), so the 
+ * profiler keeps its own stack, pushed and popped around each of them.
+ *
+ * For each thing that runs we remember how many times it was called,
+ * how long it ran in total (including everything it called), and how
+ * long it ran by itself (excluding everything it called).
+ *
+ * We also keep the self-time of every distinct call path, which is what
+ * flamegraph tools want ("alias:FOO;function:WORD 1234").
+ */
+	int	profiling = 0;
+
+typedef struct ProfileStatStru
+{
+	unsigned long	calls;		/* How many times it was entered */
+	double		self;		/* Seconds spent in it, not callees */
+	double		total;		/* Seconds spent in it and callees */
+	int		active;		/* How many times it's on the stack */
+} ProfileStat;
+
+typedef struct ProfileFrameStru
+{
+	size_t		path_len;	/* Length of profile_path before us */
+	Timespec	start;		/* When we were entered */
+	double		children;	/* Seconds spent in our callees */
+} ProfileFrame;
+
+static	alist		profile_stats = { NULL, 0, 0, strncmp, HASH_SENSITIVE, NULL };
+static	alist		profile_paths = { NULL, 0, 0, strncmp, HASH_SENSITIVE, NULL };
+static	ProfileFrame *	profile_frames = NULL;
+static	int		profile_depth = 0;
+static	int		profile_frames_max = 0;
+static	char *		profile_path = NULL;
+static	size_t		profile_path_len = 0;
+static	size_t		profile_path_max = 0;
+
+static const char *	profile_kinds[] = { "alias", "hook", "function", "command" };
+
+static void	profile_now (Timespec *ts)
+{
+	clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+/*
+ * Fetch the stat for 'name' from 'list', creating it if neccesary.
+ */
+static ProfileStat *	get_profile_stat (alist *list, const char *name)
+{
+	ProfileStat *	s;
+	int		cnt, loc;
+
+	s = find_alist_item(list, name, &cnt, &loc);
+	if (s && cnt < 0)
+		return s;
+
+	s = new_malloc(sizeof(ProfileStat));
+	s->calls = 0;
+	s->self = 0;
+	s->total = 0;
+	s->active = 0;
+	add_to_alist(list, name, s);
+	return s;
+}
+
+static void	clear_profile_stats (alist *list)
+{
+	ProfileStat *	s;
+
+	while (list->max > 0)
+	{
+		s = alist_pop(list, list->max - 1);
+		new_free((char **)&s);
+	}
+	new_free(&list->list);
+	list->total_max = 0;
+}
+
+/*
+ * Append a frame's label to the current call path.
+ */
+static void	profile_path_push (ProfileKind kind, const char *name)
+{
+	size_t	need;
+	char *	p;
+
+	need = profile_path_len + strlen(profile_kinds[kind]) + strlen(name) + 3;
+	if (need > profile_path_max)
+	{
+		profile_path_max = need * 2;
+		RESIZE(profile_path, char, profile_path_max);
+	}
+
+	p = profile_path + profile_path_len;
+	if (profile_path_len)
+		*p++ = ';';
+	p += sprintf(p, "%s:%s", profile_kinds[kind], name);
+
+	/* Semicolons seperate frames in the folded-stack format */
+	for (p = profile_path + profile_path_len + 1; *p; p++)
+		if (*p == ';')
+			*p = '_';
+	profile_path_len = p - profile_path;
+}
+
+/*
+ * Called when something we want to profile starts running.
+ * Returns 1, which you must pass to profile_leave() when it finishes.
+ */
+int	profile_enter (ProfileKind kind, const char *name)
+{
+	ProfileFrame *	f;
+	ProfileStat *	s;
+	const char *	label;
+
+	if (profile_depth >= profile_frames_max)
+	{
+		profile_frames_max = profile_frames_max ? profile_frames_max * 2 : 32;
+		RESIZE(profile_frames, ProfileFrame, profile_frames_max);
+	}
+
+	f = &profile_frames[profile_depth++];
+	f->path_len = profile_path_len;
+	f->children = 0;
+	profile_path_push(kind, name);
+
+	label = profile_path + f->path_len + (f->path_len ? 1 : 0);
+	s = get_profile_stat(&profile_stats, label);
+	s->calls++;
+	s->active++;
+
+	profile_now(&f->start);
+	return 1;
+}
+
+/*
+ * Called when the most recently entered thing finishes.  This always
+ * unwinds, even if the profiler was turned off in the meantime.
+ */
+void	profile_leave (int entered)
+{
+	ProfileFrame *	f;
+	ProfileStat *	s;
+	Timespec	now;
+	double		elapsed;
+	const char *	label;
+
+	if (!entered || profile_depth <= 0)
+		return;
+
+	profile_now(&now);
+	f = &profile_frames[--profile_depth];
+	elapsed = time_diff(f->start, now);
+	if (profile_depth > 0)
+		profile_frames[profile_depth - 1].children += elapsed;
+
+	label = profile_path + f->path_len + (f->path_len ? 1 : 0);
+	s = get_profile_stat(&profile_stats, label);
+	s->self += elapsed - f->children;
+
+	/* Recursive calls only count towards the total once */
+	if (s->active > 0)
+		s->active--;
+	if (s->active == 0)
+		s->total += elapsed;
+
+	s = get_profile_stat(&profile_paths, profile_path);
+	s->calls++;
+	s->self += elapsed - f->children;
+
+	profile_path_len = f->path_len;
+	profile_path[profile_path_len] = 0;
+}
+
+/*
+ * Frames that are still running when you reset keep their stats (so
+ * they still know they're on the stack); they just start counting again
+ * from zero.
+ */
+static void	profile_reset (void)
+{
+	ProfileStat *	s;
+	int		i;
+
+	for (i = profile_stats.max - 1; i >= 0; i--)
+	{
+		s = profile_stats.list[i]->data;
+		if (s->active > 0)
+		{
+			s->calls = 0;
+			s->self = 0;
+			s->total = 0;
+		}
+		else
+		{
+			s = alist_pop(&profile_stats, i);
+			new_free((char **)&s);
+		}
+	}
+	clear_profile_stats(&profile_paths);
+}
+
+static int	compare_profile_stats (const void *a, const void *b)
+{
+	const ProfileStat *x = ((const alist_item_ * const *)a)[0]->data;
+	const ProfileStat *y = ((const alist_item_ * const *)b)[0]->data;
+
+	if (x->self < y->self)
+		return 1;
+	else if (x->self > y->self)
+		return -1;
+	else
+		return 0;
+}
+
+static void	profile_report (int count)
+{
+	alist_item_ **	sorted;
+	ProfileStat *	s;
+	int		i;
+
+	if (profile_stats.max == 0)
+	{
+		say("No profile data has been collected");
+		return;
+	}
+
+	sorted = new_malloc(sizeof(alist_item_ *) * profile_stats.max);
+	memcpy(sorted, profile_stats.list, sizeof(alist_item_ *) * profile_stats.max);
+	qsort(sorted, profile_stats.max, sizeof(alist_item_ *), compare_profile_stats);
+
+	if (count <= 0 || count > profile_stats.max)
+		count = profile_stats.max;
+
+	say("%10s %12s %12s  %s", "Calls", "Self(ms)", "Total(ms)", "Name");
+	for (i = 0; i < count; i++)
+	{
+		s = sorted[i]->data;
+		say("%10lu %12.3f %12.3f  %s", s->calls, s->self * 1000.0,
+				s->total * 1000.0, sorted[i]->name);
+	}
+
+	new_free((char **)&sorted);
+}
+
+/*
+ * Write out every call path in "folded stack" format, one per line,
+ * with its self-time in microseconds.  This is what flamegraph.pl and
+ * friends take as input.
+ */
+static void	profile_dump (const char *filename)
+{
+	Filename	fullname;
+	FILE *		fp;
+	ProfileStat *	s;
+	int		i;
+
+	if (expand_twiddle(filename, fullname))
+	{
+		say("PROFILE: Could not expand the filename [%s]", filename);
+		return;
+	}
+
+	if (!(fp = fopen(fullname, "w")))
+	{
+		say("PROFILE: Could not open [%s]: %s", fullname, strerror(errno));
+		return;
+	}
+
+	for (i = 0; i < profile_paths.max; i++)
+	{
+		s = profile_paths.list[i]->data;
+		fprintf(fp, "%s %.0f\n", profile_paths.list[i]->name,
+						s->self * 1000000.0);
+	}
+
+	fclose(fp);
+	say("PROFILE: Wrote %d call paths to %s", profile_paths.max, fullname);
+}
+
+/*
+ * /PROFILE			Show whether the profiler is on
+ * /PROFILE ON			Start collecting
+ * /PROFILE OFF			Stop collecting (the data is kept)
+ * /PROFILE RESET		Throw away everything collected so far
+ * /PROFILE REPORT [<count>]	Show the top <count> entries by self-time
+ * /PROFILE DUMP <file>		Write the folded-stacks to <file>
+ */
+BUILT_IN_COMMAND(profilecmd)
+{
+	char *	arg;
+
+	if (!(arg = next_arg(args, &args)))
+	{
+		say("Profiling is %s (%d items, %d call paths)",
+			profiling ? "on" : "off",
+			profile_stats.max, profile_paths.max);
+		return;
+	}
+
+	if (!my_stricmp(arg, "ON"))
+		profiling = 1;
+	else if (!my_stricmp(arg, "OFF"))
+		profiling = 0;
+	else if (!my_stricmp(arg, "RESET"))
+		profile_reset();
+	else if (!my_stricmp(arg, "REPORT"))
+	{
+		if ((arg = next_arg(args, &args)))
+			profile_report(my_atol(arg));
+		else
+			profile_report(0);
+	}
+	else if (!my_stricmp(arg, "DUMP"))
+	{
+		if ((arg = new_next_arg(args, &args)))
+			profile_dump(arg);
+		else
+			say("Usage: /PROFILE DUMP <filename>");
+	}
+	else
+		say("Usage: /PROFILE [ON|OFF|RESET|REPORT [<count>]|DUMP <filename>]");
+}
@@ -32,6 +32,8 @@
 /* Python commit #14 */
 
 #include <Python.h>
+#include <pthread.h>
+#include <signal.h>
 #include "irc.h"
 #include "ircaux.h"
 #include "array.h"
@@ -43,11 +45,18 @@
 #include "extlang.h"
 #include "newio.h"
 #include "server.h"
+#include "hook.h"
+#include "names.h"
+#include "lastlog.h"
+#include "window.h"
 
 void	output_traceback (void);
+static	void	python_enter (void);
+static	void	python_leave (void);
 
 static	int	p_initialized = 0;
 static	PyObject *global_vars = NULL;
+static	PyObject *python_commands = NULL;	/* NAME -> callable */
 
 /*
  * ObRant
@@ -787,6 +796,7 @@ int 	call_python_function_1arg (PyObject *pFunc, int fd)
 	PyObject *pArgs = NULL, *pRetVal = NULL;
 	/* PyObject *retval_repr = NULL; */
 
+	python_enter();
 	if (!PyCallable_Check(pFunc))
 	{
 		my_error("python_fd_callback: The callback was not a function");
@@ -813,11 +823,13 @@ int 	call_python_function_1arg (PyObject *pFunc, int fd)
 
 c_p_f_error:
 	output_traceback();
+	python_leave();
 	return -1;
 
 c_p_f_cleanup:
 	Py_XDECREF(pArgs);
 	Py_XDECREF(pRetVal);
+	python_leave();
 	return 0;
 }
 
@@ -1101,6 +1113,23 @@ static	PyObject *	epic_cancel_callback (PyObject *__U(self), PyObject *args)
 BUILT_IN_COMMAND(pyshim)
 {
 	char *	retval = NULL;
+	PyObject *callable;
+	PyObject *pRetVal;
+
+	/* Commands registered with a callable don't need to look it up */
+	python_enter();
+	if (python_commands && (callable = PyDict_GetItemString(
+				python_commands, upper(LOCAL_COPY(command)))))
+	{
+		Py_INCREF(callable);
+		if (!(pRetVal = PyObject_CallFunction(callable, "z", args)))
+			output_traceback();
+		Py_XDECREF(pRetVal);
+		Py_DECREF(callable);
+		python_leave();
+		return;
+	}
+	python_leave();
 
 	retval = call_python_directly(command, args);
 	new_free(&retval);
@@ -1109,25 +1138,51 @@ BUILT_IN_COMMAND(pyshim)
 /*
  * epic.builtin_cmd("module.method") -- Register a python module.method 
  *					as a builtin ircII cmd
+ * epic.builtin_cmd("name", callable) -- Register a python callable as
+ *					the builtin ircII cmd /NAME
  * Arguments:
  *	self - ignored (the "epic" object)
  *	args - A tuple containing
  *		1. A string - the name of "module.method")
  *			This will become /MODULE.METHOD in ircII.
+ *		2. (Optional) A CallableObject that takes one string argument.
+ *			If you pass this, then /NAME calls it directly,
+ *			instead of looking up "module.method" every time.
  *
  * Return value:
  *	NULL     - PyArg_ParseTuple() didn't like your tuple 
  *				(and threw exception)
+ *	NULL / TypeError - The second argument isn't callable
  *	 None 	- The command was registered successfully
  */
 static	PyObject *	epic_builtin_cmd (PyObject *__U(self), PyObject *args)
 {
 	char *	symbol;
+	PyObject *callable = NULL;
 
-	if (!PyArg_ParseTuple(args, "z", &symbol)) {
+	if (!PyArg_ParseTuple(args, "z|O", &symbol, &callable)) {
 		return NULL;
 	}
 
+	if (callable)
+	{
+		if (!PyCallable_Check(callable))
+		{
+			PyErr_Format(PyExc_TypeError, "%s : Not a callable object", symbol);
+			return NULL;
+		}
+		/* Commands are looked up in upper case */
+		symbol = upper(LOCAL_COPY(symbol));
+		if (!python_commands && !(python_commands = PyDict_New()))
+			return NULL;
+		if (PyDict_SetItemString(python_commands, symbol, callable))
+			return NULL;
+	}
+	/* Back to looking up "module.method", if it was a callable before */
+	else if (python_commands && PyDict_DelItemString(python_commands, 
+					upper(LOCAL_COPY(symbol))) < 0)
+		PyErr_Clear();
+
 	/* XXX TODO - Test this -- does 'symbol' need to be strdup()d?  XXX TODO */
 	add_builtin_cmd_alias(symbol, pyshim);
 
@@ -1136,6 +1191,603 @@ static	PyObject *	epic_builtin_cmd (PyObject *__U(self), PyObject *args)
 	return Py_None;
 }
 
+/*
+ * A native /ON hook (see epic.on() below).  The hook's arguments are 
+ * passed as separate strings, and if it returns something true, that 
+ * suppresses the default action (for "?" hooks).
+ */
+static	int	python_hook (void *data, const char *__U(event), int argc, char **argv)
+{
+	PyObject *callable = (PyObject *)data;
+	PyObject *pArgs = NULL, *arg, *pRetVal = NULL;
+	int	i, retval = 0;
+
+	python_enter();
+	Py_INCREF(callable);
+	if (!(pArgs = PyTuple_New(argc)))
+		goto p_h_error;
+
+	for (i = 0; i < argc; i++)
+	{
+		if (!(arg = PyUnicode_DecodeUTF8(argv[i], strlen(argv[i]), 
+							"surrogateescape")))
+			goto p_h_error;
+		PyTuple_SET_ITEM(pArgs, i, arg);	/* It owns 'arg' now */
+	}
+
+	if (!(pRetVal = PyObject_CallObject(callable, pArgs)))
+		goto p_h_error;
+
+	retval = PyObject_IsTrue(pRetVal) > 0;
+	goto p_h_cleanup;
+
+p_h_error:
+	output_traceback();
+
+p_h_cleanup:
+	Py_XDECREF(pArgs);
+	Py_XDECREF(pRetVal);
+	Py_DECREF(callable);
+	python_leave();
+	return retval;
+}
+
+static	void	python_hook_release (void *data)
+{
+	python_enter();
+	Py_XDECREF((PyObject *)data);
+	python_leave();
+}
+
+/*
+ * epic.on("type", "pattern", callable, serial) -- Register a python 
+ *					callable as an /ON
+ * Arguments:
+ *	self - ignored (the "epic" object)
+ *	args - A tuple containing
+ *		1. A string - The /ON type, with noise character if you want
+ *			one (ie, "^MSG")
+ *		2. A string - The pattern (like /ON's "nick")
+ *		3. A CallableObject - Called when the /ON goes off.  It gets
+ *			one string for each of the event's $0, $1, ... 
+ *			(the last one gets the rest of $*)
+ *		4. (Optional) An integer - The serial number (default 0)
+ *
+ * Note: Nothing is $-expanded or parsed; the callable is called directly.
+ *	You remove it just like any other /ON (/ON -MSG "pattern")
+ *
+ * Return value:
+ *	NULL     - PyArg_ParseTuple() didn't like your tuple 
+ *				(and threw exception)
+ *	NULL / TypeError - The third argument isn't callable
+ *	NULL / ValueError - The /ON type doesn't exist
+ *	An integer - The hook's refnum (for $hookctl())
+ */
+static	PyObject *	epic_on (PyObject *__U(self), PyObject *args)
+{
+	char *	type;
+	char *	pattern;
+	PyObject *callable;
+	int	serial = 0;
+	int	refnum;
+	PyObject *repr;
+	const char *description = NULL;
+
+	if (!PyArg_ParseTuple(args, "ssO|i", &type, &pattern, &callable, &serial)) {
+		return NULL;
+	}
+
+	if (!PyCallable_Check(callable))
+	{
+		PyErr_Format(PyExc_TypeError, "%s : Not a callable object", type);
+		return NULL;
+	}
+
+	/* What /ON shows instead of the ircII code */
+	if ((repr = PyObject_Repr(callable)))
+		description = PyUnicode_AsUTF8(repr);
+	if (!description)
+	{
+		PyErr_Clear();
+		description = "<python>";
+	}
+
+	Py_INCREF(callable);
+	refnum = add_native_hook(type, serial, pattern, description,
+				python_hook, callable, python_hook_release);
+	Py_XDECREF(repr);
+
+	if (refnum < 0)
+	{
+		Py_DECREF(callable);
+		PyErr_Format(PyExc_ValueError, "%s : No such ON type", type);
+		return NULL;
+	}
+	return PyLong_FromLong(refnum);
+}
+
+/******************** Running python on a worker thread ********************/
+/*
+ * epic.run_async(callable, args, done) runs callable(*args) on a worker 
+ * thread, so something slow doesn't stop the client.  When it's finished,
+ * done(result) is called back on the main thread, from the io() loop, 
+ * where it's safe to use _epic again.  The worker tells us it's finished 
+ * a task by writing a newline to a pipe that is new_open()ed like any 
+ * other fd.
+ *
+ * About the GIL: Until the first run_async(), the main thread holds the 
+ * GIL all the time (as it always has).  After that, it lets go of it when
+ * it goes back to epic, and everything that calls python takes it back, 
+ * with python_enter() and python_leave(), for just as long as it needs it.
+ */
+typedef struct PyTaskStru {
+	struct PyTaskStru *next;
+	long		refnum;
+	PyObject *	callable;
+	PyObject *	args;
+	PyObject *	done;
+	PyObject *	result;		/* NULL if the callable threw */
+	PyObject *	etype;
+	PyObject *	evalue;
+	PyObject *	etraceback;
+} PyTask;
+
+static	pthread_mutex_t	python_task_lock = PTHREAD_MUTEX_INITIALIZER;
+static	pthread_cond_t	python_task_ready = PTHREAD_COND_INITIALIZER;
+static	PyTask *	python_tasks_pending = NULL;
+static	PyTask *	python_tasks_done = NULL;
+static	long		python_task_refnum = 0;
+static	int		python_task_pipe[2] = { -1, -1 };
+static	pthread_t	python_worker_thread;
+static	int		python_worker_started = 0;
+
+static	PyThreadState *	python_main_state = NULL; /* Set when we let go of the GIL */
+static	int		python_depth = 0;
+
+/* Call before the main thread uses python */
+static	void	python_enter (void)
+{
+	if (python_depth++ == 0 && python_main_state)
+	{
+		PyEval_RestoreThread(python_main_state);
+		python_main_state = NULL;
+	}
+}
+
+/* Call when the main thread is done with python */
+static	void	python_leave (void)
+{
+	if (--python_depth == 0 && python_worker_started)
+		python_main_state = PyEval_SaveThread();
+}
+
+static	void	python_task_append (PyTask **list, PyTask *task)
+{
+	while (*list)
+		list = &(*list)->next;
+	task->next = NULL;
+	*list = task;
+}
+
+static	void *	python_worker (void *__U(arg))
+{
+	PyTask *	task;
+	PyGILState_STATE gil;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&python_task_lock);
+		while (!python_tasks_pending)
+			pthread_cond_wait(&python_task_ready, &python_task_lock);
+		task = python_tasks_pending;
+		python_tasks_pending = task->next;
+		pthread_mutex_unlock(&python_task_lock);
+
+		gil = PyGILState_Ensure();
+		if (!(task->result = PyObject_CallObject(task->callable, task->args)))
+			PyErr_Fetch(&task->etype, &task->evalue, &task->etraceback);
+		PyGILState_Release(gil);
+
+		pthread_mutex_lock(&python_task_lock);
+		python_task_append(&python_tasks_done, task);
+		pthread_mutex_unlock(&python_task_lock);
+
+		if (write(python_task_pipe[1], "\n", 1) < 0)
+			continue;	/* It'll get picked up next time */
+	}
+	return NULL;
+}
+
+/* The worker finished some tasks -- tell their done callbacks */
+static	void	do_python_tasks (int fd)
+{
+	char *	buffer;
+	PyTask *done, *task;
+	PyObject *pRetVal;
+
+	buffer = alloca(BIG_BUFFER_SIZE);
+	if (dgets(fd, buffer, BIG_BUFFER_SIZE, -1) < 0)
+	{
+		yell("do_python_tasks: The worker thread's pipe (%d) died.", fd);
+		new_close(fd);
+		return;
+	}
+
+	pthread_mutex_lock(&python_task_lock);
+	done = python_tasks_done;
+	python_tasks_done = NULL;
+	pthread_mutex_unlock(&python_task_lock);
+
+	python_enter();
+	while ((task = done))
+	{
+		done = task->next;
+		if (!task->result)
+		{
+			PyErr_Restore(task->etype, task->evalue, task->etraceback);
+			output_traceback();
+		}
+		else if (task->done)
+		{
+			if (!(pRetVal = PyObject_CallFunctionObjArgs(task->done, 
+							task->result, NULL)))
+				output_traceback();
+			Py_XDECREF(pRetVal);
+		}
+
+		Py_XDECREF(task->callable);
+		Py_XDECREF(task->args);
+		Py_XDECREF(task->done);
+		Py_XDECREF(task->result);
+		new_free((char **)&task);
+	}
+	python_leave();
+}
+
+static	int	start_python_worker (void)
+{
+	sigset_t	all, old;
+	int		failed;
+
+	if (pipe(python_task_pipe))
+		return -1;
+	new_open(python_task_pipe[0], do_python_tasks, NEWIO_READ, POLLIN, 0, -1);
+
+	/*
+	 * The worker inherits our signal mask, and the signal handlers
+	 * (SIGINT, SIGCHLD, SIGALRM, SIGWINCH...) must only ever run on 
+	 * the main thread, so block everything while it is created.
+	 */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	failed = pthread_create(&python_worker_thread, NULL, python_worker, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (failed)
+	{
+		new_close(python_task_pipe[0]);
+		close(python_task_pipe[1]);
+		return -1;
+	}
+	pthread_detach(python_worker_thread);
+	python_worker_started = 1;
+	return 0;
+}
+
+/*
+ * epic.run_async(callable, args, done) -- Run a python function on a 
+ *					worker thread
+ *
+ * Arguments:
+ *	self - ignored (the "epic" module)
+ *	args - A tuple containing
+ *		1. A CallableObject - The thing to run on the worker thread.  
+ *			It MUST NOT call any _epic functions, because the 
+ *			client isn't thread safe.
+ *		2. (Optional) A tuple - The arguments to pass to it
+ *		3. (Optional) A CallableObject (or None) - Called on the main 
+ *			thread with the return value when it's finished.  
+ *			This is where you output things.  If the first 
+ *			callable throws an exception, you get a traceback 
+ *			instead.
+ *
+ * Tasks are run one at a time, in the order they were added.
+ *
+ * Return value:
+ *	NULL - PyArg_ParseTuple() didn't like your tuple (and threw exception)
+ *	NULL / TypeError - The callables aren't callable
+ *	NULL / RuntimeError - The worker couldn't be started, or you called
+ *			this from the worker.
+ *	An integer - The task's refnum
+ */
+static	PyObject *	epic_run_async (PyObject *__U(self), PyObject *args)
+{
+	PyObject *	callable;
+	PyObject *	cargs = NULL;
+	PyObject *	done = NULL;
+	PyTask *	task;
+	long		refnum;
+
+	if (!PyArg_ParseTuple(args, "O|O!O", &callable, &PyTuple_Type, &cargs, &done)) {
+		return NULL;
+	}
+
+	if (!PyCallable_Check(callable) || (done && done != Py_None && !PyCallable_Check(done)))
+	{
+		PyErr_SetString(PyExc_TypeError, "run_async: Not a callable object");
+		return NULL;
+	}
+
+	if (python_worker_started && pthread_equal(pthread_self(), python_worker_thread))
+	{
+		PyErr_SetString(PyExc_RuntimeError, "run_async: Can't be called from the worker thread");
+		return NULL;
+	}
+
+	if (!python_worker_started && start_python_worker())
+	{
+		PyErr_SetString(PyExc_RuntimeError, "run_async: Couldn't start the worker thread");
+		return NULL;
+	}
+
+	task = (PyTask *)new_malloc(sizeof(PyTask));
+	task->callable = callable;
+	Py_INCREF(callable);
+	if (!(task->args = cargs ? cargs : PyTuple_New(0)))
+	{
+		Py_DECREF(callable);
+		new_free((char **)&task);
+		return NULL;
+	}
+	if (cargs)
+		Py_INCREF(cargs);
+	if (done && done != Py_None)
+	{
+		task->done = done;
+		Py_INCREF(done);
+	}
+
+	pthread_mutex_lock(&python_task_lock);
+	refnum = task->refnum = ++python_task_refnum;
+	python_task_append(&python_tasks_pending, task);
+	pthread_cond_signal(&python_task_ready);
+	pthread_mutex_unlock(&python_task_lock);
+
+	return PyLong_FromLong(refnum);
+}
+
+/*************************** Bulk accessors *****************************/
+/*
+ * These return a whole channel, lastlog, 005 table or array in one call,
+ * instead of calling epic.expr() once for each thing.  They are built 
+ * right from the C structures by the walk_*() functions, which call back
+ * here for each item.  If python can't make an item, 'error' is set (and
+ * python has thrown an exception) and the rest are skipped.
+ */
+typedef struct {
+	PyObject *	obj;
+	int		error;
+} PyBulk;
+
+static	void	bulk_append (PyBulk *b, PyObject *item)
+{
+	if (!item || PyList_Append(b->obj, item))
+		b->error = 1;
+	Py_XDECREF(item);
+}
+
+static	void	bulk_nick (void *data, const char *nick, const char *status, const char *uh)
+{
+	PyBulk *b = (PyBulk *)data;
+
+	if (!b->error)
+		bulk_append(b, Py_BuildValue("(ssz)", nick, status, uh));
+}
+
+static	void	bulk_lastlog (void *data, intmax_t refnum, const char *level, const char *target, const char *msg, time_t created)
+{
+	PyBulk *b = (PyBulk *)data;
+
+	if (!b->error)
+		bulk_append(b, Py_BuildValue("(Lszzl)", (long long)refnum, 
+					level, target, msg, (long)created));
+}
+
+static	void	bulk_005 (void *data, const char *name, const char *value)
+{
+	PyBulk *b = (PyBulk *)data;
+	PyObject *v;
+
+	if (b->error)
+		return;
+	if (!(v = Py_BuildValue("z", value)) || 
+			PyDict_SetItemString(b->obj, name, v))
+		b->error = 1;
+	Py_XDECREF(v);
+}
+
+/*
+ * epic.channel_nicks("#channel", server) -- Everybody on a channel
+ *
+ * Arguments:
+ *	self - ignored (the "epic" module)
+ *	args - A tuple containing
+ *		1. A string - The channel name
+ *		2. (Optional) An integer - The server refnum (default: the
+ *			current server)
+ *
+ * Return value:
+ *	NULL - PyArg_ParseTuple() didn't like your tuple (and threw exception)
+ *	NULL / ValueError - You're not on that channel
+ *	A list of tuples, one for each nick, in the same order as $onchannel():
+ *		(nick, status, userhost)
+ *	  The status is the same two characters that $channel() shows:
+ *		'@', '%' or '.' (op, halfop, neither) and 
+ *		'+', '?' or '.' (voice, don't know, no voice)
+ *	  The userhost is None if we don't know it.
+ */
+PYTHON(channel_nicks)
+{
+	char *	channel;
+	int	server = from_server;
+	PyBulk	b;
+
+	if (!PyArg_ParseTuple(args, "s|i", &channel, &server)) {
+		return NULL;
+	}
+
+	if (!(b.obj = PyList_New(0)))
+		return NULL;
+	b.error = 0;
+
+	if (walk_channel_nicks(channel, server, bulk_nick, &b) < 0)
+	{
+		Py_DECREF(b.obj);
+		PyErr_Format(PyExc_ValueError, "%s : Not on that channel", channel);
+		return NULL;
+	}
+	if (b.error)
+	{
+		Py_DECREF(b.obj);
+		return NULL;
+	}
+	return b.obj;
+}
+
+/*
+ * epic.lastlog("window", start, count) -- Lines from a window's lastlog
+ *
+ * Arguments:
+ *	self - ignored (the "epic" module)
+ *	args - A tuple containing
+ *		1. A string - A window (refnum or name; "0" is the current one)
+ *		2. (Optional) An integer - The newest line you want, numbered 
+ *			the same as $line() (1 is the newest, and the default)
+ *		3. (Optional) An integer - How many lines you want (default
+ *			is all of them)
+ *
+ * Return value:
+ *	NULL - PyArg_ParseTuple() didn't like your tuple (and threw exception)
+ *	NULL / ValueError - There's no such window
+ *	A list of tuples, one for each line, oldest first:
+ *		(refnum, level, target, text, time)
+ *	  The target is None if the line doesn't have one.
+ */
+PYTHON(lastlog)
+{
+	char *	windesc;
+	int	start = 1, count = -1;
+	int	window;
+	PyBulk	b;
+
+	if (!PyArg_ParseTuple(args, "s|ii", &windesc, &start, &count)) {
+		return NULL;
+	}
+
+	if ((window = lookup_window(windesc)) < 1)
+	{
+		PyErr_Format(PyExc_ValueError, "%s : No such window", windesc);
+		return NULL;
+	}
+
+	if (!(b.obj = PyList_New(0)))
+		return NULL;
+	b.error = 0;
+
+	walk_window_lastlog(window, start, count, bulk_lastlog, &b);
+	if (b.error)
+	{
+		Py_DECREF(b.obj);
+		return NULL;
+	}
+	return b.obj;
+}
+
+/*
+ * epic.server_005(server) -- All of a server's 005 settings
+ *
+ * Arguments:
+ *	self - ignored (the "epic" module)
+ *	args - A tuple containing
+ *		1. (Optional) An integer - The server refnum (default: the 
+ *			current server)
+ *
+ * Return value:
+ *	NULL - PyArg_ParseTuple() didn't like your tuple (and threw exception)
+ *	NULL / ValueError - There's no such server
+ *	A dict of the settings ($serverctl(GET <refnum> 005s) and 
+ *	  $serverctl(GET <refnum> 005 <setting>) all at once)
+ */
+PYTHON(server_005)
+{
+	int	server = from_server;
+	PyBulk	b;
+
+	if (!PyArg_ParseTuple(args, "|i", &server)) {
+		return NULL;
+	}
+
+	if (!(b.obj = PyDict_New()))
+		return NULL;
+	b.error = 0;
+
+	if (walk_server_005(server, bulk_005, &b) < 0)
+	{
+		Py_DECREF(b.obj);
+		PyErr_Format(PyExc_ValueError, "%d : No such server", server);
+		return NULL;
+	}
+	if (b.error)
+	{
+		Py_DECREF(b.obj);
+		return NULL;
+	}
+	return b.obj;
+}
+
+/*
+ * epic.array("name") -- All of the items in an array (see $setitem())
+ *
+ * Arguments:
+ *	self - ignored (the "epic" module)
+ *	args - A tuple containing
+ *		1. A string - The array name
+ *
+ * Return value:
+ *	NULL - PyArg_ParseTuple() didn't like your tuple (and threw exception)
+ *	NULL / ValueError - There's no such array
+ *	A list of the items, in item number order (like $listarray())
+ */
+PYTHON(array)
+{
+	char *	name;
+	an_array *array;
+	PyObject *list, *item;
+	long	i;
+
+	if (!PyArg_ParseTuple(args, "s", &name)) {
+		return NULL;
+	}
+
+	if (!(array = get_array(LOCAL_COPY(name))))
+	{
+		PyErr_Format(PyExc_ValueError, "%s : No such array", name);
+		return NULL;
+	}
+
+	if (!(list = PyList_New(array->size)))
+		return NULL;
+	for (i = 0; i < array->size; i++)
+	{
+		if (!(item = Py_BuildValue("z", array->item[i])))
+		{
+			Py_DECREF(list);
+			return NULL;
+		}
+		PyList_SET_ITEM(list, i, item);		/* It owns 'item' now */
+	}
+	return list;
+}
 
 static	PyMethodDef	epicMethods[] = {
       /* Higher level facilities  - $-expansion supported */
@@ -1156,6 +1808,14 @@ static	PyMethodDef	epicMethods[] = {
 	{ "set_set",       epic_set_set,	METH_VARARGS,	"Set a /SET value (only)" },
 	{ "set_assign",    epic_set_assign,	METH_VARARGS,	"Set a /ASSIGN value (only)" },
 	{ "builtin_cmd",   epic_builtin_cmd,	METH_VARARGS,	"Make a Python function an EPIC builtin command" },
+	{ "on",            epic_on,		METH_VARARGS,	"Make a Python function an /ON" },
+	{ "run_async",     epic_run_async,	METH_VARARGS,	"Run a Python function on a worker thread" },
+
+      /* Bulk accessors - a whole thing at once */
+	{ "channel_nicks", epic_channel_nicks,	METH_VARARGS,	"Get everybody on a channel, with their status" },
+	{ "lastlog",       epic_lastlog,	METH_VARARGS,	"Get a range of a window's lastlog" },
+	{ "server_005",    epic_server_005,	METH_VARARGS,	"Get all of a server's 005 settings" },
+	{ "array",         epic_array,		METH_VARARGS,	"Get all of the items in an array" },
       /* Lower level IO facilities */
 	{ "callback_when_readable",  epic_callback_when_readable, METH_VARARGS,	"Register a python function for FD event callbacks" },
 	{ "callback_when_writable",  epic_callback_when_writable, METH_VARARGS,	"Register a python function for FD event callbacks" },
@@ -1224,6 +1884,8 @@ char *	python_eval_expression (char *input)
 	if (p_initialized == 0)
 		initialize_python(1);
 
+	python_enter();
+
 	/*
 	 * https://docs.python.org/3/c-api/veryhigh.html
  	 * says that this returns NULL if an exception is raised.
@@ -1239,6 +1901,7 @@ char *	python_eval_expression (char *input)
 
 	Py_XDECREF(retval);
 	Py_XDECREF(retval_repr);
+	python_leave();
 	RETURN_MSTR(retvalstr);	
 }
 
@@ -1274,8 +1937,10 @@ void	python_eval_statement (char *input)
 	 * that python has just dumped the exception to stdout and that
 	 * we are out of luck for reformatting it.
 	 */
+	python_enter();
 	if (PyRun_SimpleString(input))
 		output_traceback();
+	python_leave();
 }
 
 
@@ -1336,6 +2001,7 @@ char *	call_python_directly (const char *orig_object, char *args)
 	}
 	*method++ = 0;
 
+	python_enter();
 	mod_py = Py_BuildValue("z", module);
 	pModule = PyImport_Import(mod_py);
 	Py_XDECREF(mod_py);
@@ -1389,6 +2055,7 @@ c_p_d_cleanup:
 	Py_XDECREF(pFunc);
 	Py_XDECREF(pModule);
 	Py_XDECREF(pRetVal);
+	python_leave();
 
 	RETURN_MSTR(retvalstr);
 }
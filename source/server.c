@@ -353,8 +353,12 @@ static	void		make_options 			(int refnum);
 static	void		destroy_an_option 		(OPTION_item *item);
 static	void		destroy_options 		(int refnum);
 static	char *		get_server_005s 		(int refnum, const char *str);
+	int		walk_server_005			(int refnum, void (*func) (void *, const char *, const char *), void *data);
 	const char *	get_server_005 			(int refnum, const char *setting);
 static	OPTION_item *	new_005_item 			(int refnum, const char *setting);
+static	void		parse_isupport			(ISupport *is, const char *prefix, const char *chanmodes, const char *chantypes);
+static	void		update_isupport			(int refnum);
+static	ISupport *	get_isupport			(int refnum);
 	void		set_server_005 			(int refnum, char *setting, const char *value);
 
 static	char *		get_my_fallback_userhost	(void);
@@ -4399,6 +4403,7 @@ static void	make_options (int refnum)
 	s->options.total_max = 0;
 	s->options.func = (alist_func)strncmp;
 	s->options.hash = HASH_SENSITIVE; /* One way to deal with rfc2812 */
+	update_isupport(refnum);
 }
 
 /*
@@ -4447,6 +4452,7 @@ static void	destroy_options (int refnum)
 	s->options.max = 0;
 	s->options.total_max = 0;
 	new_free(&s->options.list);
+	update_isupport(refnum);
 }
 
 /*
@@ -4488,6 +4494,42 @@ static char *	get_server_005s (int refnum, const char *str)
 	RETURN_EMPTY;
 }
 
+/*
+ * walk_server_005 - Pass every 005 setting for a server to a function
+ *
+ * Parameters:
+ *	refnum	- A server refnum
+ *	func	- A function called with 'data', and the name and value of
+ *		  each setting that was passed to set_server_005().
+ *	data	- Passed to 'func'
+ *
+ * Return value:
+ *	-1 if "refnum" is not a valid server, or else the number of settings.
+ *
+ * This is get_server_005s() and get_server_005() for everything at once.
+ */
+int	walk_server_005 (int refnum, void (*func) (void *, const char *, const char *), void *data)
+{
+	int	i, count = 0;
+	Server *s;
+	OPTION_item *item;
+
+	if (!(s = get_server(refnum)))
+		return -1;
+
+	for (i = 0; i < s->options.max; i++)
+	{
+		if (s->options.list[i]->name == NULL)
+			continue;	/* Ignore nulls */
+		item = (OPTION_item *)s->options.list[i]->data;
+		if (item->type != 0)
+			continue;	/* Ignore non-005s */
+		func(data, item->name, item->value);
+		count++;
+	}
+	return count;
+}
+
 /*
  * get_server_005 - Retrieve an 005 variable for a server
  *
@@ -4595,9 +4637,155 @@ void	set_server_005 (int refnum, char *setting, const char *value)
 		set_server_stricmp_table(refnum, 1);
 	}
 
+	if (!strcmp(setting, "PREFIX") || !strcmp(setting, "CHANMODES") ||
+	    !strcmp(setting, "CHANTYPES"))
+		update_isupport(refnum);
+
 	update_all_status();
 }
 
+/*
+ * parse_isupport - Fill in an ISupport from the 005 values it's made of
+ *
+ * Parameters:
+ *	is	  - The ISupport to fill in
+ *	prefix	  - The PREFIX value, like "(ohv)@%+", or NULL
+ *	chanmodes - The CHANMODES value, like "b,k,l,imnpst", or NULL
+ *	chantypes - The CHANTYPES value, like "#&", or NULL
+ *
+ * Anything that is NULL gets what we always assumed before 005 existed.
+ * The results are exactly what add_to_channel(), chanmodetype() and 
+ * is_channel() used to work out for themselves every time.
+ */
+static void	parse_isupport (ISupport *is, const char *prefix, const char *chanmodes, const char *chantypes)
+{
+	const char *	letters;
+	const char *	symbols;
+	int		modetype;
+
+	memset(is, 0, sizeof(*is));
+
+	/* PREFIX=(ohv)@%+ -- the modes are "ohv" and the symbols are "@%+" */
+	if (prefix && *prefix == '(')
+	{
+		letters = prefix + 1;
+		if ((symbols = strchr(prefix, ')')))
+			symbols++;
+	}
+	else
+	{
+		letters = "ohv";
+		symbols = prefix;
+	}
+	if (!symbols || !*symbols)
+		symbols = "@%+";
+
+	for (; *symbols; symbols++)
+	{
+		if (*letters && *letters != ')')
+			is->prefix_mode[(unsigned char)*symbols] = *letters++;
+		else
+			is->prefix_mode[(unsigned char)*symbols] = *symbols;
+	}
+
+	/*
+	 * CHANMODES=A,B,C,D -- chanmodetype() says 3 for A through 6 for D.
+	 * The PREFIX modes are 2, and + and - are 1.  (So is the nul char, 
+	 * because chanmodetype() used to strchr() it.)
+	 */
+	if (!chanmodes)
+		chanmodes = "b,k,l,imnpst";
+	for (modetype = 3; *chanmodes; chanmodes++)
+	{
+		if (*chanmodes == ',')
+			modetype++;
+		else if (!is->mode_type[(unsigned char)*chanmodes])
+			is->mode_type[(unsigned char)*chanmodes] = modetype;
+	}
+
+	if (!prefix || *prefix != '(')
+		prefix = "(ohv";
+	for (prefix++; *prefix && *prefix != ')'; prefix++)
+		is->mode_type[(unsigned char)*prefix] = 2;
+
+	is->mode_type['+'] = is->mode_type['-'] = is->mode_type[0] = 1;
+
+	/* CHANTYPES=#& -- without it, it's the rfc2811 ones */
+	if (!chantypes || !*chantypes)
+		chantypes = "#&+!";
+	for (; *chantypes; chantypes++)
+		is->chantypes[(unsigned char)*chantypes / 8] |= 
+				1 << ((unsigned char)*chantypes % 8);
+}
+
+/*
+ * update_isupport - Re-parse a server's ISupport from its 005 settings.
+ * This is called whenever one of the settings it's made of changes.
+ */
+static void	update_isupport (int refnum)
+{
+	Server *s;
+
+	if (!(s = get_server(refnum)))
+		return;
+
+	parse_isupport(&s->isupport, get_server_005(refnum, "PREFIX"),
+				     get_server_005(refnum, "CHANMODES"),
+				     get_server_005(refnum, "CHANTYPES"));
+}
+
+/*
+ * get_isupport - Return a server's ISupport, or the one for a server that
+ *		  hasn't told us anything, if 'refnum' isn't a server.
+ */
+static ISupport *	get_isupport (int refnum)
+{
+	static ISupport	default_isupport;
+	static int	default_isupport_ready = 0;
+	Server *	s;
+
+	if ((s = get_server(refnum)))
+		return &s->isupport;
+
+	if (!default_isupport_ready)
+	{
+		parse_isupport(&default_isupport, NULL, NULL, NULL);
+		default_isupport_ready = 1;
+	}
+	return &default_isupport;
+}
+
+/*
+ * get_server_prefix_modes - Which nick prefixes a server uses, as a table
+ *
+ * Return value:
+ *	256 chars.  For each nick prefix symbol (like '@'), the mode it means
+ *	(like 'o').  For everything else, 0.
+ *		  THIS IS NOT YOUR STRING.  You must not modify it.
+ */
+const char *	get_server_prefix_modes (int refnum)
+{
+	return get_isupport(refnum)->prefix_mode;
+}
+
+/*
+ * get_server_chanmode_type - What kind of channel mode 'mode' is.
+ *	This is what chanmodetype() returns -- see there.
+ */
+int	get_server_chanmode_type (int refnum, int mode)
+{
+	return get_isupport(refnum)->mode_type[(unsigned char)mode];
+}
+
+/*
+ * is_server_chantype - Can a channel name start with 'c' on this server?
+ */
+int	is_server_chantype (int refnum, int c)
+{
+	return (get_isupport(refnum)->chantypes[(unsigned char)c / 8] >> 
+			((unsigned char)c % 8)) & 1;
+}
+
 /*
  * get_all_server_groups - Return a list of all "group" fiends used by servers
  *
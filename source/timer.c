@@ -102,6 +102,11 @@ static	void	list_timers (const char *command);
  *		EG, /TIMER -REPEAT -1 -SNAP 60 {echo It's a new minute!} 
  *		will run at the top of every minute.  The first execution
  *		will happen "early" to make it work out.
+ *	/TIMER -SLACK <seconds>
+ *		The TIMER may run up to this many seconds late, so that it
+ *		can run along with some other timer, instead of waking up 
+ *		the client by itself.  (default: 0, or 1% of the interval
+ *		up to 1 second for -SNAP timers)
  *
  *	/TIMER -WINDOW
  *		The TIMER should be a WINDOW Timer (default: auto-detected)
@@ -131,6 +136,7 @@ BUILT_IN_COMMAND(timercmd)
 	int		domref;
 	int		cancelable = 0;
 	int		snap = 0;
+	double		slack = -1;
 
 	if (parsing_server_index != NOSERV)
 	{
@@ -273,6 +279,17 @@ BUILT_IN_COMMAND(timercmd)
 	    {
 		snap = 1;
 	    }
+	    else if (!my_strnicmp(flag + 1, "SLACK", len))	/* SLACK */
+	    {
+		char *na = next_arg(args, &args);
+		if (!na || !*na)
+		{
+			say("%s: Missing argument to -SLACK", command);
+			return;
+		}
+		if ((slack = atof(na)) < 0)
+			slack = 0;
+	    }
 	    else if (!my_strnicmp(flag + 1, "GENERAL", len))	/* GENERAL */
 	    {
 		domain = GENERAL_TIMER;
@@ -329,7 +346,7 @@ BUILT_IN_COMMAND(timercmd)
 */
 
 		add_timer(update, want, interval, events, NULL, args, subargs, 
-				domain, domref, cancelable, snap);
+				domain, domref, cancelable, snap, slack);
 	}
 	else
 		list_timers(command);
@@ -349,8 +366,6 @@ typedef struct  timerlist_stru
 	void *	callback_data;
         char *	command;
 	char	*subargs;
-	struct	timerlist_stru *prev;
-        struct  timerlist_stru *next;
 	long	events;
 	Timespec	interval;
 	int	domain;
@@ -358,9 +373,45 @@ typedef struct  timerlist_stru
 	int	cancelable;
 	long	fires;
 	char *	package;
+	Timespec	slack;		/* How much later it may go off */
+	Timespec	deadline;	/* time + slack */
+	int	heap_index[2];		/* Where in each TimerHeap, or -1 */
+	unsigned long	serial;		/* Breaks ties between equal times */
+	uint32_t	hashval;	/* server_strhash(ref) */
+	struct	timerlist_stru *hnext;	/* Next timer in the hash bucket */
 }       Timer;
 
-static 	Timer *		PendingTimers;
+/*
+ * The scheduled timers are kept in two binary heaps.  One is ordered by
+ * when they go off ("time"), so the next one that is due is always on top.
+ * The other is ordered by the latest they may go off ("deadline", which is
+ * their time plus their slack), so the top of that one is how long the 
+ * client can sleep.  When it wakes up, every timer whose time has come 
+ * goes off, so timers with slack share their wakeups with other timers.
+ * Timers with the same time go off in the order they were scheduled.
+ * Anything that wants to see all the timers in order has to use 
+ * sorted_timers().
+ *
+ * The scheduled timers are also in a hash table by their refnum, which 
+ * is case insensitive (like it always was), so get_timer() is cheap.
+ */
+#define BY_TIME		0
+#define BY_DEADLINE	1
+
+typedef struct timer_heap_stru
+{
+	Timer **	timers;
+	int		size;
+	int		max;
+	int		which;		/* BY_TIME or BY_DEADLINE */
+}	TimerHeap;
+
+static	TimerHeap	timers_by_time = { NULL, 0, 0, BY_TIME };
+static	TimerHeap	timers_by_deadline = { NULL, 0, 0, BY_DEADLINE };
+static	unsigned long	timer_serial = 0;
+
+static	Timer **	timer_buckets = NULL;
+static	int		timer_buckets_size = 0;		/* Always a power of two */
 
 static Timer *	new_timer (void);
 static Timer *	clone_timer (Timer *otimer);
@@ -368,6 +419,7 @@ static void	delete_timer (Timer *otimer);
 static int	schedule_timer (Timer *ntimer);
 static int	unlink_timer (Timer *timer);
 static Timer *	get_timer (const char *ref);
+static Timer **	sorted_timers (void);
 
 /*
  * new_timer - Create a blank Timer that can be filled in.
@@ -392,8 +444,6 @@ static Timer *	new_timer (void)
 	ntimer->callback_data = NULL;
 	ntimer->command = NULL;
 	ntimer->subargs = NULL;
-	ntimer->prev = NULL;
-	ntimer->next = NULL;
 	ntimer->events = 0;
 	ntimer->interval.tv_sec = 0;
 	ntimer->interval.tv_nsec = 0;
@@ -402,6 +452,15 @@ static Timer *	new_timer (void)
 	ntimer->cancelable = 0;
 	ntimer->fires = 0;
 	ntimer->package = NULL;
+	ntimer->slack.tv_sec = 0;
+	ntimer->slack.tv_nsec = 0;
+	ntimer->deadline.tv_sec = 0;
+	ntimer->deadline.tv_nsec = 0;
+	ntimer->heap_index[BY_TIME] = -1;
+	ntimer->heap_index[BY_DEADLINE] = -1;
+	ntimer->serial = 0;
+	ntimer->hashval = 0;
+	ntimer->hnext = NULL;
 	return ntimer;
 }
 
@@ -446,10 +505,9 @@ static Timer *	clone_timer (Timer *otimer)
 	else
 		ntimer->command = malloc_strdup(otimer->command);
 	ntimer->subargs = malloc_strdup(otimer->subargs);
-	ntimer->prev = NULL;
-	ntimer->next = NULL;
 	ntimer->events = otimer->events;
 	ntimer->interval = otimer->interval;
+	ntimer->slack = otimer->slack;
 	ntimer->domain = otimer->domain;
 	ntimer->domref = otimer->domref;
 	ntimer->cancelable = otimer->cancelable;
@@ -469,8 +527,6 @@ static Timer *	clone_timer (Timer *otimer)
  */
 static void	delete_timer (Timer *otimer)
 {
-	Timer *tmp;
-
 	/* 
 	 * First we make sure 'otimer' is not still scheduled
 	 * before we go free()ing it.
@@ -478,15 +534,11 @@ static void	delete_timer (Timer *otimer)
 	 * (The other option is to make this return failure, but 
 	 *  since this is a void function, we'll just DTRT)
 	 */
-	for (tmp = PendingTimers; tmp; tmp = tmp->next)
+	if (otimer->heap_index[BY_TIME] >= 0)
 	{
-		if (tmp == otimer)
-		{
-			yell("delete_timer: Warning: Deleting a timer that "
-				"is still scheduled.  Unscheduling it.");
-			unlink_timer(otimer);
-			break;
-		}
+		yell("delete_timer: Warning: Deleting a timer that "
+			"is still scheduled.  Unscheduling it.");
+		unlink_timer(otimer);
 	}
 
 	if (!otimer->callback)
@@ -499,6 +551,156 @@ static void	delete_timer (Timer *otimer)
 	new_free((char **)&otimer);
 }
 
+/*
+ * timer_before - Does 'a' belong above 'b' in the 'which' heap?
+ */
+static int	timer_before (int which, const Timer *a, const Timer *b)
+{
+	const Timespec *ta, *tb;
+
+	if (which == BY_DEADLINE)
+		ta = &a->deadline, tb = &b->deadline;
+	else
+		ta = &a->time, tb = &b->time;
+
+	if (ta->tv_sec != tb->tv_sec)
+		return ta->tv_sec < tb->tv_sec;
+	if (ta->tv_nsec != tb->tv_nsec)
+		return ta->tv_nsec < tb->tv_nsec;
+	return a->serial < b->serial;
+}
+
+/* Put 'timer' in heap->timers[i] */
+static void	timer_heap_put (TimerHeap *heap, Timer *timer, int i)
+{
+	heap->timers[i] = timer;
+	timer->heap_index[heap->which] = i;
+}
+
+/* Move the timer in heap->timers[i] towards the top until it's in order */
+static void	timer_heap_up (TimerHeap *heap, int i)
+{
+	Timer *	timer = heap->timers[i];
+	int	parent;
+
+	while (i > 0)
+	{
+		parent = (i - 1) / 2;
+		if (!timer_before(heap->which, timer, heap->timers[parent]))
+			break;
+		timer_heap_put(heap, heap->timers[parent], i);
+		i = parent;
+	}
+	timer_heap_put(heap, timer, i);
+}
+
+/* Move the timer in heap->timers[i] towards the bottom until it's in order */
+static void	timer_heap_down (TimerHeap *heap, int i)
+{
+	Timer *	timer = heap->timers[i];
+	int	child;
+
+	while ((child = i * 2 + 1) < heap->size)
+	{
+		if (child + 1 < heap->size && timer_before(heap->which, 
+				heap->timers[child + 1], heap->timers[child]))
+			child++;
+		if (!timer_before(heap->which, heap->timers[child], timer))
+			break;
+		timer_heap_put(heap, heap->timers[child], i);
+		i = child;
+	}
+	timer_heap_put(heap, timer, i);
+}
+
+static void	timer_heap_insert (TimerHeap *heap, Timer *timer)
+{
+	if (heap->size >= heap->max)
+	{
+		heap->max = heap->max ? heap->max * 2 : 16;
+		RESIZE(heap->timers, Timer *, heap->max);
+	}
+
+	timer_heap_put(heap, timer, heap->size++);
+	timer_heap_up(heap, heap->size - 1);
+}
+
+/* Returns -1 if 'timer' isn't in 'heap' */
+static int	timer_heap_remove (TimerHeap *heap, Timer *timer)
+{
+	Timer *	last;
+	int	i;
+
+	if ((i = timer->heap_index[heap->which]) < 0 || i >= heap->size || 
+			heap->timers[i] != timer)
+		return -1;
+
+	/* Fill the hole with the last timer, and put that where it goes */
+	last = heap->timers[--heap->size];
+	heap->timers[heap->size] = NULL;
+	if (last != timer)
+	{
+		timer_heap_put(heap, last, i);
+		if (i > 0 && timer_before(heap->which, last, 
+						heap->timers[(i - 1) / 2]))
+			timer_heap_up(heap, i);
+		else
+			timer_heap_down(heap, i);
+	}
+	timer->heap_index[heap->which] = -1;
+	return 0;
+}
+
+/* Put a timer in the refnum hash table (after its ref is set) */
+static void	hash_timer (Timer *timer)
+{
+	Timer **	old;
+	Timer *		t;
+	int		old_size, i;
+
+	/* The heap already counts this timer */
+	if (timers_by_time.size > timer_buckets_size)
+	{
+		old = timer_buckets;
+		old_size = timer_buckets_size;
+		timer_buckets_size = timer_buckets_size ? timer_buckets_size * 2 : 16;
+		timer_buckets = (Timer **)new_malloc(sizeof(Timer *) * timer_buckets_size);
+		for (i = 0; i < old_size; i++)
+		{
+			while ((t = old[i]))
+			{
+				old[i] = t->hnext;
+				t->hnext = timer_buckets[t->hashval & (timer_buckets_size - 1)];
+				timer_buckets[t->hashval & (timer_buckets_size - 1)] = t;
+			}
+		}
+		new_free((char **)&old);
+	}
+
+	timer->hashval = server_strhash(timer->ref);
+	timer->hnext = timer_buckets[timer->hashval & (timer_buckets_size - 1)];
+	timer_buckets[timer->hashval & (timer_buckets_size - 1)] = timer;
+}
+
+/* Take a timer out of the refnum hash table */
+static void	unhash_timer (Timer *timer)
+{
+	Timer **	p;
+
+	if (!timer_buckets_size)
+		return;
+
+	for (p = &timer_buckets[timer->hashval & (timer_buckets_size - 1)]; *p; p = &(*p)->hnext)
+	{
+		if (*p == timer)
+		{
+			*p = timer->hnext;
+			timer->hnext = NULL;
+			return;
+		}
+	}
+}
+
 /*
  * schedule_timer: Submit a completed Timer to be executed later.
  *		   You must not change the Timer after it is submitted.
@@ -506,7 +708,7 @@ static void	delete_timer (Timer *otimer)
  * Arguments:
  *	ntimer - A completely filled-in timer that needs to be executed.
  *	  	(a) ntimer->time must point to when the timer is to go off.
- *		(b) ntimer->prev and ->next will be overwritten.
+ *		(b) ntimer->ref must not change while it is scheduled.
  *		(c) You must not change 'ntimer' after this returns.
  *		(d) ntimer must not already be scheduled.
  *
@@ -515,59 +717,24 @@ static void	delete_timer (Timer *otimer)
  */
 static int	schedule_timer (Timer *ntimer)
 {
-	Timer *tmp, *prev;
-
 	ntimer->fires = 0;
 
 	/*
 	 * If 'ntimer' is already scheduled, we will desschedule it,
 	 * so that it may be re-inserted in the correct place.
 	 */
-	for (tmp = PendingTimers; tmp; tmp = tmp->next)
-	{
-		if (tmp == ntimer)
-		{
-			yell("schedule_timer: Warning: Scheduling a timer "
-				"that is already scheduled.  Fixing that.");
-			unlink_timer(ntimer);
-			break;
-		}
-	}
-
-	/* Figure out the correct place */
-	for (tmp = PendingTimers; tmp; tmp = tmp->next)
-	{
-		if (time_diff(tmp->time, ntimer->time) < 0)
-			break;
-	}
-
-	/* 'ntimer' is earlier than all the timers in PendingTimers */
-	if (tmp == PendingTimers)
-	{
-		ntimer->prev = NULL;
-		ntimer->next = PendingTimers;
-		if (PendingTimers)
-			PendingTimers->prev = ntimer;
-		PendingTimers = ntimer;
-	}
-	/* 'ntimer' is earlier than 'tmp' but later than 'tmp->prev' */
-	else if (tmp)
+	if (ntimer->heap_index[BY_TIME] >= 0)
 	{
-		prev = tmp->prev;
-		ntimer->next = tmp;
-		ntimer->prev = prev;
-		tmp->prev = ntimer;
-		prev->next = ntimer;
-	}
-	/* 'ntimer' is later than every timer in PendingTimers */
-	else
-	{
-		for (tmp = PendingTimers; tmp->next; tmp = tmp->next)
-			;
-		tmp->next = ntimer;
-		ntimer->prev = tmp;
+		yell("schedule_timer: Warning: Scheduling a timer "
+			"that is already scheduled.  Fixing that.");
+		unlink_timer(ntimer);
 	}
 
+	ntimer->serial = ++timer_serial;
+	ntimer->deadline = time_add(ntimer->time, ntimer->slack);
+	timer_heap_insert(&timers_by_time, ntimer);
+	timer_heap_insert(&timers_by_deadline, ntimer);
+	hash_timer(ntimer);
 	return 0;
 }
 
@@ -575,9 +742,7 @@ static int	schedule_timer (Timer *ntimer)
  * unlink_timer - Remove a Timer from the TimerList ("unschedule it")
  * 
  * Arguments:
- *	timer	- A Timer on the TimerList.
- *		  (a) It is an error to unlink a timer not on the timer list.
- *		      Doing so may result in a crash.
+ *	timer	- A Timer, which may or may not be scheduled.
  *
  * Return Value:
  *	-1	- The timer was not scheduled (no change to 'timer')
@@ -585,33 +750,16 @@ static int	schedule_timer (Timer *ntimer)
  */
 static int	unlink_timer (Timer *timer)
 {
-	Timer *tmp, *prev, *next;
-
 	/*
 	 * We only modify 'timer' if it is actually scheduled.
 	 * unlinking an unscheduled timer is a safe no-op.
 	 */
-	for (tmp = PendingTimers; tmp; tmp = tmp->next)
-	{
-		if (tmp == timer)
-		{
-			prev = timer->prev;
-			next = timer->next;
-
-			if (prev)
-				prev->next = next;
-			else
-				PendingTimers = next;
-
-			if (next)
-				next->prev = prev;
-
-			return 0;
-		}
-	}
+	if (timer_heap_remove(&timers_by_time, timer) < 0)
+		return -1;
 
-	/* I didn't find that timer on the schedule list */
-	return -1;
+	timer_heap_remove(&timers_by_deadline, timer);
+	unhash_timer(timer);
+	return 0;
 }
 
 /*
@@ -636,21 +784,61 @@ static int	unlink_timer (Timer *timer)
  */
 static	Timer *get_timer (const char *ref)
 {
-	Timer *tmp;
+	Timer *		tmp;
+	uint32_t	hashval;
 
 	/* 'ref' must be a non-empty string */
 	if (!ref || !*ref)
 		return NULL;
 
-	for (tmp = PendingTimers; tmp; tmp = tmp->next)
+	if (!timer_buckets_size)
+		return NULL;
+
+	hashval = server_strhash(ref);
+	for (tmp = timer_buckets[hashval & (timer_buckets_size - 1)]; tmp; tmp = tmp->hnext)
 	{
-		if (!my_stricmp(tmp->ref, ref))
+		if (tmp->hashval == hashval && !my_stricmp(tmp->ref, ref))
 			return tmp;
 	}
 
 	return NULL;
 }
 
+static int	timer_sort_func (const void *p1, const void *p2)
+{
+	const Timer *a = *(const Timer * const *)p1;
+	const Timer *b = *(const Timer * const *)p2;
+
+	if (timer_before(BY_TIME, a, b))
+		return -1;
+	if (timer_before(BY_TIME, b, a))
+		return 1;
+	return 0;
+}
+
+/*
+ * sorted_timers - A copy of the schedule, in the order the timers go off.
+ *
+ * Return Value:
+ *	A new_malloc()ed array of all of the scheduled timers,
+ *	followed by a NULL.  You must new_free() it when you're done.
+ *	It's safe to unlink and delete timers while walking the copy.
+ */
+static Timer **	sorted_timers (void)
+{
+	Timer **	list;
+	int		count = timers_by_time.size;
+
+	list = (Timer **)new_malloc(sizeof(Timer *) * (count + 1));
+	if (count)
+	{
+		memcpy(list, timers_by_time.timers, sizeof(Timer *) * count);
+		qsort(list, count, sizeof(Timer *), timer_sort_func);
+	}
+	list[count] = NULL;
+	return list;
+}
+
 /*
  * timer_exists - Verify if a refnum is in use by a scheduled Timer.
  *
@@ -678,9 +866,10 @@ int 	timer_exists (const char *ref)
  */
 void    dump_timers (void)
 {
-        Timer   *tmp;
+        Timer   **list, *tmp;
         Timespec current;
         double  time_left;
+	int	i;
 
         yell("*X*X*X*X*X*X*X*X*X* WARNING *X*X*X*X*X*X*X*X*X*X");
         yell("POLLING LOOP DETECTED -- IMPORTANT DEBUGGING INFO");
@@ -689,7 +878,8 @@ void    dump_timers (void)
         say("Timer     Seconds   Events Command");
 
         get_time(&current);
-        for (tmp = PendingTimers; tmp; tmp = tmp->next)
+	list = sorted_timers();
+        for (i = 0; (tmp = list[i]); i++)
         {
                 time_left = time_diff(current, tmp->time);
                 if (time_left <= 0)
@@ -703,6 +893,7 @@ void    dump_timers (void)
 				tmp->fires,
                                 tmp->callback ? "SYSTEM" : tmp->command);
         }
+	new_free((char **)&list);
         yell("Make sure to give this list to hop on #epic on efnet!");
         yell("*X*X*X*X*X*X*X*X*X* WARNING *X*X*X*X*X*X*X*X*X*X");
 }
@@ -714,13 +905,15 @@ void    dump_timers (void)
  */
 static	void	list_timers (const char *command)
 {
-	Timer	*tmp;
+	Timer	**list, *tmp;
 	Timespec current;
 	double	time_left;
 	int	timer_count = 0;
+	int	i;
 
 	get_time(&current);
-	for (tmp = PendingTimers; tmp; tmp = tmp->next)
+	list = sorted_timers();
+	for (i = 0; (tmp = list[i]); i++)
 	{
 		if (tmp->callback)
 			continue;
@@ -736,6 +929,7 @@ static	void	list_timers (const char *command)
 		say("%-10s %-10.2f %-7ld %s", tmp->ref, time_left, 
 					tmp->events, tmp->command);
 	}
+	new_free((char **)&list);
 
 	if (timer_count == 0)
 		say("%s: No commands pending to be executed", command);
@@ -769,39 +963,23 @@ static	void	list_timers (const char *command)
  */
 static	int	create_timer_ref (const char *refnum_wanted, char **refnum_gets)
 {
-	Timer *	tmp;
-	int	i, 
-		pts;
+	char	buffer[32];
+	int	i;
 
 	/* If the user doesnt care */
 	if (!refnum_wanted || !*refnum_wanted)
 	{
-		/* So ... we count the number of timers that exist. */
-		for (pts = 0, tmp = PendingTimers; tmp; tmp = tmp->next)
-			pts++;
-
 		/* 
-		 * Now, for all the numbers (0 .. [timer count + 1]), 
+		 * For all the numbers (0 .. [timer count + 1]), 
 		 * at least one of those numbers *has* to be available,
 		 */ 
-		for (i = 0; i <= pts + 1; i++)
+		for (i = 0; i <= timers_by_time.size + 1; i++)
 		{
-			/* Are any timers named 'i'? */
-			for (tmp = PendingTimers; tmp; tmp = tmp->next)
+			/* Is any timer named 'i'?  If not, 'i' is our winner! */
+			snprintf(buffer, sizeof(buffer), "%d", i);
+			if (!get_timer(buffer))
 			{
-				if (!is_number(tmp->ref))
-					continue;
-				if (i == my_atol(tmp->ref))
-					break;
-			}
-
-			/* 
-			 * If 'tmp' is null, then we didn't find a refnum 'i'.
-			 * So 'i' is our winner!
-			 */
-			if (tmp == NULL)
-			{
-				malloc_sprintf(refnum_gets, "%d", i);
+				malloc_strcpy(refnum_gets, buffer);
 				break;
 			}
 		}
@@ -842,25 +1020,28 @@ int	remove_timer (const char *ref)
 
 static void 	remove_all_timers (void)
 {
-	Timer *ref, *next;
+	Timer **list, *ref;
+	int	i;
 
-	for (ref = PendingTimers; ref; ref = next)
+	list = sorted_timers();
+	for (i = 0; (ref = list[i]); i++)
 	{
-		next = ref->next;
 		if (ref->callback)
 			continue;
 		unlink_timer(ref);
 		delete_timer(ref);
 	}
+	new_free((char **)&list);
 }
 
 static	void	remove_timers_by_domref (int domain, int domref)
 {
-	Timer *ref, *next;
+	Timer **list, *ref;
+	int	i;
 
-	for (ref = PendingTimers; ref; ref = next)
+	list = sorted_timers();
+	for (i = 0; (ref = list[i]); i++)
 	{
-		next = ref->next;
 		if (ref->callback)
 			continue;
 		if (ref->domain != domain)
@@ -870,6 +1051,7 @@ static	void	remove_timers_by_domref (int domain, int domref)
 		unlink_timer(ref);
 		delete_timer(ref);
 	}
+	new_free((char **)&list);
 }
 
 
@@ -926,8 +1108,14 @@ static	void	remove_timers_by_domref (int domain, int domref)
  *  snap:	A "snap" timer runs every time (time() % interval == 0).
  *		This is useful for things that (eg) run at the top of every 
  *		minute (60), hour (3600), or day (86400)
+ *  slack:	How many seconds late the timer may go off, so it can go off
+ *		along with some other timer instead of waking up the client
+ *		by itself.  Timers that don't care about being a little late
+ *		should have some slack.  A negative value means the default:
+ *		0 for most timers, and 1% of the interval (at most 1 second)
+ *		for snap timers.
  */
-char *	add_timer (int update, const char *refnum_want, double interval, long events, int (callback) (void *), void *commands, const char *subargs, TimerDomain domain, int domref, int cancelable, int snap)
+char *	add_timer (int update, const char *refnum_want, double interval, long events, int (callback) (void *), void *commands, const char *subargs, TimerDomain domain, int domref, int cancelable, int snap, double slack)
 {
 	Timer *		ntimer;
 	Timer *		otimer = NULL;
@@ -999,6 +1187,18 @@ char *	add_timer (int update, const char *refnum_want, double interval, long eve
 			ntimer->time = time_add(right_now, ntimer->interval);
 	}
 
+	/* Update the slack */
+	if (update == 1 && slack < 0)
+		(void) 0;	/* XXX sigh - not updating slack */
+	else
+	{
+		if (slack < 0 && snap)
+			slack = interval / 100 < 1 ? interval / 100 : 1;
+		else if (slack < 0)
+			slack = 0;
+		ntimer->slack = double_to_timespec(slack);
+	}
+
 	/* Update the repeat events */
 	if (update == 1 && events == -2)
 		(void) 0;	/* XXX sigh - not updating events */
@@ -1050,7 +1250,11 @@ char *	add_timer (int update, const char *refnum_want, double interval, long eve
 
 /*
  * TimerTimeout:  Called from irc_io to help create the timeout
- * part of the call to poll().
+ * part of the call to poll().  This is how long until the first 
+ * deadline; any other timers whose time has come by then go off
+ * at the same time.  The clock (see clock.c) is just another timer,
+ * so if no timer is pending, the client can sleep until some data
+ * comes in.
  */
 Timespec	TimerTimeout (void)
 {
@@ -1060,12 +1264,12 @@ Timespec	TimerTimeout (void)
 	Timespec	timeout_in;
 
 	/* This, however, should never happen. */
-	if (!PendingTimers)
+	if (!timers_by_deadline.size)
 		return forever;
 
 	get_time(&current);
-	timeout_in = time_subtract(current, PendingTimers->time);
-	PendingTimers->fires++;
+	timeout_in = time_subtract(current, timers_by_deadline.timers[0]->deadline);
+	timers_by_deadline.timers[0]->fires++;
 	if (time_diff(right_away, timeout_in) < 0)
 		timeout_in = right_away;
 	return timeout_in;
@@ -1086,12 +1290,13 @@ void 	ExecuteTimers (void)
 	int	old_from_server = from_server;
 
 	get_time(&right_now);
-	while (PendingTimers && time_diff(right_now, PendingTimers->time) < 0)
+	while (timers_by_time.size && 
+		time_diff(right_now, timers_by_time.timers[0]->time) < 0)
 	{
 		int	old_refnum;
 
 		old_refnum = get_window_refnum(0);
-		current = PendingTimers;
+		current = timers_by_time.timers[0];
 		unlink_timer(current);
 
 		/* Reschedule the timer if necessary */
@@ -1183,6 +1388,7 @@ advance:
  *	SUBARGS		The vaule of $* used when this timer is executed
  *	REPEATS		The number of times this timer will be executed
  *	INTERVAL	The interval of time between executions
+ *	SLACK		How late the timer may be executed
  *	SERVER		The server this timer bound to
  *	WINDOW		The window this timer bound to
  *	PACKAGE		The /load package the timer bound to
@@ -1203,8 +1409,13 @@ char *	timerctl (char *input)
 		RETURN_STR(t->ref);
 	} else if (!my_strnicmp(listc, "REFNUMS", len)) {
 		char *	retval = NULL;
-		for (t = PendingTimers; t; t = t->next)
+		Timer **list;
+		int	i;
+
+		list = sorted_timers();
+		for (i = 0; (t = list[i]); i++)
 			malloc_strcat_word(&retval, space, t->ref, DWORD_DWORDS);
+		new_free((char **)&list);
 		RETURN_MSTR(retval);
 	} else if (!my_strnicmp(listc, "ADD", len)) {
 		RETURN_EMPTY;		/* XXX - Not implemented yet. */
@@ -1238,6 +1449,9 @@ char *	timerctl (char *input)
 		} else if (!my_strnicmp(listc, "INTERVAL", len)) {
 			return malloc_sprintf(NULL, "%ld %ld", (long) t->interval.tv_sec,
 						    (long)(t->interval.tv_nsec / 1000));
+		} else if (!my_strnicmp(listc, "SLACK", len)) {
+			return malloc_sprintf(NULL, "%ld %ld", (long) t->slack.tv_sec,
+						    (long)(t->slack.tv_nsec / 1000));
 		} else if (!my_strnicmp(listc, "SERVER", len)) {
 			if (t->domain != SERVER_TIMER)
 				RETURN_INT(-1);
@@ -1266,8 +1480,12 @@ char *	timerctl (char *input)
 
 			GET_INT_ARG(tv_sec, input);
 			GET_INT_ARG(tv_usec, input);
+
+			/* It has to move to its new place in the schedule */
+			unlink_timer(t);
 			t->time.tv_sec = tv_sec;
 			t->time.tv_nsec = tv_usec * 1000;
+			schedule_timer(t);
 		} else if (!my_strnicmp(listc, "COMMAND", len)) {
 			malloc_strcpy((char **)&t->command, input);
 		} else if (!my_strnicmp(listc, "SUBARGS", len)) {
@@ -1285,6 +1503,21 @@ char *	timerctl (char *input)
 			GET_INT_ARG(tv_usec, input);
 			t->interval.tv_sec = tv_sec;
 			t->interval.tv_nsec = tv_usec * 1000;
+		} else if (!my_strnicmp(listc, "SLACK", len)) {
+			time_t	tv_sec;
+			long	tv_usec;
+
+			GET_INT_ARG(tv_sec, input);
+			GET_INT_ARG(tv_usec, input);
+
+			if (tv_sec < 0 || tv_usec < 0)
+				tv_sec = tv_usec = 0;
+
+			/* Its deadline moves, so it has to be rescheduled */
+			unlink_timer(t);
+			t->slack.tv_sec = tv_sec;
+			t->slack.tv_nsec = tv_usec * 1000;
+			schedule_timer(t);
 		} else if (!my_strnicmp(listc, "SERVER", len)) {
 			int	refnum;
 
@@ -1313,9 +1546,11 @@ char *	timerctl (char *input)
 void    timers_swap_windows (unsigned oldref, unsigned newref)
 {
 	Timer *ref;
+	int	i;
 
-	for (ref = PendingTimers; ref; ref = ref->next)
+	for (i = 0; i < timers_by_time.size; i++)
         {
+		ref = timers_by_time.timers[i];
                 if (ref->domain != WINDOW_TIMER)
                         continue;
 
@@ -1331,9 +1566,11 @@ void    timers_swap_windows (unsigned oldref, unsigned newref)
 void    timers_merge_windows (unsigned oldref, unsigned newref)
 {
 	Timer *ref;
+	int	i;
 
-	for (ref = PendingTimers; ref; ref = ref->next)
+	for (i = 0; i < timers_by_time.size; i++)
         {
+		ref = timers_by_time.timers[i];
                 if (ref->domain != WINDOW_TIMER)
                         continue;
 
@@ -1344,18 +1581,18 @@ void    timers_merge_windows (unsigned oldref, unsigned newref)
 
 void	unload_timers (char *filename)
 {
-	Timer *ref;
+	Timer **list, *ref;
+	int	i;
 
-	for (ref = PendingTimers; ref; )
+	list = sorted_timers();
+	for (i = 0; (ref = list[i]); i++)
 	{
 		if (filename && ref->package && !my_stricmp(ref->package, filename))
 		{
 			unlink_timer(ref);
 			delete_timer(ref);
-			ref = PendingTimers;
 		}
-		else
-			ref = ref->next;
 	}
+	new_free((char **)&list);
 }
 
@@ -426,8 +426,11 @@ void 	init_variables_stage1 (void)
 	VAR(INSERT_MODE,		BOOL, update_all_status_wrapper);
 	VAR(KEY_INTERVAL,		INT,  set_key_interval);
 	VAR(LASTLOG, 			INT,  set_lastlog_size);
+	VAR(LASTLOG_INDEX,		BOOL, set_lastlog_index);
 	VAR(LASTLOG_LEVEL,		STR,  set_lastlog_mask);
 	VAR(LASTLOG_REWRITE,		STR,  (SetFunc)0);
+#define DEFAULT_LOAD_CACHE (char *)0
+	VAR(LOAD_CACHE,			STR,  (SetFunc)0);
 #define DEFAULT_LOAD_PATH (char *)0
 	VAR(LOAD_PATH,			STR,  (SetFunc)0);
 	VAR(LOG,			BOOL, logger);
@@ -6759,9 +6759,11 @@ WINDOWCMD(merge)
 		{
 			List *h;
 
-			h = window->nicks;
-			window->nicks = h->next;
-			add_item_to_list(&tmp->nicks, h);
+			while ((h = window->nicks))
+			{
+				window->nicks = h->next;
+				add_item_to_list(&tmp->nicks, h);
+			}
 		}
 
 		/* * */